@@ -22,11 +22,26 @@ public:
     // Pure virtual function for calculating magnetic field
     virtual glm::vec3 calculateMagneticField(const glm::vec3& pos) const = 0;
 
-    // Get the trace start points
-    const std::vector<TraceStartPoint>& getTraceStartPoints() const { return mTraceStartPoints; }
+    // Bring cached field state up to date. Called on one thread before field queries run
+    // concurrently, so the queries themselves only read.
+    virtual void prepareFieldQueries() const {}
+
+    // Get the trace start points, rebuilding them first if they are stale
+    const std::vector<TraceStartPoint>& getTraceStartPoints() const {
+        if (mTraceStartPointsDirty) {
+            updateTraceStartPoints();
+            mTraceStartPointsDirty = false;
+        }
+        return mTraceStartPoints;
+    }
 
 	float mPixelsPerMeter = 100.0f; // Conversion factor from meters to pixels
 
 protected:
-    std::vector<TraceStartPoint> mTraceStartPoints;
+    // Rebuild mTraceStartPoints, called lazily on the first read after they were marked dirty
+    virtual void updateTraceStartPoints() const {}
+    void markTraceStartPointsDirty() { mTraceStartPointsDirty = true; }
+
+    mutable std::vector<TraceStartPoint> mTraceStartPoints;
+    mutable bool mTraceStartPointsDirty = true;
 };
\ No newline at end of file
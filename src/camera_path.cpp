@@ -0,0 +1,61 @@
+#include "camera_path.h"
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+
+static glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return 0.5f * ((2.0f * p1) + (-p0 + p2) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (-p0 + 3.0f * p1 - 3.0f * p2 + p3) * t3);
+}
+
+void CameraPath::addKeyframe(const CameraKeyframe& keyframe) {
+    auto it = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), keyframe.time,
+        [](float time, const CameraKeyframe& other) { return time < other.time; });
+    m_keyframes.insert(it, keyframe);
+}
+
+void CameraPath::setOrbit(const glm::vec3& target, float radius, float height, float fov, float duration) {
+    // Enough keyframes that the spline stays close to the circle
+    const int segments = 16;
+    m_keyframes.clear();
+    for (int i = 0; i <= segments; ++i) {
+        float angle = 2.0f * glm::pi<float>() * i / segments;
+        CameraKeyframe keyframe;
+        keyframe.time = duration * i / segments;
+        keyframe.position = target + glm::vec3(std::sin(angle) * radius, height, std::cos(angle) * radius);
+        keyframe.target = target;
+        keyframe.fov = fov;
+        m_keyframes.push_back(keyframe);
+    }
+}
+
+CameraKeyframe CameraPath::sample(float time) const {
+    if (m_keyframes.empty()) {
+        return CameraKeyframe();
+    }
+    if (time <= m_keyframes.front().time) {
+        return m_keyframes.front();
+    }
+    if (time >= m_keyframes.back().time) {
+        return m_keyframes.back();
+    }
+
+    // Segment [i, i + 1] containing time, end points repeated at the ends of the path
+    size_t i = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), time,
+        [](float t, const CameraKeyframe& other) { return t < other.time; }) - m_keyframes.begin() - 1;
+    const CameraKeyframe& k0 = m_keyframes[i > 0 ? i - 1 : i];
+    const CameraKeyframe& k1 = m_keyframes[i];
+    const CameraKeyframe& k2 = m_keyframes[i + 1];
+    const CameraKeyframe& k3 = m_keyframes[std::min(i + 2, m_keyframes.size() - 1)];
+    float span = k2.time - k1.time;
+    float t = span > 0.0f ? (time - k1.time) / span : 0.0f;
+
+    CameraKeyframe result;
+    result.time = time;
+    result.position = catmullRom(k0.position, k1.position, k2.position, k3.position, t);
+    result.target = catmullRom(k0.target, k1.target, k2.target, k3.target, t);
+    result.fov = k1.fov + (k2.fov - k1.fov) * t;
+    return result;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Camera pose at a point in time
+struct CameraKeyframe {
+    float time{ 0.0f };
+    glm::vec3 position{ 0.0f, 0.0f, 5.0f };
+    glm::vec3 target{ 0.0f };
+    float fov{ 60.0f }; // Vertical field of view (degrees)
+};
+
+// Keyframed camera path for rendering image sequences. Positions and targets follow a
+// Catmull-Rom spline through the keyframes, the field of view is interpolated linearly.
+// Sampling outside the keyframe times holds the first or last pose.
+class CameraPath {
+public:
+    // Insert a keyframe, keeping keyframes ordered by time
+    void addKeyframe(const CameraKeyframe& keyframe);
+    // Replace the path with a full circle around target in the XZ plane, at height above it
+    void setOrbit(const glm::vec3& target, float radius, float height, float fov, float duration);
+    void clear() { m_keyframes.clear(); }
+
+    CameraKeyframe sample(float time) const;
+
+    bool empty() const { return m_keyframes.empty(); }
+    float getStartTime() const { return m_keyframes.empty() ? 0.0f : m_keyframes.front().time; }
+    float getEndTime() const { return m_keyframes.empty() ? 0.0f : m_keyframes.back().time; }
+
+private:
+    std::vector<CameraKeyframe> m_keyframes;
+};
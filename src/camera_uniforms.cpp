@@ -0,0 +1,18 @@
+#include "camera_uniforms.h"
+
+void CameraUniformBuffer::initialize(GpuResourceManager& resources) {
+    m_buffer = &resources.createBuffer("Camera UBO");
+    m_buffer->reserve(sizeof(CameraUniformsGL));
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, m_buffer->getBuffer());
+}
+
+void CameraUniformBuffer::update(const glm::mat4& view, const glm::mat4& projection) {
+    if (m_version != 0 && view == m_data.view && projection == m_data.projection) {
+        return;
+    }
+    m_data.view = view;
+    m_data.projection = projection;
+    if (m_buffer->upload(++m_version, &m_data, sizeof(m_data)) == GpuBuffer::UploadResult::Reallocated) {
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, m_buffer->getBuffer());
+    }
+}
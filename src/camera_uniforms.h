@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gpu_resources.h"
+
+// Matches CameraBlock in the vertex shaders, std140 layout
+struct CameraUniformsGL {
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+// Per-frame camera matrices shared by every program through one uniform block, so they
+// are written once instead of being set on each program
+class CameraUniformBuffer {
+public:
+    static constexpr unsigned int BINDING = 0;
+
+    void initialize(GpuResourceManager& resources);
+    // Upload the matrices if they differ from the last upload
+    void update(const glm::mat4& view, const glm::mat4& projection);
+
+private:
+    GpuBuffer* m_buffer{ nullptr };
+    CameraUniformsGL m_data{ glm::mat4(0.0f), glm::mat4(0.0f) };
+    uint64_t m_version{ 0 };
+};
@@ -1,4 +1,6 @@
 #include "dipole.h"
+#include <array>
+#include <cmath>
 #include <glm/gtc/constants.hpp>
 
 // Constructor that uses default forward direction (0,0,-1)
@@ -7,7 +9,6 @@ MagneticDipole::MagneticDipole(const glm::vec3& position, float moment, Transfor
     , BaseMagnet(pixelsPerMeter)
     , mMoment(moment)
 {
-    initializeDipoleTracePoints();
 }
 
 // Constructor that initializes with a specific direction
@@ -19,31 +20,34 @@ MagneticDipole::MagneticDipole(const glm::vec3& position, const glm::vec3& initi
     setDirection(initialDirection);
 }
 
-void MagneticDipole::updateWorldTransformMatrix()
+void MagneticDipole::onWorldTransformChanged()
 {
-    Transform::updateWorldTransformMatrix();
-    initializeDipoleTracePoints();
+    markTraceStartPointsDirty();
 }
 
-void MagneticDipole::initializeDipoleTracePoints() {
-    mTraceStartPoints.clear();
-
+void MagneticDipole::updateTraceStartPoints() const {
     constexpr int NUM_POINTS = 6; // Number of points in circle
-    float radius = 0.04f; // Small radius in meters
+    constexpr float radius = 0.04f; // Small radius in meters
+
+    // Unit circle offsets are the same for every dipole, compute them once
+    static const std::array<glm::vec2, NUM_POINTS> circle = [] {
+        std::array<glm::vec2, NUM_POINTS> points;
+        for (int i = 0; i < NUM_POINTS; ++i) {
+            float angle = i * 2.0f * glm::pi<float>() / NUM_POINTS;
+            points[i] = glm::vec2(std::cos(angle), std::sin(angle));
+        }
+        return points;
+    }();
 
     glm::vec3 center = getWorldPosition();
-    glm::vec3 up = getUp();
-    glm::vec3 right = getRight();
+    glm::vec3 up = getUp() * radius;
+    glm::vec3 right = getRight() * radius;
 
-    // Create points in a circle perpendicular to the dipole direction
+    // Create points in a circle perpendicular to the dipole direction, reusing storage
+    mTraceStartPoints.resize(NUM_POINTS);
     for (int i = 0; i < NUM_POINTS; ++i) {
-        float angle = i * 2.0f * glm::pi<float>() / NUM_POINTS;
-        glm::vec3 offset = (cos(angle) * right + sin(angle) * up) * radius;
-
-        TraceStartPoint point;
-        point.position = center + offset;
-        point.direction = TraceDirection::Both;
-        mTraceStartPoints.push_back(point);
+        mTraceStartPoints[i].position = center + circle[i].x * right + circle[i].y * up;
+        mTraceStartPoints[i].direction = TraceDirection::Both;
     }
 }
 
@@ -52,7 +56,6 @@ void MagneticDipole::setDirection(const glm::vec3& direction) {
         // Use lookAt to orient the dipole in the direction
         glm::vec3 targetPos = getWorldPosition() + glm::normalize(direction);
         lookAt(targetPos);
-        initializeDipoleTracePoints(); // Update trace points when direction changes
     }
 }
 
@@ -70,12 +73,12 @@ float MagneticDipole::getMoment() const {
 }
 
 glm::vec3 MagneticDipole::calculateMagneticField(const glm::vec3& pos) const {
-    // Get the world position of the dipole using the Transform functionality
-    glm::vec3 dipoleWorldPos = getWorldPosition();
-
-    // Get the dipole direction from the transform's forward vector
-    glm::vec3 dipoleDirection = getDirection();
+    // World position and direction come from the Transform functionality
+    return calculateDipoleField(pos, getWorldPosition(), getDirection(), mMoment, mPixelsPerMeter);
+}
 
+glm::vec3 MagneticDipole::calculateDipoleField(const glm::vec3& pos, const glm::vec3& dipoleWorldPos, const glm::vec3& dipoleDirection,
+    float moment, float pixelsPerMeter) {
     // Calculate the field based on the world position
     glm::vec3 A = pos - dipoleWorldPos; // Relative position of pos from dipole
     float r = glm::length(A);
@@ -107,20 +110,42 @@ glm::vec3 MagneticDipole::calculateMagneticField(const glm::vec3& pos) const {
     float sin_theta_mag = glm::length(dirTangential);
 
     // Convert to meters for field calculation
-    float r_meters = r / mPixelsPerMeter;
+    float r_meters = r / pixelsPerMeter;
     float r_cube = r_meters * r_meters * r_meters;
 
     // Calculate field components
-    float B_r = (2.0f * mMoment * cos_theta) / r_cube; // Radial field magnitude
+    float B_r = (2.0f * moment * cos_theta) / r_cube; // Radial field magnitude
 
     glm::vec3 B_field = B_r * A_rad; // Start with radial component
 
     // Add tangential component if it exists
     if (sin_theta_mag > 0.0001f) {
         glm::vec3 A_tan_dir = dirTangential / sin_theta_mag;
-        float B_theta = (mMoment * sin_theta_mag) / r_cube; // Tangential field magnitude
+        float B_theta = (moment * sin_theta_mag) / r_cube; // Tangential field magnitude
         B_field += B_theta * A_tan_dir;
     }
 
     return B_field;
-}
\ No newline at end of file
+}
+
+glm::mat3 MagneticDipole::calculateDipoleFieldGradient(const glm::vec3& pos, const glm::vec3& dipoleWorldPos, const glm::vec3& dipoleDirection,
+    float moment, float pixelsPerMeter) {
+    glm::vec3 A = pos - dipoleWorldPos;
+    float r = glm::length(A);
+
+    if (r < 0.0001f) return glm::mat3(0.0f); // Matches the field's cutoff
+
+    // The field above is k ((d·A) A / r^5 + d / r^3) with k = moment * pixelsPerMeter^3,
+    // differentiated term by term
+    float k = moment * pixelsPerMeter * pixelsPerMeter * pixelsPerMeter;
+    float inv_r2 = 1.0f / (r * r);
+    float scale = k * inv_r2 * inv_r2 / r; // k / r^5
+    float d_dot_A = glm::dot(dipoleDirection, A);
+    glm::mat3 gradient;
+    for (int b = 0; b < 3; ++b) {
+        glm::vec3 column = dipoleDirection[b] * A - 3.0f * A[b] * dipoleDirection - 5.0f * d_dot_A * A[b] * inv_r2 * A;
+        column[b] += d_dot_A;
+        gradient[b] = scale * column;
+    }
+    return gradient;
+}
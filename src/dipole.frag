@@ -0,0 +1,9 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec4 vertex_color; // Color from vertex shader
+
+void main()
+{
+    frag_color = vertex_color;
+}
\ No newline at end of file
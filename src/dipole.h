@@ -12,9 +12,6 @@ public:
     MagneticDipole(const glm::vec3& position, float moment, Transform* parent = nullptr, float pixelsPerMeter = 100.0f);
     MagneticDipole(const glm::vec3& position, const glm::vec3& initialDirection, float moment, Transform* parent = nullptr, float pixelsPerMeter = 100.0f);
 
-    // Override Transform methods to update trace points
-    void updateWorldTransformMatrix() override;
-
     // Moment setters/getters (position and direction are handled by Transform)
     void setMoment(float moment);
     float getMoment() const;
@@ -26,9 +23,20 @@ public:
     // Method to calculate the magnetic field at a given position
     glm::vec3 calculateMagneticField(const glm::vec3& pos) const override;
 
+    // Field of a point dipole at dipolePos pointing along direction, shared with the scene store
+    static glm::vec3 calculateDipoleField(const glm::vec3& pos, const glm::vec3& dipolePos, const glm::vec3& direction,
+        float moment, float pixelsPerMeter);
+    // Jacobian of calculateDipoleField with respect to pos, column k is the derivative along axis k
+    static glm::mat3 calculateDipoleFieldGradient(const glm::vec3& pos, const glm::vec3& dipolePos, const glm::vec3& direction,
+        float moment, float pixelsPerMeter);
+
+protected:
+    // Invalidate trace points when the dipole moves, they are rebuilt on the next read
+    void onWorldTransformChanged() override;
+    // Rebuild trace start points in a circle around the dipole
+    void updateTraceStartPoints() const override;
+
 private:
-    // Helper method to initialize trace start points in a circle
-    void initializeDipoleTracePoints();
 
     float mMoment;          // Magnetic moment
 };
\ No newline at end of file
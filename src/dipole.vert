@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec4 in_color;
+layout (location = 2) in vec3 instance_position;
+layout (location = 3) in vec4 instance_rotation; // Quaternion (x, y, z, w)
+layout (location = 4) in vec4 instance_color;
+
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+};
+uniform int use_vertex_color; // 1 for mesh vertex colors, 0 for per-instance color
+
+out vec4 vertex_color; // Pass color to fragment shader
+
+vec3 rotate(vec4 q, vec3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    vec3 world_pos = instance_position + rotate(instance_rotation, pos);
+    gl_Position = projection * view * vec4(world_pos, 1.0);
+    vertex_color = (use_vertex_color == 1) ? in_color : instance_color;
+}
\ No newline at end of file
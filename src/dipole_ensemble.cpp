@@ -0,0 +1,345 @@
+#include "dipole_ensemble.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+static float clampLane(float value, float limit) {
+    return std::min(std::max(value, -limit), limit);
+}
+
+constexpr size_t DipoleEnsemble::LANE_BLOCK;
+
+DipoleEnsemble::DipoleEnsemble(const SimulationSettings& settings)
+    : m_settings(settings) {
+}
+
+void DipoleEnsemble::setBounds(const glm::vec3& bounds_min, const glm::vec3& bounds_max) {
+    m_bounds_min = bounds_min;
+    m_bounds_max = bounds_max;
+}
+
+void DipoleEnsemble::reset(const DipoleStore& store, size_t num_scenes, float position_jitter, float rotation_jitter, uint32_t seed) {
+    clear();
+    if (store.size() == 0 || num_scenes == 0) {
+        return;
+    }
+    m_num_dipoles = store.size();
+    m_num_scenes = num_scenes;
+    m_pixels_per_meter = store.mPixelsPerMeter;
+    m_moments = store.getMoments();
+    m_pinned.resize(m_num_dipoles);
+    for (size_t i = 0; i < m_num_dipoles; ++i) {
+        m_pinned[i] = (store.getFlags(i) & DipoleFlags_Pinned) != 0;
+    }
+
+    const size_t num_lanes = m_num_dipoles * m_num_scenes;
+    for (LaneVec3* column : { &m_positions, &m_velocities, &m_angular_velocities, &m_directions, &m_forces, &m_torques }) {
+        column->resize(num_lanes);
+    }
+    m_rotations.resize(num_lanes);
+    m_energies.resize(num_lanes);
+
+    // Pinned dipoles are the fixed frame of the study and are never jittered
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> fraction(0.0f, 1.0f);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    for (size_t k = 0; k < m_num_scenes; ++k) {
+        for (size_t i = 0; i < m_num_dipoles; ++i) {
+            glm::vec3 position = store.getPosition(i);
+            glm::quat rotation = store.getRotation(i);
+            if (k > 0 && !m_pinned[i]) {
+                position += position_jitter * glm::vec3(offset(gen), offset(gen), offset(gen));
+                position = glm::clamp(position, m_bounds_min, m_bounds_max);
+                glm::vec3 axis(normal(gen), normal(gen), normal(gen));
+                if (glm::dot(axis, axis) > 1e-12f) {
+                    rotation = glm::normalize(glm::angleAxis(rotation_jitter * fraction(gen), glm::normalize(axis)) * rotation);
+                }
+            }
+            setLane(i, k, position, rotation, store.getVelocities()[i], store.getAngularVelocities()[i]);
+        }
+    }
+    computeForces();
+    m_forces_current = true;
+}
+
+bool DipoleEnsemble::setScene(size_t scene, const DipoleStore& store) {
+    if (scene >= m_num_scenes || store.size() != m_num_dipoles) {
+        return false;
+    }
+    for (size_t i = 0; i < m_num_dipoles; ++i) {
+        setLane(i, scene, store.getPosition(i), store.getRotation(i), store.getVelocities()[i], store.getAngularVelocities()[i]);
+    }
+    m_forces_current = false;
+    return true;
+}
+
+bool DipoleEnsemble::copyScene(size_t scene, DipoleStore& store) const {
+    if (scene >= m_num_scenes || store.size() != m_num_dipoles) {
+        return false;
+    }
+    for (size_t i = 0; i < m_num_dipoles; ++i) {
+        size_t n = lane(i, scene);
+        store.setPose(i, glm::vec3(m_positions.x[n], m_positions.y[n], m_positions.z[n]),
+            glm::quat(m_rotations.w[n], m_rotations.x[n], m_rotations.y[n], m_rotations.z[n]));
+        store.getVelocities()[i] = glm::vec3(m_velocities.x[n], m_velocities.y[n], m_velocities.z[n]);
+        store.getAngularVelocities()[i] = glm::vec3(m_angular_velocities.x[n], m_angular_velocities.y[n], m_angular_velocities.z[n]);
+    }
+    return true;
+}
+
+void DipoleEnsemble::clear() {
+    m_num_dipoles = 0;
+    m_num_scenes = 0;
+    m_time = 0.0;
+    m_accumulator = 0.0;
+    m_forces_current = false;
+    m_moments.clear();
+    m_pinned.clear();
+    for (LaneVec3* column : { &m_positions, &m_velocities, &m_angular_velocities, &m_directions, &m_forces, &m_torques }) {
+        column->resize(0);
+    }
+    m_rotations.resize(0);
+    m_energies.clear();
+}
+
+void DipoleEnsemble::setLane(size_t dipole, size_t scene, const glm::vec3& position, const glm::quat& rotation,
+    const glm::vec3& velocity, const glm::vec3& angular_velocity) {
+    size_t n = lane(dipole, scene);
+    m_positions.x[n] = position.x;
+    m_positions.y[n] = position.y;
+    m_positions.z[n] = position.z;
+    m_rotations.w[n] = rotation.w;
+    m_rotations.x[n] = rotation.x;
+    m_rotations.y[n] = rotation.y;
+    m_rotations.z[n] = rotation.z;
+    m_velocities.x[n] = velocity.x;
+    m_velocities.y[n] = velocity.y;
+    m_velocities.z[n] = velocity.z;
+    m_angular_velocities.x[n] = angular_velocity.x;
+    m_angular_velocities.y[n] = angular_velocity.y;
+    m_angular_velocities.z[n] = angular_velocity.z;
+}
+
+void DipoleEnsemble::advance(float duration) {
+    if (m_num_dipoles == 0) {
+        return;
+    }
+    const float dt = std::max(m_settings.tick / std::max(m_settings.substeps, 1), 1e-9f);
+    m_accumulator += std::abs(duration);
+    // A thousandth of a step of slack, so a duration that is a whole number of steps is not
+    // left one short by rounding in dt
+    const int steps = static_cast<int>(m_accumulator / dt + 1e-3);
+    m_accumulator = std::max(m_accumulator - static_cast<double>(steps) * dt, 0.0);
+    for (int step = 0; step < steps; ++step) {
+        // The closing forces of one step open the next
+        if (!m_forces_current) {
+            computeForces();
+        }
+        kick(0.5f * dt);
+        drift(dt);
+        computeForces();
+        kick(0.5f * dt);
+        m_forces_current = true;
+        m_time += dt;
+    }
+}
+
+void DipoleEnsemble::computeForces() {
+    const size_t num_scenes = m_num_scenes;
+    const size_t num_lanes = m_num_dipoles * num_scenes;
+
+    // Directions are the rotated forward (-Z) axis, the negated third column of the rotation
+    for (size_t n = 0; n < num_lanes; ++n) {
+        float w = m_rotations.w[n], x = m_rotations.x[n], y = m_rotations.y[n], z = m_rotations.z[n];
+        m_directions.x[n] = -2.0f * (x * z + w * y);
+        m_directions.y[n] = -2.0f * (y * z - w * x);
+        m_directions.z[n] = -(1.0f - 2.0f * (x * x + y * y));
+    }
+
+    // Field of dipole j at r from it is C M_j ((d_j · r̂) r̂ + d_j) / r³, the radial and
+    // tangential parts of MagneticDipole::calculateDipoleField with C = pixels_per_meter³.
+    // The force on i is the gradient of m_i · B, taken in closed form.
+    const float scale = m_pixels_per_meter * m_pixels_per_meter * m_pixels_per_meter;
+    for (size_t i = 0; i < m_num_dipoles; ++i) {
+        const size_t base_i = i * num_scenes;
+        if (m_pinned[i]) {
+            for (LaneVec3* column : { &m_forces, &m_torques }) {
+                std::fill(column->x.begin() + base_i, column->x.begin() + base_i + num_scenes, 0.0f);
+                std::fill(column->y.begin() + base_i, column->y.begin() + base_i + num_scenes, 0.0f);
+                std::fill(column->z.begin() + base_i, column->z.begin() + base_i + num_scenes, 0.0f);
+            }
+            std::fill(m_energies.begin() + base_i, m_energies.begin() + base_i + num_scenes, 0.0f);
+            continue;
+        }
+        const float moment_i = m_moments[i];
+
+        // Scenes go in blocks accumulated in local arrays, which cannot alias the columns,
+        // so the lane loop needs no overlap checks and stays in registers
+        for (size_t first = 0; first < num_scenes; first += LANE_BLOCK) {
+            const size_t width = std::min(LANE_BLOCK, num_scenes - first);
+            const float* pix = &m_positions.x[base_i + first];
+            const float* piy = &m_positions.y[base_i + first];
+            const float* piz = &m_positions.z[base_i + first];
+            const float* dix = &m_directions.x[base_i + first];
+            const float* diy = &m_directions.y[base_i + first];
+            const float* diz = &m_directions.z[base_i + first];
+            float fx[LANE_BLOCK] = {}, fy[LANE_BLOCK] = {}, fz[LANE_BLOCK] = {};
+            float bx[LANE_BLOCK] = {}, by[LANE_BLOCK] = {}, bz[LANE_BLOCK] = {};
+            float energy[LANE_BLOCK] = {};
+
+            for (size_t j = 0; j < m_num_dipoles; ++j) {
+                if (j == i) {
+                    continue;
+                }
+                const size_t base_j = j * num_scenes + first;
+                const float* pjx = &m_positions.x[base_j];
+                const float* pjy = &m_positions.y[base_j];
+                const float* pjz = &m_positions.z[base_j];
+                const float* djx = &m_directions.x[base_j];
+                const float* djy = &m_directions.y[base_j];
+                const float* djz = &m_directions.z[base_j];
+                const float field_scale = scale * m_moments[j];
+                const float force_scale = field_scale * moment_i;
+                // Pairs of moving dipoles are visited from both ends, pinned partners only once
+                const float energy_weight = m_pinned[j] ? moment_i : 0.5f * moment_i;
+
+                // One lane per scene, branch free so the loop vectorizes
+                for (size_t k = 0; k < width; ++k) {
+                    float rx = pix[k] - pjx[k];
+                    float ry = piy[k] - pjy[k];
+                    float rz = piz[k] - pjz[k];
+                    float r2 = rx * rx + ry * ry + rz * rz;
+                    // Coincident dipoles exert nothing, as in calculateDipoleField. The square
+                    // root always runs, kept finite at zero, and a select drops it, so the
+                    // lanes never diverge.
+                    float inv_r = (r2 > 1e-8f ? 1.0f : 0.0f) / std::sqrt(r2 + 1e-30f);
+                    float ux = rx * inv_r;
+                    float uy = ry * inv_r;
+                    float uz = rz * inv_r;
+                    float inv_r3 = inv_r * inv_r * inv_r;
+                    float di_u = dix[k] * ux + diy[k] * uy + diz[k] * uz;
+                    float dj_u = djx[k] * ux + djy[k] * uy + djz[k] * uz;
+                    float di_dj = dix[k] * djx[k] + diy[k] * djy[k] + diz[k] * djz[k];
+
+                    float b = field_scale * inv_r3;
+                    float field_x = b * (dj_u * ux + djx[k]);
+                    float field_y = b * (dj_u * uy + djy[k]);
+                    float field_z = b * (dj_u * uz + djz[k]);
+                    bx[k] += field_x;
+                    by[k] += field_y;
+                    bz[k] += field_z;
+                    energy[k] -= energy_weight * (dix[k] * field_x + diy[k] * field_y + diz[k] * field_z);
+
+                    float f = force_scale * inv_r3 * inv_r;
+                    float radial = 5.0f * di_u * dj_u + 3.0f * di_dj;
+                    fx[k] += f * (di_u * djx[k] + dj_u * dix[k] - radial * ux);
+                    fy[k] += f * (di_u * djy[k] + dj_u * diy[k] - radial * uy);
+                    fz[k] += f * (di_u * djz[k] + dj_u * diz[k] - radial * uz);
+                }
+            }
+
+            // Torque: τ = m_i × B_i, both clamped per component like DipoleSimulation
+            const float force_clamp = m_settings.force_clamp;
+            const float torque_clamp = m_settings.torque_clamp;
+            for (size_t k = 0; k < width; ++k) {
+                const size_t n = base_i + first + k;
+                m_forces.x[n] = clampLane(fx[k], force_clamp);
+                m_forces.y[n] = clampLane(fy[k], force_clamp);
+                m_forces.z[n] = clampLane(fz[k], force_clamp);
+                m_torques.x[n] = clampLane(moment_i * (diy[k] * bz[k] - diz[k] * by[k]), torque_clamp);
+                m_torques.y[n] = clampLane(moment_i * (diz[k] * bx[k] - dix[k] * bz[k]), torque_clamp);
+                m_torques.z[n] = clampLane(moment_i * (dix[k] * by[k] - diy[k] * bx[k]), torque_clamp);
+                m_energies[n] = energy[k];
+            }
+        }
+    }
+}
+void DipoleEnsemble::kick(float dt) {
+    const float linear = dt / m_settings.dipole_mass;
+    const float angular = dt / m_settings.moment_of_inertia;
+    for (size_t i = 0; i < m_num_dipoles; ++i) {
+        if (m_pinned[i]) {
+            continue;
+        }
+        const size_t begin = i * m_num_scenes;
+        const size_t end = begin + m_num_scenes;
+        for (size_t n = begin; n < end; ++n) {
+            m_velocities.x[n] += m_forces.x[n] * linear;
+            m_velocities.y[n] += m_forces.y[n] * linear;
+            m_velocities.z[n] += m_forces.z[n] * linear;
+            m_angular_velocities.x[n] += m_torques.x[n] * angular;
+            m_angular_velocities.y[n] += m_torques.y[n] * angular;
+            m_angular_velocities.z[n] += m_torques.z[n] * angular;
+        }
+    }
+}
+
+void DipoleEnsemble::drift(float dt) {
+    for (size_t i = 0; i < m_num_dipoles; ++i) {
+        if (m_pinned[i]) {
+            continue;
+        }
+        const size_t begin = i * m_num_scenes;
+        const size_t end = begin + m_num_scenes;
+        for (size_t n = begin; n < end; ++n) {
+            m_positions.x[n] = std::min(std::max(m_positions.x[n] + m_velocities.x[n] * dt, m_bounds_min.x), m_bounds_max.x);
+            m_positions.y[n] = std::min(std::max(m_positions.y[n] + m_velocities.y[n] * dt, m_bounds_min.y), m_bounds_max.y);
+            m_positions.z[n] = std::min(std::max(m_positions.z[n] + m_velocities.z[n] * dt, m_bounds_min.z), m_bounds_max.z);
+
+            // q = exp(ω dt) q, the exponential map written out per lane
+            float theta_x = m_angular_velocities.x[n] * dt;
+            float theta_y = m_angular_velocities.y[n] * dt;
+            float theta_z = m_angular_velocities.z[n] * dt;
+            float angle = std::sqrt(theta_x * theta_x + theta_y * theta_y + theta_z * theta_z);
+            float half = 0.5f * angle;
+            float s = angle > 1e-6f ? std::sin(half) / angle : 0.5f;
+            float ew = std::cos(half), ex = theta_x * s, ey = theta_y * s, ez = theta_z * s;
+            float w = m_rotations.w[n], x = m_rotations.x[n], y = m_rotations.y[n], z = m_rotations.z[n];
+            float rw = ew * w - ex * x - ey * y - ez * z;
+            float rx = ew * x + ex * w + ey * z - ez * y;
+            float ry = ew * y - ex * z + ey * w + ez * x;
+            float rz = ew * z + ex * y - ey * x + ez * w;
+            float inv_length = 1.0f / std::sqrt(rw * rw + rx * rx + ry * ry + rz * rz);
+            m_rotations.w[n] = rw * inv_length;
+            m_rotations.x[n] = rx * inv_length;
+            m_rotations.y[n] = ry * inv_length;
+            m_rotations.z[n] = rz * inv_length;
+        }
+    }
+}
+
+float DipoleEnsemble::getKineticEnergy(size_t scene) const {
+    float energy = 0.0f;
+    for (size_t i = 0; i < m_num_dipoles; ++i) {
+        if (m_pinned[i]) {
+            continue;
+        }
+        size_t n = lane(i, scene);
+        glm::vec3 v(m_velocities.x[n], m_velocities.y[n], m_velocities.z[n]);
+        glm::vec3 w(m_angular_velocities.x[n], m_angular_velocities.y[n], m_angular_velocities.z[n]);
+        energy += 0.5f * (m_settings.dipole_mass * glm::dot(v, v) + m_settings.moment_of_inertia * glm::dot(w, w));
+    }
+    return energy;
+}
+
+float DipoleEnsemble::getPotentialEnergy(size_t scene) const {
+    // Pairs of pinned dipoles never change and are left out
+    float energy = 0.0f;
+    for (size_t i = 0; i < m_num_dipoles; ++i) {
+        energy += m_energies[lane(i, scene)];
+    }
+    return energy;
+}
+
+float DipoleEnsemble::getMaxSpeed(size_t scene) const {
+    float speed = 0.0f;
+    for (size_t i = 0; i < m_num_dipoles; ++i) {
+        if (m_pinned[i]) {
+            continue;
+        }
+        size_t n = lane(i, scene);
+        speed = std::max(speed, glm::length(glm::vec3(m_velocities.x[n], m_velocities.y[n], m_velocities.z[n])));
+    }
+    return speed;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "dipole_store.h"
+#include "dipole_simulation.h"
+
+// Many independent copies of one small assembly advanced in lock-step, for parameter
+// studies over initial conditions. Every state component is a column of dipoles by scenes
+// with the scenes of a dipole contiguous, so the pair loop's innermost loop runs across
+// scenes with no branches and vectorizes, one lane per scene. Each step is velocity Verlet
+// with Lie-Verlet rotation like DipoleSimulation's default, with the pair force taken
+// analytically instead of by finite differences. Pinned dipoles stay put; rigid bodies,
+// neighbour lists and sleeping are not modelled, every other dipole moves on its own.
+class DipoleEnsemble {
+public:
+    explicit DipoleEnsemble(const SimulationSettings& settings = SimulationSettings());
+
+    SimulationSettings& getSettings() { return m_settings; }
+    const SimulationSettings& getSettings() const { return m_settings; }
+
+    // Positions are clamped to these bounds
+    void setBounds(const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+
+    // Copy the store into num_scenes scenes. Scene 0 keeps the store's state, every other
+    // one has its positions jittered by up to position_jitter per axis and its rotations
+    // by up to rotation_jitter radians about a random axis.
+    void reset(const DipoleStore& store, size_t num_scenes, float position_jitter, float rotation_jitter, uint32_t seed);
+    // Replace one scene's state, the store must hold as many dipoles as the ensemble
+    bool setScene(size_t scene, const DipoleStore& store);
+    // Write one scene's poses and velocities to a store holding as many dipoles
+    bool copyScene(size_t scene, DipoleStore& store) const;
+    void clear();
+
+    // Advance every scene by duration in substeps of tick / substeps. Time short of a whole
+    // substep is carried into the next call, so advancing in slices takes the same steps as
+    // advancing at once, and getTime reports the time actually stepped.
+    void advance(float duration);
+
+    size_t getSceneCount() const { return m_num_scenes; }
+    size_t getDipoleCount() const { return m_num_dipoles; }
+    double getTime() const { return m_time; }
+    // Per-scene results at the current time
+    float getKineticEnergy(size_t scene) const;
+    float getPotentialEnergy(size_t scene) const;
+    float getMaxSpeed(size_t scene) const;
+
+private:
+    // One float per dipole and scene, index dipole * scenes + scene
+    struct LaneVec3 {
+        std::vector<float> x, y, z;
+        void resize(size_t n) { x.resize(n); y.resize(n); z.resize(n); }
+    };
+    struct LaneQuat {
+        std::vector<float> w, x, y, z;
+        void resize(size_t n) { w.resize(n); x.resize(n); y.resize(n); z.resize(n); }
+    };
+
+    // Scenes accumulated together in the pair loop, a few vector registers wide
+    static constexpr size_t LANE_BLOCK = 16;
+
+    size_t lane(size_t dipole, size_t scene) const { return dipole * m_num_scenes + scene; }
+    void setLane(size_t dipole, size_t scene, const glm::vec3& position, const glm::quat& rotation,
+        const glm::vec3& velocity, const glm::vec3& angular_velocity);
+
+    // Forces, torques and the potential energy at the current state
+    void computeForces();
+    void kick(float dt);
+    void drift(float dt);
+
+    SimulationSettings m_settings;
+    glm::vec3 m_bounds_min{ -1.0f };
+    glm::vec3 m_bounds_max{ 1.0f };
+    float m_pixels_per_meter{ 100.0f };
+    size_t m_num_dipoles{ 0 };
+    size_t m_num_scenes{ 0 };
+    double m_time{ 0.0 };
+    double m_accumulator{ 0.0 }; // Time not yet stepped, under one substep
+    bool m_forces_current{ false };
+
+    // Shared by every scene
+    std::vector<float> m_moments;
+    std::vector<uint8_t> m_pinned;
+
+    LaneVec3 m_positions;
+    LaneQuat m_rotations;
+    LaneVec3 m_velocities;
+    LaneVec3 m_angular_velocities;
+    LaneVec3 m_directions;
+    LaneVec3 m_forces;
+    LaneVec3 m_torques;
+    std::vector<float> m_energies; // Potential energy of each dipole in the others' field, halved per pair when summed
+};
@@ -0,0 +1,455 @@
+#include "dipole_neighbour_grid.h"
+#include "dipole.h"
+#include <algorithm>
+#include <cmath>
+
+// Cell coordinates packed into one sortable key, 21 bits per axis
+static uint64_t cellKey(const glm::ivec3& cell) {
+    const int64_t bias = 1 << 20;
+    return (static_cast<uint64_t>(cell.x + bias) << 42) | (static_cast<uint64_t>(cell.y + bias) << 21) | static_cast<uint64_t>(cell.z + bias);
+}
+
+void DipoleNeighbourGrid::setCutoff(float cutoff, float skin) {
+    cutoff = std::max(cutoff, 1e-4f);
+    skin = std::max(skin, 0.0f);
+    if (cutoff != m_cutoff || skin != m_skin) {
+        m_cutoff = cutoff;
+        m_skin = skin;
+        m_built = false;
+    }
+}
+
+bool DipoleNeighbourGrid::update(const std::vector<glm::vec3>& positions) {
+    if (m_built && positions.size() == m_build_positions.size()) {
+        const float limit = 0.25f * m_skin * m_skin; // Half the skin, squared
+        bool moved = false;
+        for (size_t i = 0; i < positions.size() && !moved; ++i) {
+            glm::vec3 d = positions[i] - m_build_positions[i];
+            moved = glm::dot(d, d) > limit;
+        }
+        if (!moved) {
+            return false;
+        }
+    }
+    build(positions);
+    return true;
+}
+
+void DipoleNeighbourGrid::build(const std::vector<glm::vec3>& positions) {
+    const size_t num_dipoles = positions.size();
+    const float cell_size = m_cutoff + m_skin;
+    m_build_positions = positions;
+    m_built = true;
+    ++m_rebuilds;
+
+    // Sort dipoles by cell, runs of equal keys become the occupied cells
+    std::vector<std::pair<uint64_t, uint32_t>> keyed(num_dipoles);
+    std::vector<glm::ivec3> coords(num_dipoles);
+    for (size_t i = 0; i < num_dipoles; ++i) {
+        coords[i] = glm::ivec3(glm::floor(positions[i] / cell_size));
+        keyed[i] = { cellKey(coords[i]), static_cast<uint32_t>(i) };
+    }
+    std::sort(keyed.begin(), keyed.end());
+
+    std::vector<uint64_t> cell_keys;
+    m_cell_coords.clear();
+    m_cell_offsets.clear();
+    m_cell_members.resize(num_dipoles);
+    m_dipole_cells.resize(num_dipoles);
+    for (size_t n = 0; n < num_dipoles; ++n) {
+        if (n == 0 || keyed[n].first != keyed[n - 1].first) {
+            cell_keys.push_back(keyed[n].first);
+            m_cell_coords.push_back(coords[keyed[n].second]);
+            m_cell_offsets.push_back(static_cast<uint32_t>(n));
+        }
+        m_cell_members[n] = keyed[n].second;
+        m_dipole_cells[keyed[n].second] = static_cast<uint32_t>(m_cell_coords.size() - 1);
+    }
+    m_cell_offsets.push_back(static_cast<uint32_t>(num_dipoles));
+
+    // Each member of a cell gets the members of the 27 cells around it, minus itself
+    std::vector<std::vector<uint32_t>> cell_neighbourhoods(m_cell_coords.size());
+    for (size_t c = 0; c < m_cell_coords.size(); ++c) {
+        for (int dz = -1; dz <= 1; ++dz) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    uint64_t key = cellKey(m_cell_coords[c] + glm::ivec3(dx, dy, dz));
+                    auto it = std::lower_bound(cell_keys.begin(), cell_keys.end(), key);
+                    if (it == cell_keys.end() || *it != key) {
+                        continue;
+                    }
+                    size_t other = it - cell_keys.begin();
+                    cell_neighbourhoods[c].insert(cell_neighbourhoods[c].end(),
+                        m_cell_members.begin() + m_cell_offsets[other], m_cell_members.begin() + m_cell_offsets[other + 1]);
+                }
+            }
+        }
+    }
+
+    m_neighbour_offsets.resize(num_dipoles + 1);
+    m_neighbours.clear();
+    for (size_t i = 0; i < num_dipoles; ++i) {
+        m_neighbour_offsets[i] = static_cast<uint32_t>(m_neighbours.size());
+        for (uint32_t j : cell_neighbourhoods[m_dipole_cells[i]]) {
+            if (j != i) {
+                m_neighbours.push_back(j);
+            }
+        }
+    }
+    m_neighbour_offsets[num_dipoles] = static_cast<uint32_t>(m_neighbours.size());
+
+    buildLevels(cell_keys);
+}
+
+// Cell of the next coarser level, rounding towards negative infinity
+static glm::ivec3 parentCoord(const glm::ivec3& cell) {
+    return glm::ivec3(cell.x >= 0 ? cell.x / 2 : (cell.x - 1) / 2,
+        cell.y >= 0 ? cell.y / 2 : (cell.y - 1) / 2,
+        cell.z >= 0 ? cell.z / 2 : (cell.z - 1) / 2);
+}
+
+// Cells this close on a level are not far from each other there. The occupied cells have to
+// match the neighbour lists, coarser levels keep two cells between interacting aggregates
+// so a single dipole per cell stays accurate.
+static int nearRadius(size_t level) {
+    return level == 0 ? 1 : 2;
+}
+
+static bool isNear(const glm::ivec3& a, const glm::ivec3& b, int radius) {
+    glm::ivec3 d = glm::abs(a - b);
+    return d.x <= radius && d.y <= radius && d.z <= radius;
+}
+
+static int findKey(const std::vector<uint64_t>& keys, uint64_t key) {
+    auto it = std::lower_bound(keys.begin(), keys.end(), key);
+    return it != keys.end() && *it == key ? static_cast<int>(it - keys.begin()) : -1;
+}
+
+static uint64_t groupKey(int group, uint32_t cell) {
+    return (static_cast<uint64_t>(group) << 32) | cell;
+}
+
+void DipoleNeighbourGrid::buildLevels(const std::vector<uint64_t>& cell_keys) {
+    m_levels.resize(1);
+    m_levels[0].keys = cell_keys;
+    m_levels[0].coords = m_cell_coords;
+
+    // Coarsen until every remaining cell is near every other, nothing is far above that
+    for (size_t l = 0; l < 24; ++l) {
+        glm::ivec3 lo = m_levels[l].coords.empty() ? glm::ivec3(0) : m_levels[l].coords[0];
+        glm::ivec3 hi = lo;
+        for (const glm::ivec3& cell : m_levels[l].coords) {
+            lo = glm::min(lo, cell);
+            hi = glm::max(hi, cell);
+        }
+        if (isNear(lo, hi, nearRadius(l))) {
+            m_levels[l].parents.clear();
+            break;
+        }
+        Level parent;
+        std::vector<std::pair<uint64_t, glm::ivec3>> keyed;
+        keyed.reserve(m_levels[l].coords.size());
+        for (const glm::ivec3& cell : m_levels[l].coords) {
+            glm::ivec3 coord = parentCoord(cell);
+            keyed.push_back({ cellKey(coord), coord });
+        }
+        std::sort(keyed.begin(), keyed.end(), [](const std::pair<uint64_t, glm::ivec3>& a, const std::pair<uint64_t, glm::ivec3>& b) { return a.first < b.first; });
+        for (size_t n = 0; n < keyed.size(); ++n) {
+            if (n == 0 || keyed[n].first != keyed[n - 1].first) {
+                parent.keys.push_back(keyed[n].first);
+                parent.coords.push_back(keyed[n].second);
+            }
+        }
+        Level& child = m_levels[l];
+        child.parents.resize(child.coords.size());
+        parent.child_offsets.assign(parent.coords.size() + 1, 0);
+        for (size_t c = 0; c < child.coords.size(); ++c) {
+            child.parents[c] = static_cast<uint32_t>(findKey(parent.keys, cellKey(parentCoord(child.coords[c]))));
+            ++parent.child_offsets[child.parents[c] + 1];
+        }
+        for (size_t c = 0; c < parent.coords.size(); ++c) {
+            parent.child_offsets[c + 1] += parent.child_offsets[c];
+        }
+        parent.children.resize(child.coords.size());
+        std::vector<uint32_t> fill(parent.child_offsets.begin(), parent.child_offsets.end() - 1);
+        for (size_t c = 0; c < child.coords.size(); ++c) {
+            parent.children[fill[child.parents[c]]++] = static_cast<uint32_t>(c);
+        }
+        m_levels.push_back(std::move(parent));
+    }
+
+    // Interaction lists: cells not near the target whose parents are near its parent. Being
+    // near on one level implies being near on the next, so every far pair of occupied cells
+    // is covered exactly once, at the finest level where their ancestors are not near.
+    for (size_t l = 0; l + 1 < m_levels.size(); ++l) {
+        Level& level = m_levels[l];
+        const int radius = nearRadius(l);
+        const int parent_radius = nearRadius(l + 1);
+        const int span = 2 * (2 * parent_radius + 1);
+        level.interaction_offsets.assign(1, 0);
+        level.interactions.clear();
+        for (const glm::ivec3& cell : level.coords) {
+            const glm::ivec3 parent = parentCoord(cell);
+            const glm::ivec3 base = 2 * (parent - glm::ivec3(parent_radius));
+            for (int dz = 0; dz < span; ++dz) {
+                for (int dy = 0; dy < span; ++dy) {
+                    for (int dx = 0; dx < span; ++dx) {
+                        glm::ivec3 other = base + glm::ivec3(dx, dy, dz);
+                        if (isNear(cell, other, radius)) {
+                            continue;
+                        }
+                        int source = findKey(level.keys, cellKey(other));
+                        if (source >= 0) {
+                            level.interactions.push_back(static_cast<uint32_t>(source));
+                        }
+                    }
+                }
+            }
+            level.interaction_offsets.push_back(static_cast<uint32_t>(level.interactions.size()));
+        }
+    }
+    m_levels.back().interaction_offsets.assign(m_levels.back().coords.size() + 1, 0);
+    m_levels.back().interactions.clear();
+}
+
+DipoleNeighbourGrid::CellSums& DipoleNeighbourGrid::CellSums::operator+=(const CellSums& other) {
+    moment += other.moment;
+    weighted_position += other.weighted_position;
+    position += other.position;
+    weight += other.weight;
+    count += other.count;
+    return *this;
+}
+
+// One dipole for the members at their centroid, weighted by moment strength so members
+// with no moment do not pull it away from the ones that have one
+glm::vec3 DipoleNeighbourGrid::CellSums::center() const {
+    return weight > 0.0f ? weighted_position / weight : count > 0 ? position / static_cast<float>(count) : position;
+}
+
+void DipoleNeighbourGrid::CellSums::add(const glm::vec3& position_j, const glm::vec3& direction_j, float moment_j) {
+    float w = std::abs(moment_j);
+    moment += moment_j * direction_j;
+    weighted_position += w * position_j;
+    position += position_j;
+    weight += w;
+    ++count;
+}
+
+// Add the field and its Jacobian at point of an aggregate dipole, scaled by sign
+static void addAggregateField(const glm::vec3& point, const glm::vec3& source_center, const glm::vec3& source_moment,
+    float pixels_per_meter, float sign, glm::vec3& field, glm::mat3& gradient) {
+    float magnitude = glm::length(source_moment);
+    if (magnitude <= 0.0f) {
+        return;
+    }
+    glm::vec3 direction = source_moment / magnitude;
+    field += sign * MagneticDipole::calculateDipoleField(point, source_center, direction, magnitude, pixels_per_meter);
+    gradient += sign * MagneticDipole::calculateDipoleFieldGradient(point, source_center, direction, magnitude, pixels_per_meter);
+}
+
+void DipoleNeighbourGrid::computeFarField(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& directions,
+    const std::vector<float>& moments, float pixels_per_meter, std::vector<glm::vec3>& fields, std::vector<glm::mat3>& gradients,
+    const std::vector<int>* groups, const std::vector<uint32_t>* targets) {
+    const size_t num_dipoles = positions.size();
+    const size_t num_levels = m_levels.size();
+    fields.resize(num_dipoles);
+    gradients.resize(num_dipoles);
+
+    // Upward pass: cell sums from the members, then each level from the one below
+    for (size_t l = 0; l < num_levels; ++l) {
+        Level& level = m_levels[l];
+        level.sums.assign(level.coords.size(), CellSums());
+        if (l == 0) {
+            for (size_t c = 0; c < level.coords.size(); ++c) {
+                for (uint32_t n = m_cell_offsets[c]; n < m_cell_offsets[c + 1]; ++n) {
+                    uint32_t j = m_cell_members[n];
+                    level.sums[c].add(positions[j], directions[j], moments[j]);
+                }
+            }
+        }
+        else {
+            const Level& child = m_levels[l - 1];
+            for (size_t c = 0; c < child.coords.size(); ++c) {
+                level.sums[child.parents[c]] += child.sums[c];
+            }
+        }
+        level.centers.resize(level.coords.size());
+        for (size_t c = 0; c < level.coords.size(); ++c) {
+            level.centers[c] = level.sums[c].center();
+        }
+    }
+
+    // Only the cells above the target dipoles need their far field
+    for (size_t l = 0; l < num_levels; ++l) {
+        m_levels[l].needed.assign(m_levels[l].coords.size(), targets ? 0 : 1);
+    }
+    if (targets) {
+        for (uint32_t i : *targets) {
+            m_levels[0].needed[m_dipole_cells[i]] = 1;
+        }
+        for (size_t l = 0; l + 1 < num_levels; ++l) {
+            for (size_t c = 0; c < m_levels[l].coords.size(); ++c) {
+                if (m_levels[l].needed[c]) {
+                    m_levels[l + 1].needed[m_levels[l].parents[c]] = 1;
+                }
+            }
+        }
+    }
+
+    // Interactions at each level, then the downward pass expanding each parent's field to
+    // first order around its children's centroids
+    for (size_t l = num_levels; l-- > 0;) {
+        Level& level = m_levels[l];
+        level.fields.assign(level.coords.size(), glm::vec3(0.0f));
+        level.gradients.assign(level.coords.size(), glm::mat3(0.0f));
+        for (size_t c = 0; c < level.coords.size(); ++c) {
+            if (!level.needed[c]) {
+                continue;
+            }
+            for (uint32_t n = level.interaction_offsets[c]; n < level.interaction_offsets[c + 1]; ++n) {
+                uint32_t source = level.interactions[n];
+                addAggregateField(level.centers[c], level.centers[source], level.sums[source].moment,
+                    pixels_per_meter, 1.0f, level.fields[c], level.gradients[c]);
+            }
+            if (l + 1 < num_levels) {
+                const Level& parent = m_levels[l + 1];
+                uint32_t p = level.parents[c];
+                level.fields[c] += parent.fields[p] + parent.gradients[p] * (level.centers[c] - parent.centers[p]);
+                level.gradients[c] += parent.gradients[p];
+            }
+        }
+    }
+
+    // First order expansion around the centroid of each dipole's cell
+    const Level& leaves = m_levels[0];
+    auto expand = [&](size_t i) {
+        uint32_t c = m_dipole_cells[i];
+        fields[i] = leaves.fields[c] + leaves.gradients[c] * (positions[i] - leaves.centers[c]);
+        gradients[i] = leaves.gradients[c];
+    };
+    if (targets) {
+        for (uint32_t i : *targets) {
+            expand(i);
+        }
+    }
+    else {
+        for (size_t i = 0; i < num_dipoles; ++i) {
+            expand(i);
+        }
+    }
+    if (groups) {
+        removeGroupFields(positions, directions, moments, pixels_per_meter, *groups, targets, fields, gradients);
+    }
+}
+
+void DipoleNeighbourGrid::removeGroupFields(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& directions,
+    const std::vector<float>& moments, float pixels_per_meter, const std::vector<int>& groups, const std::vector<uint32_t>* targets,
+    std::vector<glm::vec3>& fields, std::vector<glm::mat3>& gradients) {
+    const size_t num_dipoles = positions.size();
+    const size_t num_levels = m_levels.size();
+
+    // Cells holding members of each group at every level, with the sums of their other members
+    for (size_t l = 0; l < num_levels; ++l) {
+        Level& level = m_levels[l];
+        level.group_keys.clear();
+        if (l == 0) {
+            for (size_t i = 0; i < num_dipoles; ++i) {
+                if (groups[i] >= 0) {
+                    level.group_keys.push_back(groupKey(groups[i], m_dipole_cells[i]));
+                }
+            }
+        }
+        else {
+            for (uint64_t key : m_levels[l - 1].group_keys) {
+                level.group_keys.push_back(groupKey(static_cast<int>(key >> 32), m_levels[l - 1].parents[static_cast<uint32_t>(key)]));
+            }
+        }
+        std::sort(level.group_keys.begin(), level.group_keys.end());
+        level.group_keys.erase(std::unique(level.group_keys.begin(), level.group_keys.end()), level.group_keys.end());
+
+        level.group_sums.assign(level.group_keys.size(), CellSums());
+        for (size_t e = 0; e < level.group_keys.size(); ++e) {
+            const int group = static_cast<int>(level.group_keys[e] >> 32);
+            const uint32_t c = static_cast<uint32_t>(level.group_keys[e]);
+            if (l == 0) {
+                for (uint32_t n = m_cell_offsets[c]; n < m_cell_offsets[c + 1]; ++n) {
+                    uint32_t j = m_cell_members[n];
+                    if (groups[j] != group) {
+                        level.group_sums[e].add(positions[j], directions[j], moments[j]);
+                    }
+                }
+            }
+            else {
+                // Children without members of the group contribute whole
+                const Level& child = m_levels[l - 1];
+                for (uint32_t n = level.child_offsets[c]; n < level.child_offsets[c + 1]; ++n) {
+                    uint32_t k = level.children[n];
+                    int own = findKey(child.group_keys, groupKey(group, k));
+                    level.group_sums[e] += own >= 0 ? child.group_sums[own] : child.sums[k];
+                }
+            }
+        }
+    }
+
+    // A grouped dipole must not feel its own group through the aggregates, so every source
+    // cell holding members of the target's group is swapped for its other members alone
+    for (size_t l = num_levels; l-- > 0;) {
+        Level& level = m_levels[l];
+        level.group_fields.assign(level.group_keys.size(), glm::vec3(0.0f));
+        level.group_gradients.assign(level.group_keys.size(), glm::mat3(0.0f));
+        for (size_t e = 0; e < level.group_keys.size(); ++e) {
+            const int group = static_cast<int>(level.group_keys[e] >> 32);
+            const uint32_t c = static_cast<uint32_t>(level.group_keys[e]);
+            if (!level.needed[c]) {
+                continue;
+            }
+            for (uint32_t n = level.interaction_offsets[c]; n < level.interaction_offsets[c + 1]; ++n) {
+                uint32_t source = level.interactions[n];
+                int own = findKey(level.group_keys, groupKey(group, source));
+                if (own < 0) {
+                    continue;
+                }
+                addAggregateField(level.centers[c], level.centers[source], level.sums[source].moment,
+                    pixels_per_meter, -1.0f, level.group_fields[e], level.group_gradients[e]);
+                if (level.group_sums[own].count > 0) {
+                    addAggregateField(level.centers[c], level.group_sums[own].center(), level.group_sums[own].moment,
+                        pixels_per_meter, 1.0f, level.group_fields[e], level.group_gradients[e]);
+                }
+            }
+            if (l + 1 < num_levels) {
+                const Level& parent = m_levels[l + 1];
+                uint32_t p = level.parents[c];
+                int up = findKey(parent.group_keys, groupKey(group, p));
+                level.group_fields[e] += parent.group_fields[up] + parent.group_gradients[up] * (level.centers[c] - parent.centers[p]);
+                level.group_gradients[e] += parent.group_gradients[up];
+            }
+        }
+    }
+
+    const Level& leaves = m_levels[0];
+    auto correct = [&](size_t i) {
+        if (groups[i] < 0) {
+            return;
+        }
+        uint32_t c = m_dipole_cells[i];
+        int e = findKey(leaves.group_keys, groupKey(groups[i], c));
+        fields[i] += leaves.group_fields[e] + leaves.group_gradients[e] * (positions[i] - leaves.centers[c]);
+        gradients[i] += leaves.group_gradients[e];
+    };
+    if (targets) {
+        for (uint32_t i : *targets) {
+            correct(i);
+        }
+    }
+    else {
+        for (size_t i = 0; i < num_dipoles; ++i) {
+            correct(i);
+        }
+    }
+}
+
+float DipoleNeighbourGrid::getAverageNeighbours() const {
+    size_t num_dipoles = m_neighbour_offsets.empty() ? 0 : m_neighbour_offsets.size() - 1;
+    return num_dipoles ? static_cast<float>(m_neighbours.size()) / num_dipoles : 0.0f;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Splits dipole interactions into a near field, summed exactly pair by pair, and a far
+// field, approximated from cell aggregates. Dipoles are binned into a uniform grid of
+// cells with edge cutoff + skin. The near set of a dipole is every dipole in its own and
+// the 26 adjacent cells, kept as a Verlet neighbour list. Lists are only rebuilt once
+// some dipole has moved more than half the skin, so pairs closer than cutoff stay near
+// in between. For the far field the occupied cells form a pyramid, each level halving the
+// resolution of the one below, and every cell acts as one dipole carrying the net moment
+// of its members at their moment weighted centroid. A cell takes the field and its
+// closed-form gradient from the cells of its own level that are not near it but whose
+// parents are near its parent, and passes them down to its children expanded to first
+// order. Near means adjacent on the occupied cells, matching the neighbour lists, and
+// within two cells on coarser levels. Interaction lists are bounded by 10^3 cells, so a
+// far evaluation is O(N + C) for N dipoles in C occupied cells, and the pyramid and its
+// lists are only rebuilt with the neighbour lists.
+class DipoleNeighbourGrid {
+public:
+    DipoleNeighbourGrid() = default;
+
+    void setCutoff(float cutoff, float skin);
+
+    // Rebuild the cells and lists if the dipole count changed or a dipole moved more than
+    // half the skin since the last build. Returns true if they were rebuilt.
+    bool update(const std::vector<glm::vec3>& positions);
+    // Drop the lists so the next update rebuilds them
+    void invalidate() { m_built = false; }
+    bool isBuilt(size_t num_dipoles) const { return m_built && m_build_positions.size() == num_dipoles; }
+
+    // Near neighbours of dipole i, excluding i itself
+    const uint32_t* neighboursBegin(size_t i) const { return m_neighbours.data() + m_neighbour_offsets[i]; }
+    const uint32_t* neighboursEnd(size_t i) const { return m_neighbours.data() + m_neighbour_offsets[i + 1]; }
+
+    // Far field and its Jacobian (column k is the derivative along axis k) at every dipole,
+    // or only at the dipoles listed in targets, leaving the other entries untouched. If
+    // groups is given, dipoles with the same non-negative group leave each other out of the
+    // field they receive, so members of one rigid body do not act on themselves.
+    void computeFarField(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& directions,
+        const std::vector<float>& moments, float pixels_per_meter, std::vector<glm::vec3>& fields, std::vector<glm::mat3>& gradients,
+        const std::vector<int>* groups = nullptr, const std::vector<uint32_t>* targets = nullptr);
+
+    size_t getCellCount() const { return m_cell_coords.size(); }
+    size_t getLevelCount() const { return m_levels.size(); }
+    uint64_t getRebuildCount() const { return m_rebuilds; }
+    float getAverageNeighbours() const;
+
+private:
+    // Running sums of a set of dipoles, enough to place their aggregate dipole
+    struct CellSums {
+        glm::vec3 moment{ 0.0f };
+        glm::vec3 weighted_position{ 0.0f }; // Weighted by moment strength
+        glm::vec3 position{ 0.0f };
+        float weight{ 0.0f };
+        uint32_t count{ 0 };
+
+        void add(const glm::vec3& position_j, const glm::vec3& direction_j, float moment_j);
+        CellSums& operator+=(const CellSums& other);
+        glm::vec3 center() const;
+    };
+
+    // One level of the far field pyramid, level 0 being the occupied cells
+    struct Level {
+        std::vector<uint64_t> keys; // Sorted cellKey of each cell
+        std::vector<glm::ivec3> coords;
+        std::vector<uint32_t> parents; // Cell index on the next level, empty on the top level
+        std::vector<uint32_t> child_offsets, children; // CSR into the level below
+        std::vector<uint32_t> interaction_offsets, interactions; // CSR of far source cells
+
+        // Per evaluation
+        std::vector<CellSums> sums;
+        std::vector<glm::vec3> centers;
+        std::vector<glm::vec3> fields; // Far field at the centroid and its Jacobian
+        std::vector<glm::mat3> gradients;
+        std::vector<uint8_t> needed;
+
+        // Cells holding members of each group, keyed group << 32 | cell and sorted, with
+        // the sums of their other members and the correction removing the group's own field
+        std::vector<uint64_t> group_keys;
+        std::vector<CellSums> group_sums;
+        std::vector<glm::vec3> group_fields;
+        std::vector<glm::mat3> group_gradients;
+    };
+
+    void build(const std::vector<glm::vec3>& positions);
+    void buildLevels(const std::vector<uint64_t>& cell_keys);
+    void removeGroupFields(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& directions,
+        const std::vector<float>& moments, float pixels_per_meter, const std::vector<int>& groups, const std::vector<uint32_t>* targets,
+        std::vector<glm::vec3>& fields, std::vector<glm::mat3>& gradients);
+
+    float m_cutoff{ 0.5f };
+    float m_skin{ 0.1f };
+    bool m_built{ false };
+    uint64_t m_rebuilds{ 0 };
+
+    std::vector<glm::vec3> m_build_positions; // Positions at the last build, for the skin test
+
+    // Occupied cells and their members, CSR by cell
+    std::vector<glm::ivec3> m_cell_coords;
+    std::vector<uint32_t> m_cell_offsets;
+    std::vector<uint32_t> m_cell_members;
+    std::vector<uint32_t> m_dipole_cells; // Occupied cell index of each dipole
+
+    // Verlet neighbour lists, CSR by dipole
+    std::vector<uint32_t> m_neighbour_offsets;
+    std::vector<uint32_t> m_neighbours;
+
+    // Far field pyramid, reused between evaluations
+    std::vector<Level> m_levels;
+};
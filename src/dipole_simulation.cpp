@@ -0,0 +1,810 @@
+#include "dipole_simulation.h"
+#include "dipole.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+static bool isPinned(const DipoleStore& store, size_t index) {
+    return (store.getFlags(index) & DipoleFlags_Pinned) != 0;
+}
+
+// Root of i's set in a union-find forest, halving the path on the way
+static uint32_t findRoot(std::vector<uint32_t>& parents, uint32_t i) {
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+// Unit quaternion rotating by rotation_vector, the exponential map of so(3)
+static glm::quat expMap(const glm::vec3& rotation_vector) {
+    float angle = glm::length(rotation_vector);
+    float half = 0.5f * angle;
+    // sin(half) / angle tends to 1/2, use the limit where the division is unstable
+    float scale = angle > 1e-6f ? std::sin(half) / angle : 0.5f;
+    return glm::quat(std::cos(half), rotation_vector * scale);
+}
+
+// Rate of the rotation vector theta under world angular velocity omega, the inverse
+// differential of the exponential map truncated after the terms fourth order needs
+static glm::vec3 dexpInv(const glm::vec3& theta, const glm::vec3& omega) {
+    glm::vec3 bracket = glm::cross(theta, omega);
+    return omega - 0.5f * bracket + (1.0f / 12.0f) * glm::cross(theta, bracket);
+}
+
+const char* simulationIntegratorName(SimulationIntegrator integrator) {
+    switch (integrator) {
+    case SimulationIntegrator::ExplicitEuler: return "Explicit Euler";
+    case SimulationIntegrator::SymplecticEuler: return "Symplectic Euler";
+    case SimulationIntegrator::VelocityVerlet: return "Velocity Verlet";
+    case SimulationIntegrator::RKMK4: return "RKMK4";
+    }
+    return "Unknown";
+}
+
+DipoleSimulation::DipoleSimulation(const SimulationSettings& settings)
+    : m_settings(settings) {
+}
+
+void DipoleSimulation::setBounds(const glm::vec3& bounds_min, const glm::vec3& bounds_max) {
+    m_bounds_min = bounds_min;
+    m_bounds_max = bounds_max;
+}
+
+int DipoleSimulation::accumulate(double simulated_time) {
+    double tick = std::max(m_settings.tick, 1e-6f);
+    m_accumulator += std::abs(simulated_time);
+    int ticks = static_cast<int>(m_accumulator / tick);
+    int budget = std::max(m_settings.max_ticks_per_frame, 1);
+    // Only the fraction of a tick is carried over, whole ticks beyond the budget are dropped
+    // rather than caught up next frame, so a slow frame cannot start a spiral
+    m_accumulator -= ticks * tick;
+    if (ticks > budget) {
+        m_dropped_time += (ticks - budget) * tick;
+        ticks = budget;
+    }
+    return ticks;
+}
+
+void DipoleSimulation::tick(DipoleStore& store, bool reverse) {
+    m_previous_positions = store.getPositions();
+    m_previous_rotations = store.getRotations();
+
+    // Forces closing the last Verlet step still hold unless the store was edited since
+    // An edit also wakes every sleeper, whatever changed may have disturbed them
+    const bool edited = store.getVersion() != m_tick_version || m_forces.size() != store.size();
+    if (edited || !m_settings.sleeping) {
+        m_forces_current = false;
+        m_far_forces_current = false;
+        wakeAll(store.size());
+    }
+    loadState(store);
+    if (edited || m_dipole_bodies.size() != store.size()) {
+        buildBodies(store);
+    }
+    store.prepareFieldQueries();
+    m_force_evaluations = 0;
+
+    // Flags can change without an edit, so the awake set is rebuilt every tick. With every
+    // dipole asleep or pinned there is nothing to integrate.
+    m_awake.clear();
+    for (size_t i = 0; i < store.size(); ++i) {
+        if (!isStatic(store, i)) {
+            m_awake.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    const bool idle = m_num_asleep > 0 && m_awake.empty();
+
+    // Pinning is not an edit either, a body with a pinned member is held in place whole
+    for (Body& body : m_bodies) {
+        body.fixed = false;
+    }
+    for (size_t i = 0; i < store.size(); ++i) {
+        if (m_dipole_bodies[i] >= 0 && isPinned(store, i)) {
+            m_bodies[m_dipole_bodies[i]].fixed = true;
+        }
+    }
+    m_member_list.clear();
+    for (uint32_t i : m_body_members) {
+        if (!m_bodies[m_dipole_bodies[i]].fixed && !isPinned(store, i)) {
+            m_member_list.push_back(i);
+        }
+    }
+
+    int substeps = std::max(m_settings.substeps, 1);
+    float dt = m_settings.tick / substeps;
+    if (reverse) {
+        dt = -dt;
+    }
+    const int far_interval = std::max(m_settings.far_field_interval, 1);
+    if (usesRespa() && !idle) {
+        // Near forces every substep, far forces once per group of far_interval substeps
+        for (int step = 0; step < substeps; step += far_interval) {
+            stepRespa(store, dt, std::min(far_interval, substeps - step));
+        }
+    }
+    for (int step = 0; step < substeps && !usesRespa() && !idle; ++step) {
+        switch (m_settings.integrator) {
+        case SimulationIntegrator::ExplicitEuler: stepExplicitEuler(store, dt); break;
+        case SimulationIntegrator::SymplecticEuler: stepSymplecticEuler(store, dt); break;
+        case SimulationIntegrator::VelocityVerlet:
+            if (m_settings.adaptive) {
+                stepBlockVerlet(store, dt);
+                stepBodies(store, dt);
+            }
+            else {
+                stepVelocityVerlet(store, dt);
+            }
+            break;
+        case SimulationIntegrator::RKMK4:
+            stepRKMK4(store, dt);
+            stepBodies(store, dt);
+            break;
+        }
+    }
+
+    if (m_settings.sleeping && !idle) {
+        updateSleep(store, std::abs(dt) * substeps);
+    }
+    storeState(store);
+    m_last_force_evaluations = m_force_evaluations;
+    ++m_tick_count;
+    m_tick_version = store.getVersion();
+}
+
+void DipoleSimulation::reset() {
+    m_accumulator = 0.0;
+    m_tick_version = UINT64_MAX;
+    m_forces_current = false;
+    m_far_forces_current = false;
+    wakeAll(0);
+}
+
+float DipoleSimulation::getInterpolationAlpha() const {
+    return static_cast<float>(std::min(m_accumulator / std::max(m_settings.tick, 1e-6f), 1.0));
+}
+
+bool DipoleSimulation::interpolatePoses(const DipoleStore& store, std::vector<glm::vec3>& positions, std::vector<glm::quat>& rotations) const {
+    if (store.getVersion() != m_tick_version || m_previous_positions.size() != store.size()) {
+        return false;
+    }
+    float alpha = getInterpolationAlpha();
+    positions.resize(store.size());
+    rotations.resize(store.size());
+    for (size_t i = 0; i < store.size(); ++i) {
+        positions[i] = glm::mix(m_previous_positions[i], store.getPosition(i), alpha);
+        rotations[i] = glm::slerp(m_previous_rotations[i], store.getRotation(i), alpha);
+    }
+    return true;
+}
+
+bool DipoleSimulation::isStatic(const DipoleStore& store, size_t index) const {
+    return isPinned(store, index) || (m_num_asleep > 0 && m_asleep[index]);
+}
+
+bool DipoleSimulation::isFree(const DipoleStore& store, size_t index) const {
+    return m_dipole_bodies[index] < 0 && !isStatic(store, index);
+}
+
+void DipoleSimulation::wakeAll(size_t num_dipoles) {
+    m_asleep.assign(num_dipoles, 0);
+    m_rest_times.assign(num_dipoles, 0.0f);
+    m_sleeper_valid.clear();
+    m_num_asleep = 0;
+    m_num_islands = 0;
+}
+
+void DipoleSimulation::updateSleep(const DipoleStore& store, float elapsed) {
+    const size_t num_dipoles = store.size();
+
+    // A dipole rests while both speeds stay under their thresholds. Net force or torque
+    // would accelerate it past them within the window, so resting for sleep_time also
+    // means it is near equilibrium.
+    const float velocity_limit = m_settings.sleep_velocity * m_settings.sleep_velocity;
+    const float angular_limit = m_settings.sleep_angular_velocity * m_settings.sleep_angular_velocity;
+    // Members of rigid bodies never rest, an island holding part of a body cannot stop it.
+    for (uint32_t i : m_awake) {
+        bool resting = m_dipole_bodies[i] < 0
+            && glm::dot(m_state.velocities[i], m_state.velocities[i]) <= velocity_limit
+            && glm::dot(m_state.angular_velocities[i], m_state.angular_velocities[i]) <= angular_limit;
+        m_rest_times[i] = resting ? m_rest_times[i] + elapsed : 0.0f;
+    }
+
+    // Islands join dipoles closer than the island radius. Pinned dipoles never move, so
+    // like the ground in a rigid body solver they anchor islands without joining them.
+    const float radius = std::max(m_settings.island_radius, 1e-4f);
+    m_island_grid.setCutoff(radius, 0.25f * radius);
+    m_island_grid.update(m_state.positions);
+    m_island_parents.resize(num_dipoles);
+    std::iota(m_island_parents.begin(), m_island_parents.end(), 0u);
+    for (size_t i = 0; i < num_dipoles; ++i) {
+        if (isPinned(store, i)) {
+            continue;
+        }
+        for (const uint32_t* j = m_island_grid.neighboursBegin(i); j != m_island_grid.neighboursEnd(i); ++j) {
+            glm::vec3 d = m_state.positions[*j] - m_state.positions[i];
+            if (*j > i && !isPinned(store, *j) && glm::dot(d, d) <= radius * radius) {
+                m_island_parents[findRoot(m_island_parents, static_cast<uint32_t>(i))] = findRoot(m_island_parents, *j);
+            }
+        }
+    }
+
+    // The least rested member decides for its whole island
+    m_island_rest_times.assign(num_dipoles, FLT_MAX);
+    for (size_t i = 0; i < num_dipoles; ++i) {
+        if (!isPinned(store, i)) {
+            float& island_rest = m_island_rest_times[findRoot(m_island_parents, static_cast<uint32_t>(i))];
+            island_rest = std::min(island_rest, m_rest_times[i]);
+        }
+    }
+
+    bool changed = false;
+    m_num_asleep = 0;
+    m_num_islands = 0;
+    for (size_t i = 0; i < num_dipoles; ++i) {
+        if (isPinned(store, i)) {
+            continue;
+        }
+        uint32_t root = findRoot(m_island_parents, static_cast<uint32_t>(i));
+        m_num_islands += root == i;
+        bool asleep = m_island_rest_times[root] >= m_settings.sleep_time;
+        changed |= asleep != (m_asleep[i] != 0);
+        m_asleep[i] = asleep;
+        if (asleep) {
+            m_state.velocities[i] = glm::vec3(0.0f);
+            m_state.angular_velocities[i] = glm::vec3(0.0f);
+            ++m_num_asleep;
+        }
+    }
+
+    // Woken dipoles have stale forces and the sleepers' cached field is a different sum
+    if (changed) {
+        m_sleeper_valid.clear();
+        m_forces_current = false;
+        m_far_forces_current = false;
+    }
+}
+
+void DipoleSimulation::buildBodies(const DipoleStore& store) {
+    const size_t num_dipoles = store.size();
+    m_bodies.clear();
+    m_body_members.clear();
+    m_dipole_bodies.assign(num_dipoles, -1);
+    for (size_t i = 0; i < num_dipoles; ++i) {
+        if (store.getBody(i) != NO_BODY) {
+            m_body_members.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    // Group the members by body id, keeping store order within a body
+    std::stable_sort(m_body_members.begin(), m_body_members.end(),
+        [&store](uint32_t a, uint32_t b) { return store.getBody(a) < store.getBody(b); });
+    for (size_t m = 0; m < m_body_members.size(); ++m) {
+        if (m == 0 || store.getBody(m_body_members[m]) != store.getBody(m_body_members[m - 1])) {
+            Body body{};
+            body.first_member = static_cast<uint32_t>(m);
+            body.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+            m_bodies.push_back(body);
+        }
+        ++m_bodies.back().num_members;
+        m_dipole_bodies[m_body_members[m]] = static_cast<int>(m_bodies.size() - 1);
+    }
+
+    // The body frame starts aligned with the world, so the members' current offsets from
+    // the center and rotations are their body frame pose
+    m_member_offsets.resize(m_body_members.size());
+    m_member_rotations.resize(m_body_members.size());
+    for (Body& body : m_bodies) {
+        const uint32_t end = body.first_member + body.num_members;
+        glm::vec3 center(0.0f);
+        glm::vec3 velocity(0.0f);
+        for (uint32_t m = body.first_member; m < end; ++m) {
+            center += m_state.positions[m_body_members[m]];
+            velocity += m_state.velocities[m_body_members[m]];
+        }
+        body.center = center / static_cast<float>(body.num_members);
+        body.velocity = velocity / static_cast<float>(body.num_members);
+        body.shape_inertia = glm::mat3(0.0f);
+        for (uint32_t m = body.first_member; m < end; ++m) {
+            glm::vec3 offset = m_state.positions[m_body_members[m]] - body.center;
+            m_member_offsets[m] = offset;
+            m_member_rotations[m] = m_state.rotations[m_body_members[m]];
+            body.shape_inertia += glm::dot(offset, offset) * glm::mat3(1.0f) - glm::outerProduct(offset, offset);
+        }
+        // Members all spin with the body, the first one's angular velocity is the body's
+        body.angular_momentum = getBodyInertia(body) * m_state.angular_velocities[m_body_members[body.first_member]];
+    }
+}
+
+float DipoleSimulation::getBodyMass(const Body& body) const {
+    return body.num_members * m_settings.dipole_mass;
+}
+
+glm::mat3 DipoleSimulation::getBodyInertia(const Body& body) const {
+    // Point masses at the members, each also spinning about its own center
+    return m_settings.dipole_mass * body.shape_inertia + (body.num_members * m_settings.moment_of_inertia) * glm::mat3(1.0f);
+}
+
+void DipoleSimulation::kickBodies(const std::vector<glm::vec3>& forces, const std::vector<glm::vec3>& torques, float dt) {
+    // Members are contiguous per body, so each reduction is one pass over a range. Member
+    // forces on each other cancel in pairs and are never evaluated.
+    for (Body& body : m_bodies) {
+        if (body.fixed) {
+            continue;
+        }
+        glm::vec3 force(0.0f);
+        glm::vec3 torque(0.0f);
+        for (uint32_t m = body.first_member; m < body.first_member + body.num_members; ++m) {
+            uint32_t i = m_body_members[m];
+            force += forces[i];
+            torque += glm::cross(m_state.positions[i] - body.center, forces[i]) + torques[i];
+        }
+        body.velocity += (force / getBodyMass(body)) * dt;
+        body.angular_momentum += torque * dt;
+    }
+}
+
+void DipoleSimulation::driftBodies(float dt) {
+    for (Body& body : m_bodies) {
+        if (body.fixed) {
+            continue;
+        }
+        // The inertia is only diagonal in the world frame for symmetric bodies, so the
+        // angular velocity follows from the momentum through the rotated inertia
+        glm::mat3 inertia = getBodyInertia(body);
+        glm::mat3 rotation = glm::mat3_cast(body.rotation);
+        glm::vec3 angular_velocity = rotation * glm::inverse(inertia) * glm::transpose(rotation) * body.angular_momentum;
+        // Only the center is kept inside the bounds, members may reach past them
+        body.center = glm::clamp(body.center + body.velocity * dt, m_bounds_min, m_bounds_max);
+        body.rotation = glm::normalize(expMap(angular_velocity * dt) * body.rotation);
+
+        rotation = glm::mat3_cast(body.rotation);
+        angular_velocity = rotation * glm::inverse(inertia) * glm::transpose(rotation) * body.angular_momentum;
+        for (uint32_t m = body.first_member; m < body.first_member + body.num_members; ++m) {
+            uint32_t i = m_body_members[m];
+            glm::vec3 offset = rotation * m_member_offsets[m];
+            m_state.positions[i] = body.center + offset;
+            m_state.rotations[i] = glm::normalize(body.rotation * m_member_rotations[m]);
+            m_state.velocities[i] = body.velocity + glm::cross(angular_velocity, offset);
+            m_state.angular_velocities[i] = angular_velocity;
+        }
+    }
+}
+
+void DipoleSimulation::stepBodies(const DipoleStore& store, float dt) {
+    // Split step, the bodies advance after the free dipoles and see them at their new
+    // poses. Forces are only evaluated on the members.
+    if (m_member_list.empty()) {
+        return;
+    }
+    computeForces(store, m_state.positions, m_state.rotations, m_forces, m_torques, &m_member_list);
+    kickBodies(m_forces, m_torques, 0.5f * dt);
+    driftBodies(dt);
+    computeForces(store, m_state.positions, m_state.rotations, m_forces, m_torques, &m_member_list);
+    kickBodies(m_forces, m_torques, 0.5f * dt);
+    // The free dipoles' forces were taken before the bodies moved
+    m_forces_current = false;
+}
+
+void DipoleSimulation::loadState(DipoleStore& store) {
+    m_state.positions = store.getPositions();
+    m_state.rotations = store.getRotations();
+    m_state.velocities = store.getVelocities();
+    m_state.angular_velocities = store.getAngularVelocities();
+}
+
+void DipoleSimulation::storeState(DipoleStore& store) const {
+    store.getVelocities() = m_state.velocities;
+    store.getAngularVelocities() = m_state.angular_velocities;
+    for (size_t i = 0; i < store.size(); ++i) {
+        if (!isStatic(store, i)) {
+            store.setPose(i, m_state.positions[i], m_state.rotations[i]);
+        }
+    }
+}
+
+void DipoleSimulation::computeForces(const DipoleStore& store, const std::vector<glm::vec3>& positions, const std::vector<glm::quat>& rotations,
+    std::vector<glm::vec3>& forces, std::vector<glm::vec3>& torques, const std::vector<uint32_t>* active, ForceTerms terms) {
+    const size_t num_dipoles = store.size();
+    const std::vector<float>& moments = store.getMoments();
+    const float pixels_per_meter = store.mPixelsPerMeter;
+    forces.resize(num_dipoles, glm::vec3(0.0f));
+    torques.resize(num_dipoles, glm::vec3(0.0f));
+    m_directions.resize(num_dipoles);
+    for (size_t j = 0; j < num_dipoles; ++j) {
+        m_directions[j] = rotations[j] * glm::vec3(0.0f, 0.0f, -1.0f);
+    }
+
+    // With neighbour lists only near pairs are summed exactly, the rest comes from the grid's
+    // far field. Near-only evaluations leave the lists alone, so between two far evaluations
+    // the split cannot change and no pair is counted in both or neither.
+    const bool use_grid = m_settings.neighbour_lists || terms != ForceTerms::All;
+    const bool near_terms = terms != ForceTerms::Far;
+    const bool far_terms = terms != ForceTerms::Near;
+
+    // With the store's pinned field grid, pinned dipoles leave the pair sums and the far
+    // field aggregates, a grid sample stands in for all of them. Its exact part is close
+    // range, so it counts as a near term.
+    const StaticFieldGrid* pinned_field = store.getStaticField();
+    const std::vector<float>* source_moments = &moments;
+    if (pinned_field) {
+        m_source_moments = moments;
+        for (size_t j = 0; j < num_dipoles; ++j) {
+            if (isPinned(store, j)) {
+                m_source_moments[j] = 0.0f;
+            }
+        }
+        source_moments = &m_source_moments;
+    }
+    if (use_grid) {
+        m_grid.setCutoff(m_settings.neighbour_cutoff, m_settings.neighbour_skin);
+        if (far_terms || !m_grid.isBuilt(num_dipoles)) {
+            m_grid.update(positions);
+        }
+        if (far_terms) {
+            // Bodies are rigid, their members' mutual forces cancel and are left out here too.
+            // Block steps only move a few dipoles per micro-step, only those get a far field.
+            m_grid.computeFarField(positions, m_directions, *source_moments, pixels_per_meter, m_far_fields, m_far_gradients,
+                m_bodies.empty() ? nullptr : &m_dipole_bodies, active);
+        }
+    }
+
+    // Sleepers are left out of the exact pair sums, their field comes from the cache. Near
+    // lists bound which sleepers a sample covers, so a rebuild invalidates every sample.
+    const bool use_sleepers = m_num_asleep > 0 && near_terms;
+    if (!active) {
+        active = &m_awake;
+    }
+    if (use_sleepers && (m_sleeper_valid.size() != num_dipoles || m_sleeper_use_grid != use_grid
+        || (use_grid && m_sleeper_grid_rebuilds != m_grid.getRebuildCount()))) {
+        m_sleeper_valid.assign(num_dipoles, 0);
+        m_sleeper_origins.resize(num_dipoles);
+        m_sleeper_fields.resize(num_dipoles);
+        m_sleeper_gradients.resize(num_dipoles);
+        m_sleeper_use_grid = use_grid;
+        m_sleeper_grid_rebuilds = m_grid.getRebuildCount();
+    }
+    const float refresh = m_settings.sleep_field_refresh * m_settings.sleep_field_refresh;
+
+    const float h = 0.001f; // Small step for numerical gradient
+    size_t count = active ? active->size() : num_dipoles;
+    m_force_evaluations += count;
+    for (size_t n = 0; n < count; ++n) {
+        size_t i = active ? (*active)[n] : n;
+        glm::vec3 pos_i = positions[i];
+        glm::vec3 m_i = moments[i] * m_directions[i];
+        auto field_of = [&](size_t j, const glm::vec3& pos) {
+            return MagneticDipole::calculateDipoleField(pos, positions[j], m_directions[j], moments[j], pixels_per_meter);
+        };
+
+        // Field at dipole i for the torque, and force F_i = ∇(m_i · B). The far field's
+        // gradient is its Jacobian, so its force is the transposed Jacobian times m_i.
+        glm::vec3 B_i(0.0f);
+        glm::vec3 force(0.0f);
+        if (use_grid && far_terms) {
+            B_i = m_far_fields[i];
+            force = glm::transpose(m_far_gradients[i]) * m_i;
+        }
+        if (pinned_field && near_terms) {
+            glm::vec3 pinned_B;
+            glm::mat3 pinned_gradient;
+            pinned_field->sample(pos_i, pinned_B, pinned_gradient);
+            B_i += pinned_B;
+            force += glm::transpose(pinned_gradient) * m_i;
+        }
+        if (use_sleepers) {
+            glm::vec3 drift = pos_i - m_sleeper_origins[i];
+            if (!m_sleeper_valid[i] || glm::dot(drift, drift) > refresh) {
+                // Resample the sleepers' field and central difference Jacobian here
+                m_sleeper_origins[i] = pos_i;
+                m_sleeper_fields[i] = glm::vec3(0.0f);
+                m_sleeper_gradients[i] = glm::mat3(0.0f);
+                m_sleeper_valid[i] = 1;
+                auto add_sleeper = [&](size_t j) {
+                    if (!m_asleep[j]) {
+                        return;
+                    }
+                    m_sleeper_fields[i] += field_of(j, pos_i);
+                    for (int k = 0; k < 3; ++k) {
+                        glm::vec3 offset(0.0f);
+                        offset[k] = h;
+                        m_sleeper_gradients[i][k] += (field_of(j, pos_i + offset) - field_of(j, pos_i - offset)) / (2.0f * h);
+                    }
+                };
+                if (use_grid) {
+                    for (const uint32_t* j = m_grid.neighboursBegin(i); j != m_grid.neighboursEnd(i); ++j) {
+                        add_sleeper(*j);
+                    }
+                }
+                else {
+                    for (size_t j = 0; j < num_dipoles; ++j) {
+                        if (j != i) {
+                            add_sleeper(j);
+                        }
+                    }
+                }
+            }
+            B_i += m_sleeper_fields[i] + m_sleeper_gradients[i] * (pos_i - m_sleeper_origins[i]);
+            force += glm::transpose(m_sleeper_gradients[i]) * m_i;
+        }
+        const int body_i = m_dipole_bodies[i];
+        auto add_pair = [&](size_t j) {
+            // Members of one body cannot move relative to each other, their pairs are skipped
+            if ((use_sleepers && m_asleep[j]) || (pinned_field && isPinned(store, j)) || (body_i >= 0 && m_dipole_bodies[j] == body_i)) {
+                return;
+            }
+            B_i += field_of(j, pos_i);
+
+            // Numerical gradient of potential energy U = m_i · B_j
+            glm::vec3 B_xp = field_of(j, pos_i + glm::vec3(h, 0, 0));
+            glm::vec3 B_xm = field_of(j, pos_i - glm::vec3(h, 0, 0));
+            glm::vec3 B_yp = field_of(j, pos_i + glm::vec3(0, h, 0));
+            glm::vec3 B_ym = field_of(j, pos_i - glm::vec3(0, h, 0));
+            glm::vec3 B_zp = field_of(j, pos_i + glm::vec3(0, 0, h));
+            glm::vec3 B_zm = field_of(j, pos_i - glm::vec3(0, 0, h));
+
+            glm::vec3 grad_U;
+            grad_U.x = (glm::dot(m_i, B_xp) - glm::dot(m_i, B_xm)) / (2.0f * h);
+            grad_U.y = (glm::dot(m_i, B_yp) - glm::dot(m_i, B_ym)) / (2.0f * h);
+            grad_U.z = (glm::dot(m_i, B_zp) - glm::dot(m_i, B_zm)) / (2.0f * h);
+
+            force += grad_U;
+        };
+        if (near_terms && use_grid) {
+            for (const uint32_t* j = m_grid.neighboursBegin(i); j != m_grid.neighboursEnd(i); ++j) {
+                add_pair(*j);
+            }
+        }
+        else if (near_terms) {
+            for (size_t j = 0; j < num_dipoles; ++j) {
+                if (i != j) {
+                    add_pair(j);
+                }
+            }
+        }
+
+        // Torque: τ = m_i × B_i
+        torques[i] = glm::clamp(glm::cross(m_i, B_i), -m_settings.torque_clamp, m_settings.torque_clamp);
+        forces[i] = glm::clamp(force, -m_settings.force_clamp, m_settings.force_clamp);
+    }
+}
+
+void DipoleSimulation::stepExplicitEuler(const DipoleStore& store, float dt) {
+    // Drift with the old velocities, then kick, the quaternion is advanced additively
+    computeForces(store, m_state.positions, m_state.rotations, m_forces, m_torques);
+    m_forces_current = false;
+    for (size_t i = 0; i < store.size(); ++i) {
+        if (!isFree(store, i)) {
+            continue;
+        }
+        glm::quat w_dt = glm::quat(0.0f, m_state.angular_velocities[i] * dt * 0.5f);
+        m_state.rotations[i] = glm::normalize(m_state.rotations[i] + w_dt * m_state.rotations[i]);
+        m_state.positions[i] = glm::clamp(m_state.positions[i] + m_state.velocities[i] * dt, m_bounds_min, m_bounds_max);
+        m_state.velocities[i] += (m_forces[i] / m_settings.dipole_mass) * dt;
+        m_state.angular_velocities[i] += (m_torques[i] / m_settings.moment_of_inertia) * dt;
+    }
+    driftBodies(dt);
+    kickBodies(m_forces, m_torques, dt);
+}
+
+void DipoleSimulation::stepSymplecticEuler(const DipoleStore& store, float dt) {
+    // Kick, then drift with the new velocities
+    computeForces(store, m_state.positions, m_state.rotations, m_forces, m_torques);
+    m_forces_current = false;
+    for (size_t i = 0; i < store.size(); ++i) {
+        if (!isFree(store, i)) {
+            continue;
+        }
+        m_state.velocities[i] += (m_forces[i] / m_settings.dipole_mass) * dt;
+        m_state.angular_velocities[i] += (m_torques[i] / m_settings.moment_of_inertia) * dt;
+        m_state.positions[i] = glm::clamp(m_state.positions[i] + m_state.velocities[i] * dt, m_bounds_min, m_bounds_max);
+        m_state.rotations[i] = glm::normalize(expMap(m_state.angular_velocities[i] * dt) * m_state.rotations[i]);
+    }
+    kickBodies(m_forces, m_torques, dt);
+    driftBodies(dt);
+}
+
+void DipoleSimulation::stepVelocityVerlet(const DipoleStore& store, float dt, ForceTerms terms) {
+    // Half kick, drift on both groups, half kick with the forces at the new poses. The
+    // closing forces open the next step, so each step costs one force evaluation.
+    if (!m_forces_current || m_forces_terms != terms) {
+        computeForces(store, m_state.positions, m_state.rotations, m_forces, m_torques, nullptr, terms);
+    }
+    const float half_dt = 0.5f * dt;
+    for (size_t i = 0; i < store.size(); ++i) {
+        if (!isFree(store, i)) {
+            continue;
+        }
+        m_state.velocities[i] += (m_forces[i] / m_settings.dipole_mass) * half_dt;
+        m_state.angular_velocities[i] += (m_torques[i] / m_settings.moment_of_inertia) * half_dt;
+        m_state.positions[i] = glm::clamp(m_state.positions[i] + m_state.velocities[i] * dt, m_bounds_min, m_bounds_max);
+        m_state.rotations[i] = glm::normalize(expMap(m_state.angular_velocities[i] * dt) * m_state.rotations[i]);
+    }
+    kickBodies(m_forces, m_torques, half_dt);
+    driftBodies(dt);
+    computeForces(store, m_state.positions, m_state.rotations, m_forces, m_torques, nullptr, terms);
+    for (size_t i = 0; i < store.size(); ++i) {
+        if (!isFree(store, i)) {
+            continue;
+        }
+        m_state.velocities[i] += (m_forces[i] / m_settings.dipole_mass) * half_dt;
+        m_state.angular_velocities[i] += (m_torques[i] / m_settings.moment_of_inertia) * half_dt;
+    }
+    kickBodies(m_forces, m_torques, half_dt);
+    m_forces_current = true;
+    m_forces_terms = terms;
+}
+
+void DipoleSimulation::stepRKMK4(const DipoleStore& store, float dt) {
+    // Classic RK4 on positions and velocities. Rotations are q = exp(theta) q0, RK4 runs on
+    // the rotation vector theta in the Lie algebra and maps back once at the end.
+    const size_t num_dipoles = store.size();
+    static constexpr float stage_offsets[4] = { 0.0f, 0.5f, 0.5f, 1.0f };
+    static constexpr float stage_weights[4] = { 1.0f / 6.0f, 1.0f / 3.0f, 1.0f / 3.0f, 1.0f / 6.0f };
+    m_stage_positions.resize(num_dipoles);
+    m_stage_rotations.resize(num_dipoles);
+
+    for (int stage = 0; stage < 4; ++stage) {
+        // Stage state, advanced from the step start along the previous stage's derivatives
+        float offset = stage_offsets[stage] * dt;
+        m_stage_velocities[stage].resize(num_dipoles);
+        m_stage_angular_velocities[stage].resize(num_dipoles);
+        m_stage_rotation_rates[stage].resize(num_dipoles);
+        for (size_t i = 0; i < num_dipoles; ++i) {
+            glm::vec3 theta(0.0f);
+            if (stage == 0 || !isFree(store, i)) {
+                m_stage_positions[i] = m_state.positions[i];
+                m_stage_rotations[i] = m_state.rotations[i];
+                m_stage_velocities[stage][i] = m_state.velocities[i];
+                m_stage_angular_velocities[stage][i] = m_state.angular_velocities[i];
+            }
+            else {
+                const int previous = stage - 1;
+                theta = offset * m_stage_rotation_rates[previous][i];
+                m_stage_positions[i] = m_state.positions[i] + offset * m_stage_velocities[previous][i];
+                m_stage_rotations[i] = expMap(theta) * m_state.rotations[i];
+                m_stage_velocities[stage][i] = m_state.velocities[i] + offset * m_stage_forces[previous][i] / m_settings.dipole_mass;
+                m_stage_angular_velocities[stage][i] = m_state.angular_velocities[i] + offset * m_stage_torques[previous][i] / m_settings.moment_of_inertia;
+            }
+            m_stage_rotation_rates[stage][i] = dexpInv(theta, m_stage_angular_velocities[stage][i]);
+        }
+        computeForces(store, m_stage_positions, m_stage_rotations, m_stage_forces[stage], m_stage_torques[stage]);
+    }
+
+    for (size_t i = 0; i < num_dipoles; ++i) {
+        if (!isFree(store, i)) {
+            continue;
+        }
+        glm::vec3 velocity_sum(0.0f), force_sum(0.0f), torque_sum(0.0f), theta_sum(0.0f);
+        for (int stage = 0; stage < 4; ++stage) {
+            velocity_sum += stage_weights[stage] * m_stage_velocities[stage][i];
+            force_sum += stage_weights[stage] * m_stage_forces[stage][i];
+            torque_sum += stage_weights[stage] * m_stage_torques[stage][i];
+            theta_sum += stage_weights[stage] * m_stage_rotation_rates[stage][i];
+        }
+        m_state.positions[i] = glm::clamp(m_state.positions[i] + dt * velocity_sum, m_bounds_min, m_bounds_max);
+        m_state.velocities[i] += dt * force_sum / m_settings.dipole_mass;
+        m_state.angular_velocities[i] += dt * torque_sum / m_settings.moment_of_inertia;
+        m_state.rotations[i] = glm::normalize(expMap(dt * theta_sum) * m_state.rotations[i]);
+    }
+    m_forces_current = false;
+}
+
+void DipoleSimulation::stepBlockVerlet(const DipoleStore& store, float dt) {
+    // Dipole i steps by dt / 2^level_i. The step is cut into micro steps of the finest
+    // level in use. Every dipole drifts each micro step, but only the dipoles whose own
+    // step starts or ends get kicked, and forces are only evaluated for those ending.
+    const size_t num_dipoles = store.size();
+    if (m_levels.size() != num_dipoles) {
+        m_levels.assign(num_dipoles, 0);
+    }
+    m_next_levels = m_levels;
+    if (!m_forces_current || m_forces_terms != ForceTerms::All) {
+        computeForces(store, m_state.positions, m_state.rotations, m_forces, m_torques);
+    }
+
+    const int top_level = *std::max_element(m_levels.begin(), m_levels.end());
+    const int micro_steps = 1 << top_level;
+    const float micro_dt = dt / micro_steps;
+    const float tolerance = std::max(m_settings.adaptive_tolerance, 1e-9f);
+    const int max_level = std::min(std::max(m_settings.max_block_levels, 0), 16);
+    for (int k = 0; k < micro_steps; ++k) {
+        // Opening half kicks for dipoles starting a step
+        for (size_t i = 0; i < num_dipoles; ++i) {
+            int stride = 1 << (top_level - m_levels[i]);
+            if (k % stride != 0 || !isFree(store, i)) {
+                continue;
+            }
+            float half_dt = 0.5f * stride * micro_dt;
+            m_state.velocities[i] += (m_forces[i] / m_settings.dipole_mass) * half_dt;
+            m_state.angular_velocities[i] += (m_torques[i] / m_settings.moment_of_inertia) * half_dt;
+        }
+
+        // Drift everyone so the forces on active dipoles see current positions
+        for (size_t i = 0; i < num_dipoles; ++i) {
+            if (!isFree(store, i)) {
+                continue;
+            }
+            m_state.positions[i] = glm::clamp(m_state.positions[i] + m_state.velocities[i] * micro_dt, m_bounds_min, m_bounds_max);
+            m_state.rotations[i] = glm::normalize(expMap(m_state.angular_velocities[i] * micro_dt) * m_state.rotations[i]);
+        }
+
+        m_active.clear();
+        for (size_t i = 0; i < num_dipoles; ++i) {
+            if ((k + 1) % (1 << (top_level - m_levels[i])) == 0 && isFree(store, i)) {
+                m_active.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        m_old_forces.resize(num_dipoles);
+        m_old_torques.resize(num_dipoles);
+        for (uint32_t i : m_active) {
+            m_old_forces[i] = m_forces[i];
+            m_old_torques[i] = m_torques[i];
+        }
+        computeForces(store, m_state.positions, m_state.rotations, m_forces, m_torques, &m_active);
+
+        // Closing half kicks, then estimate each step's local error from how much the
+        // acceleration changed over it. The error scales with the step cubed, so a level
+        // up (half the step) cuts it eightfold.
+        for (uint32_t i : m_active) {
+            int stride = 1 << (top_level - m_levels[i]);
+            float step_dt = stride * micro_dt;
+            m_state.velocities[i] += (m_forces[i] / m_settings.dipole_mass) * (0.5f * step_dt);
+            m_state.angular_velocities[i] += (m_torques[i] / m_settings.moment_of_inertia) * (0.5f * step_dt);
+
+            float dt_squared = step_dt * step_dt / 6.0f;
+            float error = std::max(glm::length(m_forces[i] - m_old_forces[i]) / m_settings.dipole_mass * dt_squared,
+                glm::length(m_torques[i] - m_old_torques[i]) / m_settings.moment_of_inertia * dt_squared);
+            int level = m_levels[i];
+            if (error > tolerance) {
+                level += std::max(1, static_cast<int>(std::ceil(std::log2(error / tolerance) / 3.0f)));
+            }
+            else if (error < tolerance / 8.0f) {
+                --level;
+            }
+            // Finer wins if a dipole closes several steps this substep
+            int desired = std::min(std::max(level, 0), max_level);
+            m_next_levels[i] = (k + 1 == stride) ? desired : std::max(m_next_levels[i], desired);
+        }
+    }
+
+    // Levels change only here, where every dipole has finished its step
+    m_levels.swap(m_next_levels);
+    m_forces_current = true;
+    m_forces_terms = ForceTerms::All;
+}
+
+bool DipoleSimulation::usesRespa() const {
+    return m_settings.integrator == SimulationIntegrator::VelocityVerlet && m_settings.neighbour_lists
+        && !m_settings.adaptive && m_settings.far_field_interval > 1;
+}
+
+void DipoleSimulation::stepRespa(const DipoleStore& store, float dt, int inner_steps) {
+    // Impulse RESPA: the far field kicks for half the outer step, the near field runs
+    // inner_steps Verlet steps, then the far field is re-evaluated and kicks again. The
+    // closing far forces open the next outer step.
+    if (!m_far_forces_current) {
+        computeForces(store, m_state.positions, m_state.rotations, m_far_forces, m_far_torques, nullptr, ForceTerms::Far);
+    }
+    const float half_outer_dt = 0.5f * dt * inner_steps;
+    auto far_kick = [&]() {
+        for (size_t i = 0; i < store.size(); ++i) {
+            if (!isFree(store, i)) {
+                continue;
+            }
+            m_state.velocities[i] += (m_far_forces[i] / m_settings.dipole_mass) * half_outer_dt;
+            m_state.angular_velocities[i] += (m_far_torques[i] / m_settings.moment_of_inertia) * half_outer_dt;
+        }
+        kickBodies(m_far_forces, m_far_torques, half_outer_dt);
+    };
+
+    far_kick();
+    for (int step = 0; step < inner_steps; ++step) {
+        stepVelocityVerlet(store, dt, ForceTerms::Near);
+    }
+    computeForces(store, m_state.positions, m_state.rotations, m_far_forces, m_far_torques, nullptr, ForceTerms::Far);
+    far_kick();
+    m_far_forces_current = true;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "dipole_store.h"
+#include "dipole_neighbour_grid.h"
+
+// Time integration scheme, each advances translation and rotation together
+enum class SimulationIntegrator {
+    ExplicitEuler,   // First order, drifts and needs small steps
+    SymplecticEuler, // First order, kick then drift, bounded energy error
+    VelocityVerlet,  // Second order leapfrog with Lie-Verlet rotation, one force evaluation per step
+    RKMK4,           // Fourth order Runge-Kutta, Munthe-Kaas on rotations, four evaluations per step
+};
+
+const char* simulationIntegratorName(SimulationIntegrator integrator);
+
+// Dipole dynamics settings. Simulated time is real time scaled by the simulation speed.
+struct SimulationSettings {
+    SimulationIntegrator integrator = SimulationIntegrator::VelocityVerlet;
+    float tick = 1.0f / 60.0f;        // Simulated seconds per fixed tick
+    int substeps = 4;                 // Integration steps per tick
+    int max_ticks_per_frame = 4;      // Catch-up budget, time beyond it is dropped
+    float dipole_mass = 1.0f;         // Mass of each dipole (kg)
+    float moment_of_inertia = 0.1f;   // Moment of inertia (kg·m²)
+    float force_clamp = 100.0f;       // Max force magnitude (N)
+    float torque_clamp = 10.0f;       // Max torque magnitude (N·m)
+    bool adaptive = false;            // Individual block timesteps with local error control, Verlet only
+    float adaptive_tolerance = 1e-4f; // Local error per step, meters for positions, radians for rotations
+    int max_block_levels = 6;         // Finest individual step is the substep / 2^levels
+    bool neighbour_lists = false;     // Exact near field from neighbour lists, aggregated far field beyond
+    float neighbour_cutoff = 0.5f;    // Separation always summed exactly
+    float neighbour_skin = 0.1f;      // Extra list reach, lists rebuild after moving half of it
+    int far_field_interval = 1;       // Substeps per far field evaluation (RESPA), Verlet with neighbour lists only
+    bool sleeping = false;            // Islands of resting dipoles stop integrating until something near them moves
+    float sleep_velocity = 0.01f;     // Speed below which a dipole is resting (m/s)
+    float sleep_angular_velocity = 0.05f; // Angular speed below which a dipole is resting (rad/s)
+    float sleep_time = 0.5f;          // Simulated seconds every dipole of an island must rest before it sleeps
+    float island_radius = 0.5f;       // Dipoles closer than this share an island and sleep or wake together
+    float sleep_field_refresh = 0.01f; // Awake dipoles re-sample the cached field of sleepers after moving this far
+};
+
+// Advances the dipoles of a store under their mutual forces and torques. Frame time is
+// gathered in an accumulator and spent in whole fixed ticks of substeps, so results do
+// not depend on the frame rate and a slow frame cannot take one huge unstable step. The
+// poses before the last tick are kept so rendering can blend between the last two ticks.
+// A tick loads the dynamic state into structure-of-arrays columns, integrates every
+// substep on them and writes the poses back to the store once. Rotations advance on the
+// quaternion group through the exponential map, so they stay unit length without
+// renormalization drift. Angular velocities are world-frame and the inertia is isotropic.
+// Islands of resting dipoles can sleep, the integrators skip them and the dipoles still
+// moving see them through a cached field. Dipoles sharing a body id in the store move as
+// one rigid body, the integrators advance the body from the summed force and torque of
+// its members and place the members from its pose.
+class DipoleSimulation {
+public:
+    explicit DipoleSimulation(const SimulationSettings& settings = SimulationSettings());
+
+    SimulationSettings& getSettings() { return m_settings; }
+    const SimulationSettings& getSettings() const { return m_settings; }
+
+    // Positions are clamped to these bounds
+    void setBounds(const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+
+    // Add simulated time to the accumulator and return how many ticks are due, at most
+    // max_ticks_per_frame. Time beyond the budget is dropped.
+    int accumulate(double simulated_time);
+    // Run one fixed tick, backwards in time if reverse
+    void tick(DipoleStore& store, bool reverse);
+    // Forget accumulated time and the interpolation poses, for when the simulation restarts
+    void reset();
+
+    // Fraction of a tick accumulated but not yet simulated
+    float getInterpolationAlpha() const;
+    // Poses blended from the previous tick towards the store by the interpolation alpha.
+    // Returns false if the store changed since the last tick, then the store is current.
+    bool interpolatePoses(const DipoleStore& store, std::vector<glm::vec3>& positions, std::vector<glm::quat>& rotations) const;
+
+    uint64_t getTickCount() const { return m_tick_count; }
+    const DipoleNeighbourGrid& getNeighbourGrid() const { return m_grid; }
+    // Per-dipole force evaluations made by the last tick
+    uint64_t getForceEvaluations() const { return m_last_force_evaluations; }
+    // Individual step level of each dipole under adaptive stepping, its step is the substep / 2^level
+    const std::vector<int>& getBlockLevels() const { return m_levels; }
+    size_t getSleepingCount() const { return m_num_asleep; }
+    size_t getIslandCount() const { return m_num_islands; }
+    size_t getBodyCount() const { return m_bodies.size(); }
+    double getDroppedTime() const { return m_dropped_time; }
+
+private:
+    // Interaction terms a force evaluation includes, near and far as split by the neighbour grid
+    enum class ForceTerms { All, Near, Far };
+
+    // Dynamic state integrated during a tick, one entry per dipole
+    struct State {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> velocities;
+        std::vector<glm::vec3> angular_velocities;
+    };
+
+    // Rigid body of the dipoles sharing a body id. The pose maps the members' body frame
+    // offsets and rotations to the world. Momenta are the body's own, the members'
+    // velocities are derived from them after every drift.
+    struct Body {
+        uint32_t first_member;     // Into m_body_members
+        uint32_t num_members;
+        glm::mat3 shape_inertia;   // Σ |r|²I - r rᵀ over the members in the body frame, per unit dipole mass
+        glm::vec3 center;
+        glm::quat rotation;
+        glm::vec3 velocity;
+        glm::vec3 angular_momentum;
+        bool fixed;                // Has a pinned member, so the whole body stays put
+    };
+
+    // Left alone by the integrators, pinned or asleep
+    bool isStatic(const DipoleStore& store, size_t index) const;
+    // Integrated on its own, neither static nor a member of a rigid body
+    bool isFree(const DipoleStore& store, size_t index) const;
+    void wakeAll(size_t num_dipoles);
+    // Advance the rest timers by elapsed, regroup the islands and put each island to sleep
+    // or wake it as a whole
+    void updateSleep(const DipoleStore& store, float elapsed);
+
+    // Regroup the rigid bodies from the store's body ids, taking the current poses as their shape
+    void buildBodies(const DipoleStore& store);
+    // Sum the forces and torques on the members of each body and kick its momenta by dt
+    void kickBodies(const std::vector<glm::vec3>& forces, const std::vector<glm::vec3>& torques, float dt);
+    // Move each body along its momenta by dt and place its members
+    void driftBodies(float dt);
+    // Velocity Verlet step of the bodies alone, for integrators that do not advance them
+    void stepBodies(const DipoleStore& store, float dt);
+    float getBodyMass(const Body& body) const;
+    // Body frame inertia tensor, from the current mass and moment of inertia settings
+    glm::mat3 getBodyInertia(const Body& body) const;
+
+    void loadState(DipoleStore& store);
+    void storeState(DipoleStore& store) const;
+    // Forces and torques on every dipole, or only the active ones, with the dipoles at
+    // positions and rotations. Entries of inactive dipoles are left as they were.
+    void computeForces(const DipoleStore& store, const std::vector<glm::vec3>& positions, const std::vector<glm::quat>& rotations,
+        std::vector<glm::vec3>& forces, std::vector<glm::vec3>& torques, const std::vector<uint32_t>* active = nullptr,
+        ForceTerms terms = ForceTerms::All);
+
+    void stepExplicitEuler(const DipoleStore& store, float dt);
+    void stepSymplecticEuler(const DipoleStore& store, float dt);
+    void stepVelocityVerlet(const DipoleStore& store, float dt, ForceTerms terms = ForceTerms::All);
+    void stepRKMK4(const DipoleStore& store, float dt);
+    // Velocity Verlet with individual power-of-two steps per dipole
+    void stepBlockVerlet(const DipoleStore& store, float dt);
+    // Multiple time stepping, inner_steps near-field Verlet steps inside one far-field step
+    bool usesRespa() const;
+    void stepRespa(const DipoleStore& store, float dt, int inner_steps);
+
+    SimulationSettings m_settings;
+    glm::vec3 m_bounds_min{ -1.0f };
+    glm::vec3 m_bounds_max{ 1.0f };
+    double m_accumulator{ 0.0 };
+    double m_dropped_time{ 0.0 };
+    uint64_t m_tick_count{ 0 };
+    uint64_t m_force_evaluations{ 0 };
+    uint64_t m_last_force_evaluations{ 0 };
+
+    State m_state;
+
+    // Forces and torques at m_state, valid after a Verlet step so the next one reuses them
+    std::vector<glm::vec3> m_forces;
+    std::vector<glm::vec3> m_torques;
+    bool m_forces_current{ false };
+    ForceTerms m_forces_terms{ ForceTerms::All };
+
+    // Far forces and torques at m_state under RESPA, closing one outer step and opening the next
+    std::vector<glm::vec3> m_far_forces;
+    std::vector<glm::vec3> m_far_torques;
+    bool m_far_forces_current{ false };
+
+    // Near/far split for neighbour lists, far field and Jacobian per dipole
+    DipoleNeighbourGrid m_grid;
+    std::vector<glm::vec3> m_far_fields;
+    std::vector<glm::mat3> m_far_gradients;
+
+    // Block timestep levels, kept across ticks while the dipole count is unchanged
+    std::vector<int> m_levels;
+    std::vector<int> m_next_levels;
+    std::vector<uint32_t> m_active;
+    std::vector<glm::vec3> m_old_forces;
+    std::vector<glm::vec3> m_old_torques;
+
+    // Sleep state, kept across ticks while only the simulation changes the store
+    std::vector<uint8_t> m_asleep;
+    std::vector<float> m_rest_times;         // Simulated time each dipole has been resting
+    std::vector<uint32_t> m_awake;           // Dipoles integrated this tick, neither pinned nor asleep
+    std::vector<uint32_t> m_island_parents;  // Union-find forest over dipoles closer than the island radius
+    std::vector<float> m_island_rest_times;  // Shortest rest time in each island, by root
+    size_t m_num_asleep{ 0 };
+    size_t m_num_islands{ 0 };
+    DipoleNeighbourGrid m_island_grid;
+
+    // Field and Jacobian of the sleeping dipoles at each awake dipole, sampled at an origin
+    // and expanded to first order around it. Sleepers do not move, so the samples hold
+    // until the sleep set or the near lists change or the dipole drifts from its origin.
+    std::vector<glm::vec3> m_sleeper_origins;
+    std::vector<glm::vec3> m_sleeper_fields;
+    std::vector<glm::mat3> m_sleeper_gradients;
+    std::vector<uint8_t> m_sleeper_valid;
+    uint64_t m_sleeper_grid_rebuilds{ UINT64_MAX };
+    bool m_sleeper_use_grid{ false };
+
+    // Rigid bodies, rebuilt whenever the store is edited and otherwise kept so their
+    // shape does not drift with rounding in the member poses
+    std::vector<Body> m_bodies;
+    std::vector<uint32_t> m_body_members;     // Member dipoles grouped by body
+    std::vector<glm::vec3> m_member_offsets;  // Body frame offset from the center, by m_body_members entry
+    std::vector<glm::quat> m_member_rotations; // Body frame rotation, by m_body_members entry
+    std::vector<int> m_dipole_bodies;         // Body index of each dipole, -1 if free
+    std::vector<uint32_t> m_member_list;      // Members of bodies that are not fixed, for member-only force evaluations
+
+    // Per-dipole scratch, reused between steps
+    std::vector<glm::vec3> m_directions;
+    std::vector<float> m_source_moments; // Moments with pinned dipoles zeroed while the pinned field grid stands in for them
+    std::vector<glm::vec3> m_stage_positions;
+    std::vector<glm::quat> m_stage_rotations;
+    std::vector<glm::vec3> m_stage_velocities[4];
+    std::vector<glm::vec3> m_stage_angular_velocities[4];
+    std::vector<glm::vec3> m_stage_forces[4];
+    std::vector<glm::vec3> m_stage_torques[4];
+    std::vector<glm::vec3> m_stage_rotation_rates[4]; // Rotation vector derivatives, dexp^-1 of the angular velocity
+
+    // Poses before the last tick and the store version the tick produced
+    std::vector<glm::vec3> m_previous_positions;
+    std::vector<glm::quat> m_previous_rotations;
+    uint64_t m_tick_version{ UINT64_MAX };
+};
@@ -0,0 +1,88 @@
+#include "dipole_source_buffer.h"
+#include "gl_debug.h"
+
+#include <algorithm>
+#include <iostream>
+
+DipoleSourceBuffer::DipoleSourceBuffer()
+    : m_backend(Backend::TextureBuffer) {
+}
+
+DipoleSourceBuffer::~DipoleSourceBuffer() {
+    release();
+}
+
+void DipoleSourceBuffer::release() {
+    if (m_texture) {
+        glDeleteTextures(1, &m_texture);
+        m_texture = 0;
+    }
+    m_buffer = nullptr;
+}
+
+void DipoleSourceBuffer::initialize(GpuResourceManager& resources) {
+    m_backend = GLAD_GL_VERSION_4_3 ? Backend::StorageBuffer : Backend::TextureBuffer;
+    m_buffer = &resources.createBuffer("Dipole source buffer");
+    // Reserve up front so the texture buffer view is never attached to an empty buffer
+    m_buffer->reserve(64 * sizeof(DipoleSourceGL));
+    if (m_backend == Backend::StorageBuffer) {
+        GLint64 max_block_bytes = 0;
+        glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &max_block_bytes);
+        m_max_sources = static_cast<size_t>(max_block_bytes) / sizeof(DipoleSourceGL);
+    }
+    else {
+        // GL 3.3 only guarantees 65536 texels, two per dipole
+        GLint max_texels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+        m_max_sources = static_cast<size_t>(max_texels) / (sizeof(DipoleSourceGL) / sizeof(glm::vec4));
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer->getBuffer());
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        labelGLObject(GL_TEXTURE, m_texture, "Dipole source texture buffer");
+    }
+}
+
+std::string DipoleSourceBuffer::shaderHeader() const {
+    if (m_backend == Backend::StorageBuffer) {
+        return "#version 430 core\n#define DIPOLE_SOURCES_SSBO\n";
+    }
+    return "#version 330 core\n";
+}
+
+void DipoleSourceBuffer::update(const DipoleStore& store) {
+    if (m_buffer->isCurrent(store.getVersion())) {
+        return;
+    }
+    GLDebugScope scope("Dipole source upload");
+    const size_t count = std::min(store.size(), m_max_sources);
+    if (count < store.size() && !m_reported_limit) {
+        std::cerr << "Dipole source buffer holds at most " << m_max_sources << " dipoles on this device, "
+            << store.size() - count << " are left out of GPU field evaluation" << std::endl;
+        m_reported_limit = true;
+    }
+    m_sources.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        m_sources[i].position_moment = glm::vec4(store.getPosition(i), store.getMoment(i));
+        m_sources[i].direction = glm::vec4(store.getDirection(i), 0.0f);
+    }
+
+    GpuBuffer::UploadResult result = m_buffer->upload(store.getVersion(), m_sources.data(), m_sources.size() * sizeof(DipoleSourceGL));
+    if (result == GpuBuffer::UploadResult::Reallocated && m_backend == Backend::TextureBuffer) {
+        glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer->getBuffer());
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+}
+
+void DipoleSourceBuffer::bind(const Shader& shader) const {
+    if (m_backend == Backend::StorageBuffer) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING, m_buffer->getBuffer());
+    }
+    else {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.set_int("dipole_data", TEXTURE_UNIT);
+    }
+}
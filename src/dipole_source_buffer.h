@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "dipole_store.h"
+#include "gpu_resources.h"
+
+// One dipole as read by GPU field shaders, two vec4 texels per dipole
+struct DipoleSourceGL {
+    glm::vec4 position_moment; // xyz position, w moment
+    glm::vec4 direction;       // xyz unit direction, w unused
+};
+
+// GPU copy of the dipole store for shaders that sum the field of every dipole. Sized to
+// the store up to the device limit: a shader storage buffer on GL 4.3, otherwise a
+// texture buffer, which GL 3.3 guarantees but only to 65536 texels, about 32k dipoles.
+// Dipoles past the limit are left out and reported once. Shaders include shaderHeader()
+// ahead of their source and read dipoles through fetchDipole(i), see field_bake_frag.
+class DipoleSourceBuffer {
+public:
+    enum class Backend { StorageBuffer, TextureBuffer };
+
+    static constexpr unsigned int STORAGE_BINDING = 0; // Matches the binding in the shader
+    static constexpr unsigned int TEXTURE_UNIT = 1;
+
+    DipoleSourceBuffer();
+    ~DipoleSourceBuffer();
+
+    DipoleSourceBuffer(const DipoleSourceBuffer&) = delete;
+    DipoleSourceBuffer& operator=(const DipoleSourceBuffer&) = delete;
+
+    void initialize(GpuResourceManager& resources);
+    // Delete the texture view while the context is still current, the storage belongs to the manager
+    void release();
+    Backend getBackend() const { return m_backend; }
+
+    // #version line and backend define to place before shader sources using fetchDipole
+    std::string shaderHeader() const;
+
+    // Copy the store to the GPU, skipped if its version is already uploaded.
+    // Storage grows geometrically and is never shrunk.
+    void update(const DipoleStore& store);
+    // Bind for use by shader, also sets its sampler on the texture buffer path
+    void bind(const Shader& shader) const;
+
+    // Dipoles uploaded, at most getMaxSources()
+    size_t size() const { return m_sources.size(); }
+    size_t getMaxSources() const { return m_max_sources; }
+
+private:
+    Backend m_backend;
+    GpuBuffer* m_buffer{ nullptr };
+    unsigned int m_texture{ 0 }; // Texture buffer view of m_buffer on the fallback path
+    std::vector<DipoleSourceGL> m_sources;
+    size_t m_max_sources{ 0 }; // From the backend's size limit, queried at initialize
+    bool m_reported_limit{ false };
+};
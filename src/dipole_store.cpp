@@ -0,0 +1,325 @@
+#include "dipole_store.h"
+#include "dipole.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+// How long the pinned dipoles must hold still before the pinned field grid is rebuilt
+static constexpr std::chrono::milliseconds STATIC_FIELD_SETTLE(250);
+
+DipoleStore::DipoleStore(float pixelsPerMeter)
+    : BaseMagnet(pixelsPerMeter)
+{
+}
+
+DipoleHandle DipoleStore::add(const glm::vec3& position, const glm::quat& rotation, float moment, uint8_t flags, uint32_t body) {
+    uint32_t slot;
+    if (!mFreeSlots.empty()) {
+        slot = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    else {
+        slot = static_cast<uint32_t>(mSlotToDense.size());
+        mSlotToDense.push_back(0);
+        mSlotGeneration.push_back(0);
+    }
+
+    mSlotToDense[slot] = static_cast<uint32_t>(mPositions.size());
+    mPositions.push_back(position);
+    mRotations.push_back(glm::normalize(rotation));
+    mMoments.push_back(moment);
+    mVelocities.push_back(glm::vec3(0.0f));
+    mAngularVelocities.push_back(glm::vec3(0.0f));
+    mFlags.push_back(flags);
+    mBodies.push_back(body);
+    mDenseToSlot.push_back(slot);
+
+    markStaticChanged(mPositions.size() - 1);
+    markChanged();
+    return { slot, mSlotGeneration[slot] };
+}
+
+bool DipoleStore::remove(DipoleHandle handle) {
+    int index = indexOf(handle);
+    if (index < 0) {
+        return false;
+    }
+
+    markStaticChanged(index);
+
+    // Move the last dipole into the freed dense index, then pop
+    size_t last = mPositions.size() - 1;
+    if (static_cast<size_t>(index) != last) {
+        mPositions[index] = mPositions[last];
+        mRotations[index] = mRotations[last];
+        mMoments[index] = mMoments[last];
+        mVelocities[index] = mVelocities[last];
+        mAngularVelocities[index] = mAngularVelocities[last];
+        mFlags[index] = mFlags[last];
+        mBodies[index] = mBodies[last];
+        mDenseToSlot[index] = mDenseToSlot[last];
+        mSlotToDense[mDenseToSlot[index]] = static_cast<uint32_t>(index);
+    }
+    mPositions.pop_back();
+    mRotations.pop_back();
+    mMoments.pop_back();
+    mVelocities.pop_back();
+    mAngularVelocities.pop_back();
+    mFlags.pop_back();
+    mBodies.pop_back();
+    mDenseToSlot.pop_back();
+
+    // Invalidate outstanding handles to this slot and recycle it
+    ++mSlotGeneration[handle.slot];
+    mFreeSlots.push_back(handle.slot);
+
+    markChanged();
+    return true;
+}
+
+void DipoleStore::clear() {
+    for (uint32_t slot : mDenseToSlot) {
+        ++mSlotGeneration[slot];
+        mFreeSlots.push_back(slot);
+    }
+    mPositions.clear();
+    mRotations.clear();
+    mMoments.clear();
+    mVelocities.clear();
+    mAngularVelocities.clear();
+    mFlags.clear();
+    mBodies.clear();
+    mDenseToSlot.clear();
+    ++mStaticVersion;
+    markChanged();
+}
+
+void DipoleStore::assign(size_t count, const glm::vec3* positions, const glm::quat* rotations, const float* moments, const uint8_t* flags,
+    const uint32_t* bodies) {
+    clear();
+    mPositions.assign(positions, positions + count);
+    mRotations.assign(rotations, rotations + count);
+    mMoments.assign(moments, moments + count);
+    if (flags) {
+        mFlags.assign(flags, flags + count);
+    }
+    else {
+        mFlags.assign(count, DipoleFlags_None);
+    }
+    if (bodies) {
+        mBodies.assign(bodies, bodies + count);
+    }
+    else {
+        mBodies.assign(count, NO_BODY);
+    }
+    mVelocities.assign(count, glm::vec3(0.0f));
+    mAngularVelocities.assign(count, glm::vec3(0.0f));
+
+    // Reuse the slots freed by clear first, so outstanding handles stay rejected
+    mDenseToSlot.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t slot;
+        if (!mFreeSlots.empty()) {
+            slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+        }
+        else {
+            slot = static_cast<uint32_t>(mSlotToDense.size());
+            mSlotToDense.push_back(0);
+            mSlotGeneration.push_back(0);
+        }
+        mSlotToDense[slot] = static_cast<uint32_t>(i);
+        mDenseToSlot[i] = slot;
+    }
+    markChanged();
+}
+
+void DipoleStore::assignRange(size_t first, size_t count, const glm::vec3* positions, const glm::quat* rotations, const float* moments, const uint8_t* flags,
+    const uint32_t* bodies) {
+    std::copy(positions, positions + count, mPositions.begin() + first);
+    std::copy(rotations, rotations + count, mRotations.begin() + first);
+    std::copy(moments, moments + count, mMoments.begin() + first);
+    std::copy(flags, flags + count, mFlags.begin() + first);
+    std::copy(bodies, bodies + count, mBodies.begin() + first);
+    ++mStaticVersion;
+    markChanged();
+}
+
+bool DipoleStore::isValid(DipoleHandle handle) const {
+    // Removal bumps the slot generation, so only handles to live dipoles match
+    return handle.slot < mSlotGeneration.size() && mSlotGeneration[handle.slot] == handle.generation;
+}
+
+int DipoleStore::indexOf(DipoleHandle handle) const {
+    return isValid(handle) ? static_cast<int>(mSlotToDense[handle.slot]) : -1;
+}
+
+void DipoleStore::setPosition(size_t index, const glm::vec3& position) {
+    mPositions[index] = position;
+    markStaticChanged(index);
+    markChanged();
+}
+
+void DipoleStore::setRotation(size_t index, const glm::quat& rotation) {
+    mRotations[index] = glm::normalize(rotation);
+    markStaticChanged(index);
+    markChanged();
+}
+
+void DipoleStore::setPose(size_t index, const glm::vec3& position, const glm::quat& rotation) {
+    mPositions[index] = position;
+    mRotations[index] = glm::normalize(rotation);
+    markStaticChanged(index);
+    markChanged();
+}
+
+void DipoleStore::setMoment(size_t index, float moment) {
+    mMoments[index] = moment;
+    markStaticChanged(index);
+    markChanged();
+}
+
+void DipoleStore::setFlags(size_t index, uint8_t flags) {
+    if (flags == mFlags[index]) {
+        return;
+    }
+    if ((mFlags[index] ^ flags) & DipoleFlags_Pinned) {
+        ++mStaticVersion;
+    }
+    mFlags[index] = flags;
+    markChanged();
+}
+
+void DipoleStore::setBody(size_t index, uint32_t body) {
+    mBodies[index] = body;
+    markChanged();
+}
+
+uint32_t DipoleStore::createBodyId() const {
+    uint32_t last = NO_BODY;
+    for (uint32_t body : mBodies) {
+        last = std::max(last, body);
+    }
+    return last + 1;
+}
+
+void DipoleStore::resetVelocities() {
+    std::fill(mVelocities.begin(), mVelocities.end(), glm::vec3(0.0f));
+    std::fill(mAngularVelocities.begin(), mAngularVelocities.end(), glm::vec3(0.0f));
+}
+
+void DipoleStore::markChanged() {
+    ++mVersion;
+    markTraceStartPointsDirty();
+}
+
+void DipoleStore::markStaticChanged(size_t index) {
+    if (mFlags[index] & DipoleFlags_Pinned) {
+        ++mStaticVersion;
+    }
+}
+
+void DipoleStore::setStaticFieldGrid(bool enabled, const glm::vec3& bounds_min, const glm::vec3& bounds_max, float cell_size) {
+    if (enabled != mStaticFieldEnabled || bounds_min != mStaticFieldMin || bounds_max != mStaticFieldMax || cell_size != mStaticFieldCellSize) {
+        mStaticFieldEnabled = enabled;
+        mStaticFieldMin = bounds_min;
+        mStaticFieldMax = bounds_max;
+        mStaticFieldCellSize = cell_size;
+        ++mStaticVersion;
+    }
+}
+
+void DipoleStore::prepareFieldQueries() const {
+    // Take up a finished build unless a pinned dipole changed while it ran
+    if (mStaticBuild.valid() && mStaticBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        StaticFieldGrid grid = mStaticBuild.get();
+        if (mStaticBuildVersion == mStaticVersion) {
+            mStaticField = std::move(grid);
+            mStaticFieldVersion = mStaticBuildVersion;
+        }
+    }
+    if (!mStaticFieldEnabled || mStaticFieldVersion == mStaticVersion || mStaticBuild.valid()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (mStaticSeenVersion != mStaticVersion) {
+        mStaticSeenVersion = mStaticVersion;
+        mStaticSeenTime = now;
+    }
+    if (now - mStaticSeenTime < STATIC_FIELD_SETTLE) {
+        return;
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> directions;
+    std::vector<float> moments;
+    for (size_t i = 0; i < mPositions.size(); ++i) {
+        if (mFlags[i] & DipoleFlags_Pinned) {
+            positions.push_back(mPositions[i]);
+            directions.push_back(getDirection(i));
+            moments.push_back(mMoments[i]);
+        }
+    }
+    // The worker owns copies of everything it reads, so the store can keep changing meanwhile
+    mStaticBuildVersion = mStaticVersion;
+    mStaticBuild = std::async(std::launch::async, [positions = std::move(positions), directions = std::move(directions),
+        moments = std::move(moments), pixels_per_meter = mPixelsPerMeter, bounds_min = mStaticFieldMin,
+        bounds_max = mStaticFieldMax, cell_size = mStaticFieldCellSize]() {
+        StaticFieldGrid grid;
+        grid.build(positions, directions, moments, pixels_per_meter, bounds_min, bounds_max, cell_size);
+        return grid;
+    });
+}
+
+const StaticFieldGrid* DipoleStore::getStaticField() const {
+    bool current = mStaticFieldEnabled && mStaticFieldVersion == mStaticVersion && !mStaticField.empty();
+    return current ? &mStaticField : nullptr;
+}
+
+glm::vec3 DipoleStore::calculateDipoleField(size_t index, const glm::vec3& pos) const {
+    return MagneticDipole::calculateDipoleField(pos, mPositions[index], getDirection(index), mMoments[index], mPixelsPerMeter);
+}
+
+glm::vec3 DipoleStore::calculateMagneticField(const glm::vec3& pos) const {
+    if (const StaticFieldGrid* static_field = getStaticField()) {
+        // Pinned dipoles come from the cache, only the others are summed
+        glm::vec3 totalField = static_field->sample(pos);
+        for (size_t i = 0; i < mPositions.size(); ++i) {
+            if (!(mFlags[i] & DipoleFlags_Pinned)) {
+                totalField += calculateDipoleField(i, pos);
+            }
+        }
+        return totalField;
+    }
+    glm::vec3 totalField(0.0f);
+    for (size_t i = 0; i < mPositions.size(); ++i) {
+        totalField += calculateDipoleField(i, pos);
+    }
+    return totalField;
+}
+
+void DipoleStore::updateTraceStartPoints() const {
+    constexpr int NUM_POINTS = 6; // Number of points in circle, matches MagneticDipole
+    constexpr float radius = 0.04f; // Small radius in meters
+
+    static const std::array<glm::vec2, NUM_POINTS> circle = [] {
+        std::array<glm::vec2, NUM_POINTS> points;
+        for (int i = 0; i < NUM_POINTS; ++i) {
+            float angle = i * 2.0f * glm::pi<float>() / NUM_POINTS;
+            points[i] = glm::vec2(std::cos(angle), std::sin(angle));
+        }
+        return points;
+    }();
+
+    mTraceStartPoints.resize(mPositions.size() * NUM_POINTS);
+    for (size_t i = 0; i < mPositions.size(); ++i) {
+        glm::vec3 up = mRotations[i] * glm::vec3(0.0f, radius, 0.0f);
+        glm::vec3 right = mRotations[i] * glm::vec3(radius, 0.0f, 0.0f);
+        for (int k = 0; k < NUM_POINTS; ++k) {
+            TraceStartPoint& point = mTraceStartPoints[i * NUM_POINTS + k];
+            point.position = mPositions[i] + circle[k].x * right + circle[k].y * up;
+            point.direction = TraceDirection::Both;
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "base_magnet.h"
+#include "static_field_grid.h"
+
+// Stable reference to a dipole in a DipoleStore. Stays valid across removals of other
+// dipoles and is rejected once the dipole it refers to has been removed.
+struct DipoleHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const DipoleHandle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const DipoleHandle& other) const { return !(*this == other); }
+};
+
+// Per-dipole flag bits, stored in the flags column
+enum DipoleFlags : uint8_t {
+    DipoleFlags_None = 0,
+    DipoleFlags_Pinned = 1 << 0, // Excluded from simulation integration, a static field source
+};
+
+// Rigid body id of a dipole that moves on its own
+constexpr uint32_t NO_BODY = 0;
+
+// Scene store for magnetic dipoles. State is kept in dense, structure-of-arrays columns
+// so hot loops iterate contiguous memory, and a slot map translates handles to dense
+// indices so removal is O(1) (swap with the last dipole and pop).
+class DipoleStore : public BaseMagnet {
+public:
+    explicit DipoleStore(float pixelsPerMeter = 100.0f);
+
+    // Add a dipole and return its handle. Dipoles sharing a body id other than NO_BODY are
+    // simulated as one rigid body.
+    DipoleHandle add(const glm::vec3& position, const glm::quat& rotation, float moment, uint8_t flags = DipoleFlags_None, uint32_t body = NO_BODY);
+    // Remove a dipole, returns false if the handle is stale
+    bool remove(DipoleHandle handle);
+    void clear();
+    // Replace every dipole with count dipoles copied column by column, for bulk loads.
+    // Rotations are taken as already normalized, flags and bodies may be null for none.
+    void assign(size_t count, const glm::vec3* positions, const glm::quat* rotations, const float* moments, const uint8_t* flags,
+        const uint32_t* bodies = nullptr);
+    // Overwrite the state of count dipoles from dense index first, handles are unaffected.
+    // Rotations are taken as already normalized.
+    void assignRange(size_t first, size_t count, const glm::vec3* positions, const glm::quat* rotations, const float* moments, const uint8_t* flags,
+        const uint32_t* bodies);
+
+    // Handle <-> dense index translation
+    bool isValid(DipoleHandle handle) const;
+    int indexOf(DipoleHandle handle) const; // -1 if the handle is stale
+    DipoleHandle handleAt(size_t index) const { return { mDenseToSlot[index], mSlotGeneration[mDenseToSlot[index]] }; }
+
+    size_t size() const { return mPositions.size(); }
+    bool empty() const { return mPositions.empty(); }
+
+    // Bumped on every change to position, rotation, moment, flags, body or membership
+    uint64_t getVersion() const { return mVersion; }
+
+    // Column access by dense index
+    const std::vector<glm::vec3>& getPositions() const { return mPositions; }
+    const std::vector<glm::quat>& getRotations() const { return mRotations; }
+    const std::vector<float>& getMoments() const { return mMoments; }
+    const std::vector<uint8_t>& getFlags() const { return mFlags; }
+    const std::vector<uint32_t>& getBodies() const { return mBodies; }
+    std::vector<glm::vec3>& getVelocities() { return mVelocities; }
+    std::vector<glm::vec3>& getAngularVelocities() { return mAngularVelocities; }
+    const std::vector<glm::vec3>& getVelocities() const { return mVelocities; }
+    const std::vector<glm::vec3>& getAngularVelocities() const { return mAngularVelocities; }
+
+    glm::vec3 getPosition(size_t index) const { return mPositions[index]; }
+    glm::quat getRotation(size_t index) const { return mRotations[index]; }
+    float getMoment(size_t index) const { return mMoments[index]; }
+    uint8_t getFlags(size_t index) const { return mFlags[index]; }
+    uint32_t getBody(size_t index) const { return mBodies[index]; }
+    // Dipole points along the rotated forward axis (-Z), matching Transform::getForward
+    glm::vec3 getDirection(size_t index) const { return mRotations[index] * glm::vec3(0.0f, 0.0f, -1.0f); }
+
+    void setPosition(size_t index, const glm::vec3& position);
+    void setRotation(size_t index, const glm::quat& rotation);
+    void setPose(size_t index, const glm::vec3& position, const glm::quat& rotation);
+    void setMoment(size_t index, float moment);
+    void setFlags(size_t index, uint8_t flags);
+    void setBody(size_t index, uint32_t body);
+    // Body id not used by any dipole yet
+    uint32_t createBodyId() const;
+    void resetVelocities();
+
+    // Field of a single dipole at a given position
+    glm::vec3 calculateDipoleField(size_t index, const glm::vec3& pos) const;
+    // Total field of all dipoles at a given position
+    glm::vec3 calculateMagneticField(const glm::vec3& pos) const override;
+
+    // Cache the combined field of the pinned dipoles on a grid over the bounds, so field
+    // queries only sum the unpinned dipoles exactly. Disabled by default.
+    void setStaticFieldGrid(bool enabled, const glm::vec3& bounds_min, const glm::vec3& bounds_max, float cell_size);
+    // Rebuild the pinned field grid on a worker thread once the pinned dipoles have held
+    // still for a moment, and take it up when the build finishes
+    void prepareFieldQueries() const override;
+    // Pinned field grid if it is enabled and current, otherwise null. Queries fall back to
+    // summing the pinned dipoles directly while a rebuild is pending.
+    const StaticFieldGrid* getStaticField() const;
+
+protected:
+    // Rebuild trace start points in a circle around every dipole
+    void updateTraceStartPoints() const override;
+
+private:
+    void markChanged();
+    // Bump the static version if the dipole at index is pinned
+    void markStaticChanged(size_t index);
+
+    // Dense columns, indexed by dense index
+    std::vector<glm::vec3> mPositions;
+    std::vector<glm::quat> mRotations;
+    std::vector<float> mMoments;
+    std::vector<glm::vec3> mVelocities;
+    std::vector<glm::vec3> mAngularVelocities;
+    std::vector<uint8_t> mFlags;
+    std::vector<uint32_t> mBodies;
+    std::vector<uint32_t> mDenseToSlot;
+
+    // Slot map, indexed by handle slot
+    std::vector<uint32_t> mSlotToDense;
+    std::vector<uint32_t> mSlotGeneration;
+    std::vector<uint32_t> mFreeSlots;
+
+    uint64_t mVersion = 0;
+
+    // Pinned field grid, rebuilt in the background once mStaticVersion moves past the built version
+    bool mStaticFieldEnabled = false;
+    glm::vec3 mStaticFieldMin{ 0.0f };
+    glm::vec3 mStaticFieldMax{ 0.0f };
+    float mStaticFieldCellSize = 0.25f;
+    uint64_t mStaticVersion = 0; // Bumped on every change to a pinned dipole or the pinned set
+    mutable uint64_t mStaticFieldVersion = UINT64_MAX;
+    mutable StaticFieldGrid mStaticField;
+    // Last static version seen and when, so dragging a pinned dipole does not start a build every frame
+    mutable uint64_t mStaticSeenVersion = UINT64_MAX;
+    mutable std::chrono::steady_clock::time_point mStaticSeenTime;
+    // Build in flight and the static version it was started from
+    mutable std::future<StaticFieldGrid> mStaticBuild;
+    mutable uint64_t mStaticBuildVersion = UINT64_MAX;
+};
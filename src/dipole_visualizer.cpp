@@ -1,12 +1,15 @@
 #include "dipole_visualizer.h"
-
-std::set<unsigned int> DipoleVisualizer::active_VAOs = {};
-
-DipoleVisualizer::DipoleVisualizer(float radius, float arrow_length, MagneticDipole* parent,
-    const glm::vec4& northFaceColor, const glm::vec4& southFaceColor, const glm::vec4& edgeColor)
-    : Transform(glm::vec3(0.0f), glm::vec3(0.0f), parent),
-    m_radius(radius), m_arrow_length(arrow_length),
-    m_northFaceColor(northFaceColor), m_southFaceColor(southFaceColor), m_edgeColor(edgeColor) {
+#include "gl_debug.h"
+#include <algorithm>
+#include <cstddef>
+#include <glm/gtc/constants.hpp>
+
+DipoleVisualizer::DipoleVisualizer(float radius, float arrow_length,
+    const glm::vec4& northFaceColor, const glm::vec4& southFaceColor, const glm::vec4& edgeColor,
+    const glm::vec4& selectedEdgeColor)
+    : m_radius(radius), m_arrow_length(arrow_length),
+    m_northFaceColor(northFaceColor), m_southFaceColor(southFaceColor), m_edgeColor(edgeColor),
+    m_selectedEdgeColor(selectedEdgeColor) {
 }
 
 void DipoleVisualizer::printVAO() {
@@ -14,26 +17,32 @@ void DipoleVisualizer::printVAO() {
 }
 
 DipoleVisualizer::~DipoleVisualizer() {
-    std::cout << "Removing dipole with sphere and arrow VAO: " << sphere_VAO << ", " << arrow_VAO << std::endl;
+    release();
+}
+
+void DipoleVisualizer::release() {
+    if (!sphere_VAO && !arrow_VAO) {
+        return;
+    }
+    std::cout << "Removing dipole mesh with sphere and arrow VAO: " << sphere_VAO << ", " << arrow_VAO << std::endl;
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    if (sphere_VAO) {
-        glDeleteVertexArrays(1, &sphere_VAO);
-        active_VAOs.erase(sphere_VAO);
-    }
+    if (sphere_VAO) glDeleteVertexArrays(1, &sphere_VAO);
     if (sphere_VBO) glDeleteBuffers(1, &sphere_VBO);
+    if (sphere_color_VBO) glDeleteBuffers(1, &sphere_color_VBO);
     if (sphere_EBO) glDeleteBuffers(1, &sphere_EBO);
-    if (arrow_VAO) {
-        glDeleteVertexArrays(1, &arrow_VAO);
-        active_VAOs.erase(arrow_VAO);
-    }
+    if (arrow_VAO) glDeleteVertexArrays(1, &arrow_VAO);
     if (arrow_VBO) glDeleteBuffers(1, &arrow_VBO);
     if (arrow_EBO) glDeleteBuffers(1, &arrow_EBO);
-    checkGLError("DipoleVisualizer destructor");
+    sphere_VAO = sphere_VBO = sphere_color_VBO = sphere_EBO = 0;
+    arrow_VAO = arrow_VBO = arrow_EBO = 0;
+    instance_buffer = nullptr;
+    GL_CHECK("DipoleVisualizer release");
 }
 
-void DipoleVisualizer::initialize() {
+void DipoleVisualizer::initialize(GpuResourceManager& resources) {
+    instance_buffer = &resources.createBuffer("Dipole instance VBO");
     generateSphereGeometry();
     generateArrowGeometry();
     setupBuffers();
@@ -60,10 +69,8 @@ void DipoleVisualizer::generateSphereGeometry(int sectors, int stacks) {
             sphere_vertices.push_back(y);
             sphere_vertices.push_back(z);
 
-            // Assign colors: red for z > 0 (north), blue for z <= 0 (south)
-            glm::vec4 color = (z > 0.0f) ?
-                glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) : // Red (north)
-                glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);  // Blue (south)
+            // Assign colors: north face for z > 0, south face for z <= 0
+            glm::vec4 color = (z > 0.0f) ? m_northFaceColor : m_southFaceColor;
             sphere_colors.push_back(color.r);
             sphere_colors.push_back(color.g);
             sphere_colors.push_back(color.b);
@@ -106,9 +113,12 @@ void DipoleVisualizer::setupBuffers() {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+    // Per-instance buffer, shared by both meshes and filled by updateInstances. Storage
+    // must exist before the instance attributes can point at it.
+    instance_buffer->reserve(64 * sizeof(DipoleInstanceGL));
+
     // Sphere setup
     glGenVertexArrays(1, &sphere_VAO);
-    active_VAOs.insert(sphere_VAO);
     glGenBuffers(1, &sphere_VBO);
     glGenBuffers(1, &sphere_EBO);
     glBindVertexArray(sphere_VAO);
@@ -120,7 +130,6 @@ void DipoleVisualizer::setupBuffers() {
     glEnableVertexAttribArray(0);
 
     // Vertex colors
-    unsigned int sphere_color_VBO;
     glGenBuffers(1, &sphere_color_VBO);
     glBindBuffer(GL_ARRAY_BUFFER, sphere_color_VBO);
     glBufferData(GL_ARRAY_BUFFER, sphere_colors.size() * sizeof(float), sphere_colors.data(), GL_STATIC_DRAW);
@@ -131,13 +140,13 @@ void DipoleVisualizer::setupBuffers() {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphere_indices.size() * sizeof(unsigned int), sphere_indices.data(), GL_STATIC_DRAW);
 
+    setupInstanceAttributes();
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
     // Arrow setup
     glGenVertexArrays(1, &arrow_VAO);
-    active_VAOs.insert(arrow_VAO);
     glGenBuffers(1, &arrow_VBO);
     glGenBuffers(1, &arrow_EBO);
     glBindVertexArray(arrow_VAO);
@@ -147,82 +156,93 @@ void DipoleVisualizer::setupBuffers() {
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, arrow_indices.size() * sizeof(unsigned int), arrow_indices.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
+    setupInstanceAttributes();
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    std::cout << "New dipole with sphere and arrow VAO: " << sphere_VAO << ", " << arrow_VAO << std::endl;
+    labelGLObject(GL_VERTEX_ARRAY, sphere_VAO, "Dipole sphere VAO");
+    labelGLObject(GL_BUFFER, sphere_VBO, "Dipole sphere VBO");
+    labelGLObject(GL_BUFFER, sphere_color_VBO, "Dipole sphere color VBO");
+    labelGLObject(GL_BUFFER, sphere_EBO, "Dipole sphere EBO");
+    labelGLObject(GL_VERTEX_ARRAY, arrow_VAO, "Dipole arrow VAO");
+    labelGLObject(GL_BUFFER, arrow_VBO, "Dipole arrow VBO");
+    labelGLObject(GL_BUFFER, arrow_EBO, "Dipole arrow EBO");
 
-    checkGLError("setupBuffers");
+    std::cout << "Dipole mesh with sphere and arrow VAO: " << sphere_VAO << ", " << arrow_VAO << std::endl;
+
+    GL_CHECK("DipoleVisualizer setupBuffers");
 }
 
-bool DipoleVisualizer::isVAOValid(unsigned int vao) const {
-    if (vao == 0) {
-        std::cerr << "VAO is 0 (not initialized)" << std::endl;
-        return false;
-    }
-    if (active_VAOs.find(vao) == active_VAOs.end()) {
-        std::cerr << "VAO " << vao << " not in active_VAOs set" << std::endl;
-        return false;
-    }
-    GLint isValid;
-    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &isValid);
-    glBindVertexArray(vao);
-    bool valid = glGetError() == GL_NO_ERROR;
-    glBindVertexArray(isValid);
-    return valid;
+void DipoleVisualizer::setupInstanceAttributes() {
+    // Applies to the bound VAO, attributes advance once per instance
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer->getBuffer());
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(DipoleInstanceGL), (void*)offsetof(DipoleInstanceGL, position));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(DipoleInstanceGL), (void*)offsetof(DipoleInstanceGL, rotation));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(DipoleInstanceGL), (void*)offsetof(DipoleInstanceGL, color));
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
 }
 
-void DipoleVisualizer::render(const glm::mat4& view, const glm::mat4& projection, Shader& shader) {
-    GLenum err;
-    while ((err = glGetError()) != GL_NO_ERROR) {
-        std::cerr << "OpenGL error in render: " << err << std::endl;
+void DipoleVisualizer::updateInstances(const DipoleStore& store, int selected_index) {
+    if (store.getVersion() == instance_version && selected_index == instance_selected_index) {
+        return;
     }
-    // Verify shader program
-    GLint currentProgram;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram);
-    shader.use_shader();
-    glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram);
+    instance_version = store.getVersion();
+    instance_selected_index = selected_index;
+    uploadInstances(store.getPositions(), store.getRotations(), selected_index);
+}
 
-    // Set uniforms
-    glm::mat4 model = getWorldTransformMatrix();
-    shader.set_mat4("view", view);
-    shader.set_mat4("projection", projection);
-    shader.set_mat4("model", model);
+void DipoleVisualizer::updateInstances(const std::vector<glm::vec3>& positions, const std::vector<glm::quat>& rotations, int selected_index) {
+    // Poses not taken from a store have no version, so the next store update must rebuild
+    instance_version = UINT64_MAX;
+    instance_selected_index = selected_index;
+    uploadInstances(positions, rotations, selected_index);
+}
 
-    // Render sphere with vertex colors
-    if (isVAOValid(sphere_VAO)) {
-        glBindVertexArray(sphere_VAO);
-        checkGLError("After binding sphere_VAO");
-        if (sphere_indices.size() > 0) {
-            glDrawElements(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, 0);
-            checkGLError("After drawing sphere");
-        }
-        else {
-            std::cerr << "sphere_indices empty, skipping draw" << std::endl;
-        }
-        glBindVertexArray(0);
+void DipoleVisualizer::uploadInstances(const std::vector<glm::vec3>& positions, const std::vector<glm::quat>& rotations, int selected_index) {
+    instances.resize(positions.size());
+    for (size_t i = 0; i < instances.size(); ++i) {
+        instances[i].position = positions[i];
+        instances[i].rotation = glm::vec4(rotations[i].x, rotations[i].y, rotations[i].z, rotations[i].w);
+        instances[i].color = (static_cast<int>(i) == selected_index) ? m_selectedEdgeColor : m_edgeColor;
     }
 
-    // Render arrow with uniform color
-    shader.set_vec4("color", m_edgeColor);
-    if (isVAOValid(arrow_VAO)) {
+    // The instance data depends on the selection as well as the store, so tag uploads with a local counter
+    GpuBuffer::UploadResult result = instance_buffer->upload(++instance_upload_version, instances.data(), instances.size() * sizeof(DipoleInstanceGL));
+    if (result == GpuBuffer::UploadResult::Reallocated) {
+        glBindVertexArray(sphere_VAO);
+        setupInstanceAttributes();
         glBindVertexArray(arrow_VAO);
-        checkGLError("After binding arrow_VAO");
-        if (arrow_indices.size() > 0) {
-            glDrawElements(GL_LINES, arrow_indices.size(), GL_UNSIGNED_INT, 0);
-            checkGLError("After drawing arrow");
-        }
-        else {
-            std::cerr << "arrow_indices empty, skipping draw" << std::endl;
-        }
+        setupInstanceAttributes();
         glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 }
 
-void DipoleVisualizer::checkGLError(const std::string& context) {
-    GLenum err;
-    while ((err = glGetError()) != GL_NO_ERROR) {
-        std::cerr << "OpenGL error in " << context << ": " << err << std::endl;
+void DipoleVisualizer::render(Shader& shader) {
+    if (instances.empty()) {
+        return;
     }
+    GLDebugScope scope("Dipole visualizer");
+    shader.use_shader();
+
+    // Set uniforms
+
+    // Render spheres with vertex colors
+    shader.set_int("use_vertex_color", 1);
+    glBindVertexArray(sphere_VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, sphere_indices.size(), GL_UNSIGNED_INT, 0, instances.size());
+    GL_CHECK("DipoleVisualizer sphere draw");
+
+    // Render arrows with per-instance color
+    shader.set_int("use_vertex_color", 0);
+    glBindVertexArray(arrow_VAO);
+    glDrawElementsInstanced(GL_LINES, arrow_indices.size(), GL_UNSIGNED_INT, 0, instances.size());
+    GL_CHECK("DipoleVisualizer arrow draw");
+    glBindVertexArray(0);
 }
\ No newline at end of file
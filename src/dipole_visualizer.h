@@ -1,26 +1,47 @@
 #pragma once
 
 #include <vector>
-#include <set>
-#include <string>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 
-#include "transform.h"
 #include "shader.h"
-#include "dipole.h"
+#include "dipole_store.h"
+#include "gpu_resources.h"
 
-class DipoleVisualizer : public Transform {
+// Per-instance vertex data for one dipole, matches the instance attributes in dipole_vert
+struct DipoleInstanceGL {
+    glm::vec3 position; // Instance world position
+    glm::vec4 rotation; // Instance rotation quaternion as (x, y, z, w)
+    glm::vec4 color;    // Arrow color
+};
+
+// Sphere and arrow mesh shared by every dipole. All dipoles in the scene store are drawn
+// with one instanced call per mesh, fed from a per-instance buffer of positions,
+// rotations and arrow colors.
+class DipoleVisualizer {
 public:
-    DipoleVisualizer(float radius = 0.1f, float arrow_length = 0.2f, MagneticDipole* parent = nullptr,
+    DipoleVisualizer(float radius = 0.1f, float arrow_length = 0.2f,
         const glm::vec4& northFaceColor = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),
         const glm::vec4& southFaceColor = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
-        const glm::vec4& edgeColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+        const glm::vec4& edgeColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
+        const glm::vec4& selectedEdgeColor = glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
     ~DipoleVisualizer();
 
-    void initialize();
-    void render(const glm::mat4& view, const glm::mat4& projection, Shader& shader);
+    // Owns GL objects, so it is neither copyable nor movable
+    DipoleVisualizer(const DipoleVisualizer&) = delete;
+    DipoleVisualizer& operator=(const DipoleVisualizer&) = delete;
+
+    void initialize(GpuResourceManager& resources);
+    // Delete the GL objects while the context is still current, the destructor then does nothing
+    void release();
+    // Refresh the instance buffer from the store, skipped if nothing changed since the last call
+    void updateInstances(const DipoleStore& store, int selected_index = -1);
+    // Refresh the instance buffer from poses blended between simulation ticks, always rebuilt
+    void updateInstances(const std::vector<glm::vec3>& positions, const std::vector<glm::quat>& rotations, int selected_index = -1);
+    // Camera matrices come from the shared CameraBlock uniform block
+    void render(Shader& shader);
     void printVAO();
 
 private:
@@ -29,19 +50,25 @@ private:
     glm::vec4 m_northFaceColor;
     glm::vec4 m_southFaceColor;
     glm::vec4 m_edgeColor;
-    unsigned int sphere_VAO{ 0 }, sphere_VBO{ 0 }, sphere_EBO{ 0 };
+    glm::vec4 m_selectedEdgeColor;
+    unsigned int sphere_VAO{ 0 }, sphere_VBO{ 0 }, sphere_color_VBO{ 0 }, sphere_EBO{ 0 };
     unsigned int arrow_VAO{ 0 }, arrow_VBO{ 0 }, arrow_EBO{ 0 };
+    GpuBuffer* instance_buffer{ nullptr }; // Owned by the resource manager
     std::vector<float> sphere_vertices;
     std::vector<float> sphere_colors; // Added for per-vertex colors
     std::vector<unsigned int> sphere_indices;
     std::vector<float> arrow_vertices;
     std::vector<unsigned int> arrow_indices;
 
-    static std::set<unsigned int> active_VAOs; // Track active VAO IDs
+    // Instance data and what it was built from
+    std::vector<DipoleInstanceGL> instances;
+    uint64_t instance_upload_version{ 0 };
+    uint64_t instance_version{ UINT64_MAX };
+    int instance_selected_index{ -1 };
 
     void generateSphereGeometry(int sectors = 16, int stacks = 16);
     void generateArrowGeometry();
     void setupBuffers();
-    bool isVAOValid(unsigned int vao) const;
-    void checkGLError(const std::string& context);
-};
\ No newline at end of file
+    void setupInstanceAttributes();
+    void uploadInstances(const std::vector<glm::vec3>& positions, const std::vector<glm::quat>& rotations, int selected_index);
+};
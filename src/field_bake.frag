@@ -0,0 +1,83 @@
+in vec2 plane_uv;
+out float field_magnitude;
+
+uniform float pixels_per_meter;
+uniform vec3 plane_origin; // Corner of the field plane at plane coordinates (0, 0)
+uniform vec3 plane_axis_u; // Edge of the field plane along u
+uniform vec3 plane_axis_v; // Edge of the field plane along v
+
+// Magnetic dipole struct
+struct MagneticDipole {
+    vec3 position;
+    vec3 direction;
+    float moment;
+};
+
+// Dipole sources from DipoleSourceBuffer, two vec4 per dipole: (position, moment) and (direction, 0).
+// The #version line and DIPOLE_SOURCES_SSBO define are prepended by DipoleSourceBuffer::shaderHeader.
+#ifdef DIPOLE_SOURCES_SSBO
+layout (std430, binding = 0) readonly buffer DipoleSources {
+    vec4 dipole_data[];
+};
+
+MagneticDipole fetchDipole(int i) {
+    vec4 position_moment = dipole_data[2 * i];
+    return MagneticDipole(position_moment.xyz, dipole_data[2 * i + 1].xyz, position_moment.w);
+}
+#else
+uniform samplerBuffer dipole_data;
+
+MagneticDipole fetchDipole(int i) {
+    vec4 position_moment = texelFetch(dipole_data, 2 * i);
+    return MagneticDipole(position_moment.xyz, texelFetch(dipole_data, 2 * i + 1).xyz, position_moment.w);
+}
+#endif
+uniform int num_dipoles;
+
+vec3 calculateMagneticField(vec3 pos, MagneticDipole dipole) {
+    vec3 A = pos - dipole.position;
+    float r = length(A);
+    if (r < 0.0001) return vec3(0.0); // Avoid divide-by-zero
+    vec3 A_rad = A / r;
+
+    // Find a perpendicular axis for tangential plane
+    vec3 perpAxis;
+    if (abs(A_rad.x) < abs(A_rad.y) && abs(A_rad.x) < abs(A_rad.z)) {
+        perpAxis = vec3(1.0, 0.0, 0.0);
+    } else if (abs(A_rad.y) < abs(A_rad.z)) {
+        perpAxis = vec3(0.0, 1.0, 0.0);
+    } else {
+        perpAxis = vec3(0.0, 0.0, 1.0);
+    }
+
+    vec3 A_tan1 = normalize(cross(A_rad, perpAxis));
+    vec3 A_tan2 = cross(A_rad, A_tan1);
+
+    float cos_theta = dot(A_rad, dipole.direction);
+    vec3 dirTangential = dipole.direction - cos_theta * A_rad;
+    float sin_theta_mag = length(dirTangential);
+
+    float r_meters = r / pixels_per_meter;
+    float r_cube = r_meters * r_meters * r_meters;
+
+    float B_r = (2.0 * dipole.moment * cos_theta) / r_cube;
+    vec3 B_field = B_r * A_rad;
+
+    if (sin_theta_mag > 0.0001) {
+        vec3 A_tan_dir = dirTangential / sin_theta_mag;
+        float B_theta = (dipole.moment * sin_theta_mag) / r_cube;
+        B_field += B_theta * A_tan_dir;
+    }
+
+    return B_field;
+}
+
+void main() {
+    // Calculate total magnetic field at this texel of the plane
+    vec3 world_pos = plane_origin + plane_uv.x * plane_axis_u + plane_uv.y * plane_axis_v;
+    vec3 field_str = vec3(0.0);
+    for (int i = 0; i < num_dipoles; i++) {
+        field_str += calculateMagneticField(world_pos, fetchDipole(i));
+    }
+    field_magnitude = length(field_str);
+}
\ No newline at end of file
@@ -1,5 +1,5 @@
 #version 330 core
-in vec3 field;
+in float field_strength;
 out vec4 frag_color;
 
 uniform int use_color; // 0 for white, 1 for colored
@@ -48,8 +48,7 @@ void main()
 {
     if (use_color == 1) {
         // Existing color mapping (blue for weak, red for strong)
-        float field_str_len = length(field);
-        float normalized_field = min(field_str_len * 0.000001 * sensitivity_scaled, 1.0);
+        float normalized_field = min(field_strength * 0.000001 * sensitivity_scaled, 1.0);
         vec3 col = hsl2rgb((1.0 - normalized_field) * (300.0 / 360.0), 1.0, min(normalized_field * 2.0, 0.5));
         frag_color = vec4(col, 1.0f);
     } else {
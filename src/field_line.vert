@@ -1,15 +1,26 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aField;
+layout (location = 0) in vec3 aPos;           // World position, or normalized over the cuboid bounds
+layout (location = 1) in float aFieldStrength; // Field magnitude, or normalized log10 magnitude
 
-out vec3 field;
+out float field_strength;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+};
+uniform vec3 position_offset; // Decodes compact positions, zero for float vertices
+uniform vec3 position_scale;  // Decodes compact positions, one for float vertices
+uniform int field_log_encoded;
+uniform vec2 field_log_range; // log10 magnitude range of the compact encoding
 
 void main()
 {
-    field = aField;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    if (field_log_encoded == 1) {
+        field_strength = aFieldStrength > 0.0 ? pow(10.0, mix(field_log_range.x, field_log_range.y, aFieldStrength)) : 0.0;
+    } else {
+        field_strength = aFieldStrength;
+    }
+    vec3 position = position_offset + aPos * position_scale;
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "field_line_exporter.h"
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+// Width of the placeholder counts in the text headers, enough for any 64-bit value
+static constexpr int COUNT_WIDTH = 20;
+
+static bool isLittleEndian() {
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+}
+
+// Append a value in big-endian order, as legacy VTK binary files require
+template <typename T>
+static void appendBigEndian(std::vector<char>& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    if (isLittleEndian()) {
+        for (size_t i = 0; i < sizeof(T) / 2; ++i) {
+            std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+        }
+    }
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static void appendNative(std::vector<char>& out, T value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static std::string paddedCount(uint64_t count) {
+    std::string text = std::to_string(count);
+    return std::string(COUNT_WIDTH - text.size(), ' ') + text;
+}
+
+FieldLineExportFormat FieldLineExporter::formatFromPath(const std::string& path) {
+    std::string extension = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+    for (char& c : extension) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    if (extension == ".vtk") return FieldLineExportFormat::VTK;
+    if (extension == ".ply") return FieldLineExportFormat::PLY;
+    return FieldLineExportFormat::Binary;
+}
+
+FieldLineExporter::FieldLineExporter(const std::string& path, FieldLineExportFormat format)
+    : m_path(path), m_format(format), m_file(path, std::ios::binary) {
+    if (!m_file) {
+        std::cerr << "Failed to open field line export file: " << path << std::endl;
+        return;
+    }
+    if (m_format == FieldLineExportFormat::VTK) {
+        m_spill = std::tmpfile();
+        if (!m_spill) {
+            std::cerr << "Failed to create temporary file for field line export" << std::endl;
+            return;
+        }
+    }
+    writeHeader();
+    m_open = static_cast<bool>(m_file);
+}
+
+FieldLineExporter::~FieldLineExporter() {
+    if (m_open && !m_finished) {
+        finish();
+    }
+    if (m_spill) {
+        std::fclose(m_spill);
+    }
+}
+
+void FieldLineExporter::writeHeader() {
+    switch (m_format) {
+    case FieldLineExportFormat::Binary: {
+        // Counts are rewritten in place by finish()
+        FieldLineFileHeader header{};
+        std::memcpy(header.magic, FIELD_LINE_FILE_MAGIC, sizeof(FIELD_LINE_FILE_MAGIC));
+        header.version = FIELD_LINE_FILE_VERSION;
+        header.header_size = sizeof(FieldLineFileHeader);
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        break;
+    }
+    case FieldLineExportFormat::VTK:
+        m_file << "# vtk DataFile Version 3.0\n"
+            << "Magnetic field lines\n"
+            << "BINARY\n"
+            << "DATASET POLYDATA\n"
+            << "POINTS ";
+        m_counts_offset = m_file.tellp();
+        m_file << paddedCount(0) << " float\n";
+        break;
+    case FieldLineExportFormat::PLY:
+        m_file << (isLittleEndian() ? "ply\nformat binary_little_endian 1.0\n" : "ply\nformat binary_big_endian 1.0\n")
+            << "comment Magnetic field lines, edges join consecutive points of each line\n"
+            << "element vertex ";
+        m_counts_offset = m_file.tellp();
+        m_file << paddedCount(0) << "\n"
+            << "property float x\nproperty float y\nproperty float z\n"
+            << "property float bx\nproperty float by\nproperty float bz\n"
+            << "element edge " << paddedCount(0) << "\n"
+            << "property uint vertex1\nproperty uint vertex2\n"
+            << "end_header\n";
+        break;
+    }
+}
+
+void FieldLineExporter::consume(const FieldLine& line) {
+    if (!m_open || line.points.empty()) {
+        return;
+    }
+
+    // Encode outside the lock so workers only serialize on the file write
+    thread_local std::vector<char> encoded;
+    thread_local std::vector<char> spilled;
+    encoded.clear();
+    spilled.clear();
+    uint32_t count = static_cast<uint32_t>(line.points.size());
+    switch (m_format) {
+    case FieldLineExportFormat::Binary:
+        appendNative(encoded, count);
+        for (const FieldLinePoint& point : line.points) {
+            appendNative(encoded, point.position);
+            appendNative(encoded, point.field);
+        }
+        break;
+    case FieldLineExportFormat::VTK:
+        for (const FieldLinePoint& point : line.points) {
+            for (int i = 0; i < 3; ++i) {
+                appendBigEndian(encoded, point.position[i]);
+                appendBigEndian(spilled, point.field[i]);
+            }
+        }
+        break;
+    case FieldLineExportFormat::PLY:
+        for (const FieldLinePoint& point : line.points) {
+            appendNative(encoded, point.position);
+            appendNative(encoded, point.field);
+        }
+        break;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file.write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+    if (!spilled.empty()) {
+        std::fwrite(spilled.data(), 1, spilled.size(), m_spill);
+    }
+    if (m_format != FieldLineExportFormat::Binary) {
+        m_line_counts.push_back(count);
+    }
+    ++m_line_count;
+    m_point_count += count;
+}
+
+void FieldLineExporter::appendSpill(std::ofstream& file) {
+    std::rewind(m_spill);
+    std::vector<char> buffer(1 << 20);
+    size_t read;
+    while ((read = std::fread(buffer.data(), 1, buffer.size(), m_spill)) > 0) {
+        file.write(buffer.data(), static_cast<std::streamsize>(read));
+    }
+}
+
+bool FieldLineExporter::finish() {
+    if (!m_open || m_finished) {
+        return m_finished;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_finished = true;
+
+    switch (m_format) {
+    case FieldLineExportFormat::Binary: {
+        FieldLineFileHeader header{};
+        std::memcpy(header.magic, FIELD_LINE_FILE_MAGIC, sizeof(FIELD_LINE_FILE_MAGIC));
+        header.version = FIELD_LINE_FILE_VERSION;
+        header.header_size = sizeof(FieldLineFileHeader);
+        header.line_count = m_line_count;
+        header.point_count = m_point_count;
+        m_file.seekp(0);
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        break;
+    }
+    case FieldLineExportFormat::VTK: {
+        // Connectivity: per line its point count followed by its point indices
+        std::vector<char> connectivity;
+        m_file << "\nLINES " << m_line_count << " " << (m_line_count + m_point_count) << "\n";
+        int32_t index = 0;
+        for (uint32_t count : m_line_counts) {
+            connectivity.clear();
+            appendBigEndian(connectivity, static_cast<int32_t>(count));
+            for (uint32_t i = 0; i < count; ++i) {
+                appendBigEndian(connectivity, index++);
+            }
+            m_file.write(connectivity.data(), static_cast<std::streamsize>(connectivity.size()));
+        }
+        m_file << "\nPOINT_DATA " << m_point_count << "\nVECTORS field float\n";
+        appendSpill(m_file);
+        m_file << "\n";
+        m_file.seekp(m_counts_offset);
+        m_file << paddedCount(m_point_count);
+        break;
+    }
+    case FieldLineExportFormat::PLY: {
+        // Edges join consecutive points within each line
+        std::vector<char> edges;
+        uint32_t index = 0;
+        for (uint32_t count : m_line_counts) {
+            edges.clear();
+            for (uint32_t i = 1; i < count; ++i) {
+                appendNative(edges, index + i - 1);
+                appendNative(edges, index + i);
+            }
+            index += count;
+            m_file.write(edges.data(), static_cast<std::streamsize>(edges.size()));
+        }
+        m_file.seekp(m_counts_offset);
+        m_file << paddedCount(m_point_count) << "\n"
+            << "property float x\nproperty float y\nproperty float z\n"
+            << "property float bx\nproperty float by\nproperty float bz\n"
+            << "element edge " << paddedCount(m_point_count - m_line_count);
+        break;
+    }
+    }
+
+    m_file.flush();
+    if (!m_file) {
+        std::cerr << "Failed to write field line export file: " << m_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool exportFieldLines(FieldLineTracer& tracer, const std::string& path) {
+    FieldLineExporter exporter(path, FieldLineExporter::formatFromPath(path));
+    if (!exporter.isOpen()) {
+        return false;
+    }
+    tracer.traceFieldLines(exporter);
+    if (!exporter.finish()) {
+        return false;
+    }
+    std::cout << "Exported " << exporter.getLineCount() << " field lines (" << exporter.getPointCount() << " points) to " << path << std::endl;
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "field_line_tracer.h"
+
+// Formats the exporter can write
+enum class FieldLineExportFormat {
+    Binary, // Own .mfl format, see FieldLineFileHeader
+    VTK,    // Legacy VTK PolyData (binary), for ParaView
+    PLY,    // Binary PLY with vertices and edges, for Blender
+};
+
+constexpr char FIELD_LINE_FILE_MAGIC[8] = { 'M', 'F', 'L', 'I', 'N', 'E', 'S', '\0' };
+constexpr uint32_t FIELD_LINE_FILE_VERSION = 1;
+
+// Header of the binary format, followed by one record per line: a uint32 point count and
+// then per point a float position (xyz) and field (xyz). Little-endian.
+struct FieldLineFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t line_count;
+    uint64_t point_count;
+};
+
+// Streams traced field lines to a file as they are completed, pass it to
+// FieldLineTracer::traceFieldLines(FieldLineSink&). Lines are encoded on the calling worker
+// thread and appended under a lock, so only the per-line point counts are kept in memory.
+// Counts in the file header are written as placeholders and filled in by finish(). VTK
+// point data is spilled to a temporary file and appended after the line connectivity.
+class FieldLineExporter : public FieldLineSink {
+public:
+    FieldLineExporter(const std::string& path, FieldLineExportFormat format);
+    ~FieldLineExporter();
+
+    FieldLineExporter(const FieldLineExporter&) = delete;
+    FieldLineExporter& operator=(const FieldLineExporter&) = delete;
+
+    bool isOpen() const { return m_open; }
+    void consume(const FieldLine& line) override;
+    // Write the trailing sections and final counts, returns false if any write failed
+    bool finish();
+
+    uint64_t getLineCount() const { return m_line_count; }
+    uint64_t getPointCount() const { return m_point_count; }
+
+    // Binary unless the extension is .vtk or .ply
+    static FieldLineExportFormat formatFromPath(const std::string& path);
+
+private:
+    void writeHeader();
+    void appendSpill(std::ofstream& file);
+
+    std::string m_path;
+    FieldLineExportFormat m_format;
+    std::ofstream m_file;
+    std::FILE* m_spill{ nullptr };        // VTK field vectors, written after the lines
+    std::mutex m_mutex;
+    std::vector<uint32_t> m_line_counts;  // Points per line, for VTK and PLY connectivity
+    uint64_t m_line_count{ 0 };
+    uint64_t m_point_count{ 0 };
+    std::streamoff m_counts_offset{ 0 };  // Where the placeholder counts start
+    bool m_open{ false };
+    bool m_finished{ false };
+};
+
+// Trace the tracer's current lines straight into a file, returns false on failure
+bool exportFieldLines(FieldLineTracer& tracer, const std::string& path);
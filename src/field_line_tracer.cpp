@@ -1,7 +1,8 @@
 #include "field_line_tracer.h"
 #include <algorithm>
+#include <atomic>
+#include <iterator>
 #include <thread>
-#include <mutex>
 #include <vector>
 
 FieldLineTracer::FieldLineTracer(const std::vector<BaseMagnet*>& magnets, float bounds_width, float bounds_height, float bounds_depth,
@@ -105,23 +106,38 @@ void FieldLineTracer::traceFieldLineFromPoint(const glm::vec3& startPos, TraceDi
     }
 }
 
-std::vector<FieldLine> FieldLineTracer::traceFieldLines() {
-    std::vector<FieldLine> fieldLines;
-    std::mutex fieldLinesMutex;
-
-    // Collect all start points
-    struct StartPointInfo {
-        glm::vec3 position;
-        TraceDirection direction;
-    };
-    std::vector<StartPointInfo> allStartPoints;
+std::vector<TraceStartPoint> FieldLineTracer::collectStartPoints() const {
+    // Reading the start points also resolves each magnet's cached world transform on this
+    // thread, and cached fields are rebuilt here, so worker threads only ever read that state
+    std::vector<TraceStartPoint> allStartPoints;
     for (const auto* magnet : mMagnets) {
+        magnet->prepareFieldQueries();
         const auto& startPoints = magnet->getTraceStartPoints();
-        for (const auto& startPoint : startPoints) {
-            allStartPoints.push_back({ startPoint.position, startPoint.direction });
-        }
+        allStartPoints.insert(allStartPoints.end(), startPoints.begin(), startPoints.end());
+    }
+    return allStartPoints;
+}
+
+void FieldLineTracer::traceFieldLine(const TraceStartPoint& startPoint, FieldLine& line) {
+    line.points.clear();
+    // Trace backward if specified
+    if (startPoint.direction == TraceDirection::Backward || startPoint.direction == TraceDirection::Both) {
+        traceFieldLineFromPoint(startPoint.position, TraceDirection::Backward, line);
     }
+    // Add the starting point
+    FieldLinePoint start;
+    start.position = startPoint.position;
+    start.field = calculateTotalField(startPoint.position);
+    line.points.push_back(start);
+    // Trace forward if specified
+    if (startPoint.direction == TraceDirection::Forward || startPoint.direction == TraceDirection::Both) {
+        traceFieldLineFromPoint(startPoint.position, TraceDirection::Forward, line);
+    }
+}
 
+std::vector<FieldLine> FieldLineTracer::traceFieldLines() {
+    std::vector<FieldLine> fieldLines;
+    std::vector<TraceStartPoint> allStartPoints = collectStartPoints();
     if (allStartPoints.empty()) {
         return fieldLines;
     }
@@ -139,27 +155,12 @@ std::vector<FieldLine> FieldLineTracer::traceFieldLines() {
         size_t endIdx = std::min(startIdx + pointsPerThread, allStartPoints.size());
 
         if (startIdx < allStartPoints.size()) {
-            threads.emplace_back([this, startIdx, endIdx, &allStartPoints, &threadResults, i, &fieldLinesMutex]() {
+            threads.emplace_back([this, startIdx, endIdx, &allStartPoints, &threadResults, i]() {
                 std::vector<FieldLine>& localLines = threadResults[i];
                 for (size_t j = startIdx; j < endIdx; ++j) {
-                    const auto& startPoint = allStartPoints[j];
                     FieldLine line;
-                    // Trace backward if specified
-                    if (startPoint.direction == TraceDirection::Backward || startPoint.direction == TraceDirection::Both) {
-                        traceFieldLineFromPoint(startPoint.position, TraceDirection::Backward, line);
-                    }
-                    // Add the starting point
-                    FieldLinePoint start;
-                    start.position = startPoint.position;
-                    start.field = calculateTotalField(startPoint.position);
-                    line.points.push_back(start);
-                    // Trace forward if specified
-                    if (startPoint.direction == TraceDirection::Forward || startPoint.direction == TraceDirection::Both) {
-                        traceFieldLineFromPoint(startPoint.position, TraceDirection::Forward, line);
-                    }
-                    if (!line.points.empty()) {
-                        localLines.push_back(std::move(line));
-                    }
+                    traceFieldLine(allStartPoints[j], line);
+                    localLines.push_back(std::move(line));
                 }
                 });
         }
@@ -171,9 +172,35 @@ std::vector<FieldLine> FieldLineTracer::traceFieldLines() {
     }
 
     // Merge results from all threads
-    for (const auto& localLines : threadResults) {
-        fieldLines.insert(fieldLines.end(), localLines.begin(), localLines.end());
+    for (auto& localLines : threadResults) {
+        fieldLines.insert(fieldLines.end(), std::make_move_iterator(localLines.begin()), std::make_move_iterator(localLines.end()));
     }
 
     return fieldLines;
-}
\ No newline at end of file
+}
+
+void FieldLineTracer::traceFieldLines(FieldLineSink& sink) {
+    std::vector<TraceStartPoint> allStartPoints = collectStartPoints();
+    if (allStartPoints.empty()) {
+        return;
+    }
+
+    // Workers claim start points one at a time, so uneven line lengths do not leave threads idle
+    unsigned int numThreads = std::min(std::thread::hardware_concurrency(), (unsigned int)allStartPoints.size());
+    numThreads = std::max(1u, numThreads);
+    std::atomic<size_t> nextStartPoint{ 0 };
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        threads.emplace_back([this, &allStartPoints, &nextStartPoint, &sink]() {
+            // Reused for every line this worker traces, only one line per thread is alive at a time
+            FieldLine line;
+            for (size_t j = nextStartPoint++; j < allStartPoints.size(); j = nextStartPoint++) {
+                traceFieldLine(allStartPoints[j], line);
+                sink.consume(line);
+            }
+            });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
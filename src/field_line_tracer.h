@@ -13,6 +13,14 @@ struct FieldLine {
     std::vector<FieldLinePoint> points;
 };
 
+// Receives traced lines as they are completed. consume is called concurrently from the
+// tracer's worker threads, in no particular order, and the line is only valid for the call.
+class FieldLineSink {
+public:
+    virtual ~FieldLineSink() = default;
+    virtual void consume(const FieldLine& line) = 0;
+};
+
 class FieldLineTracer {
 public:
     FieldLineTracer(const std::vector<BaseMagnet*>& magnets, float bounds_width, float bounds_height, float bounds_depth,
@@ -21,9 +29,14 @@ public:
 
     // Trace field lines from all start points of all magnets
     std::vector<FieldLine> traceFieldLines();
+    // Trace the same lines but hand each to sink as soon as it is complete instead of
+    // collecting them, so memory use is bounded by the thread count rather than the seeds
+    void traceFieldLines(FieldLineSink& sink);
 
     // Update cuboid bounds
     void updateBounds(float width, float height, float depth);
+    const glm::vec3& getBoundsMin() const { return cuboid_bounds_min; }
+    const glm::vec3& getBoundsMax() const { return cuboid_bounds_max; }
 
     // Set trace configuration
     void setTraceConfig(float step_size, int max_steps, float adaptive_min_step, float adaptive_max_step,
@@ -33,6 +46,11 @@ private:
     // Calculate total magnetic field at a position
     glm::vec3 calculateTotalField(const glm::vec3& pos) const;
 
+    // Start points of all magnets, read on the calling thread so workers only read magnet state
+    std::vector<TraceStartPoint> collectStartPoints() const;
+    // Trace a complete line through a start point, replacing the contents of line
+    void traceFieldLine(const TraceStartPoint& startPoint, FieldLine& line);
+
     // Trace a single field line from a start point in one direction
     void traceFieldLineFromPoint(const glm::vec3& startPos, TraceDirection direction, FieldLine& line);
 
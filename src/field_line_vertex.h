@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// Vertex layouts for traced field lines. The shaders only need the field magnitude, so
+// neither layout stores the full field vector.
+enum class FieldLineVertexFormat {
+    Float,   // 16 bytes: float position and magnitude
+    Compact, // 8 bytes: 16-bit position relative to the cuboid bounds, log-encoded 16-bit magnitude
+};
+
+struct FieldLineVertexFloat {
+    glm::vec3 position;
+    float field_strength;
+};
+
+struct FieldLineVertexCompact {
+    uint16_t position[3];   // Normalized over the cuboid bounds
+    uint16_t field_strength; // Normalized log10 magnitude over [FIELD_LINE_LOG_MIN, FIELD_LINE_LOG_MAX], 0 for no field
+};
+
+// Magnitude range covered by the compact encoding, tracing stops below 1e-6 anyway.
+// 16 decades over 16 bits keeps the relative error below 0.06%.
+constexpr float FIELD_LINE_LOG_MIN = -6.0f;
+constexpr float FIELD_LINE_LOG_MAX = 10.0f;
+
+// Shader uniforms needed to decode the vertices of one upload
+struct FieldLineVertexDecode {
+    glm::vec3 position_offset{ 0.0f };
+    glm::vec3 position_scale{ 1.0f };
+    int log_encoded{ 0 };
+};
+
+inline size_t fieldLineVertexSize(FieldLineVertexFormat format) {
+    return format == FieldLineVertexFormat::Compact ? sizeof(FieldLineVertexCompact) : sizeof(FieldLineVertexFloat);
+}
+
+inline uint16_t quantizeUnorm16(float value) {
+    return static_cast<uint16_t>(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
+
+inline FieldLineVertexCompact encodeFieldLineVertex(const glm::vec3& position, float field_strength,
+    const glm::vec3& bounds_min, const glm::vec3& inverse_extent) {
+    FieldLineVertexCompact vertex;
+    glm::vec3 normalized = (position - bounds_min) * inverse_extent;
+    vertex.position[0] = quantizeUnorm16(normalized.x);
+    vertex.position[1] = quantizeUnorm16(normalized.y);
+    vertex.position[2] = quantizeUnorm16(normalized.z);
+    if (field_strength > 0.0f) {
+        float log_strength = (std::log10(field_strength) - FIELD_LINE_LOG_MIN) / (FIELD_LINE_LOG_MAX - FIELD_LINE_LOG_MIN);
+        // Reserve 0 for zero field so it never decodes to 1e-6
+        vertex.field_strength = std::max<uint16_t>(quantizeUnorm16(log_strength), 1);
+    }
+    else {
+        vertex.field_strength = 0;
+    }
+    return vertex;
+}
@@ -1,37 +1,83 @@
 #include "field_plane.h"
+#include <algorithm>
+#include <cmath>
 
-FieldPlane::FieldPlane(float width, float height, float z_position)
-    : m_width(width), m_height(height), m_z_normalized(z_position)
+FieldPlane::FieldPlane(float width, float height, float depth, FieldPlaneOrientation orientation, float offset)
+    : m_half_extents(width / 2.0f, height / 2.0f, depth / 2.0f), m_orientation(orientation),
+    m_normal(0.0f, 0.0f, 1.0f), m_offset_step(OFFSET_STEPS / 2)
 {
-    generateGeometry(width / 2.0f); // Initial depth is irrelevant for default z
+    setOrientation(orientation);
+    setOffset(offset);
+    generateGeometry();
 }
 
-void FieldPlane::updateZPosition(float z_normalized, float cuboid_depth)
+void FieldPlane::setOrientation(FieldPlaneOrientation orientation, const glm::vec3& custom_normal)
 {
-    m_z_normalized = std::max(-1.0f, std::min(1.0f, z_normalized));
-    generateGeometry(cuboid_depth);
+    glm::vec3 normal;
+    switch (orientation) {
+    case FieldPlaneOrientation::XY: normal = glm::vec3(0.0f, 0.0f, 1.0f); break;
+    case FieldPlaneOrientation::YZ: normal = glm::vec3(1.0f, 0.0f, 0.0f); break;
+    case FieldPlaneOrientation::XZ: normal = glm::vec3(0.0f, 1.0f, 0.0f); break;
+    default:
+        normal = glm::length(custom_normal) > 1e-6f ? glm::normalize(custom_normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+        break;
+    }
+    if (orientation == m_orientation && normal == m_normal) {
+        return;
+    }
+    m_orientation = orientation;
+    m_normal = normal;
+    generateGeometry();
 }
 
-void FieldPlane::updateDimensions(float width, float height, float cuboid_depth)
+void FieldPlane::setOffset(float offset_normalized)
 {
-    m_width = width;
-    m_height = height;
-    generateGeometry(cuboid_depth);
+    float clamped = std::max(-1.0f, std::min(1.0f, offset_normalized));
+    int step = static_cast<int>(std::lround((clamped + 1.0f) * 0.5f * OFFSET_STEPS));
+    if (step == m_offset_step) {
+        return;
+    }
+    m_offset_step = step;
+    generateGeometry();
 }
 
-void FieldPlane::generateGeometry(float cuboid_depth)
+void FieldPlane::updateBounds(float width, float height, float depth)
 {
-    float hw = m_width / 2.0f;
-    float hh = m_height / 2.0f;
-    float z = m_z_normalized * (cuboid_depth / 2.0f); // Map [-1, 1] to [-hd, hd]
+    m_half_extents = glm::vec3(width / 2.0f, height / 2.0f, depth / 2.0f);
+    generateGeometry();
+}
+
+void FieldPlane::generateGeometry()
+{
+    // Orthonormal basis in the plane, XY planes get u = x and v = y
+    glm::vec3 helper = std::abs(m_normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 u = glm::normalize(glm::cross(helper, m_normal));
+    glm::vec3 v = glm::cross(m_normal, u);
+
+    // Half extents of the cuboid projected onto each axis, so the plane covers its cross-section
+    float hu = glm::dot(glm::abs(u), m_half_extents);
+    float hv = glm::dot(glm::abs(v), m_half_extents);
+    float hn = glm::dot(glm::abs(m_normal), m_half_extents);
+    glm::vec3 center = m_normal * (getOffset() * hn); // Map [-1, 1] to [-hn, hn]
 
-    // Vertices (XY plane at z)
-    vertices[0] = -hw; vertices[1] = -hh; vertices[2] = z; // Bottom-left
-    vertices[3] = hw;  vertices[4] = -hh; vertices[5] = z; // Bottom-right
-    vertices[6] = -hw; vertices[7] = hh;  vertices[8] = z; // Top-left
-    vertices[9] = hw;  vertices[10] = hh; vertices[11] = z; // Top-right
+    m_origin = center - hu * u - hv * v;
+    m_axis_u = 2.0f * hu * u;
+    m_axis_v = 2.0f * hv * v;
+
+    // Vertices with plane coordinates
+    const glm::vec2 corners[4] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f } };
+    for (int i = 0; i < 4; ++i) {
+        glm::vec3 position = m_origin + corners[i].x * m_axis_u + corners[i].y * m_axis_v;
+        vertices[i * 5 + 0] = position.x;
+        vertices[i * 5 + 1] = position.y;
+        vertices[i * 5 + 2] = position.z;
+        vertices[i * 5 + 3] = corners[i].x;
+        vertices[i * 5 + 4] = corners[i].y;
+    }
 
     // Indices (two triangles)
     indices[0] = 0; indices[1] = 1; indices[2] = 2; // First triangle: 0-1-2
     indices[3] = 2; indices[4] = 1; indices[5] = 3; // Second triangle: 2-1-3
-}
\ No newline at end of file
+
+    ++m_version;
+}
@@ -1,26 +1,61 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <utility>
 
+enum class FieldPlaneOrientation {
+    XY,
+    YZ,
+    XZ,
+    Custom, // Arbitrary normal
+};
+
+// Rectangular slice through the cuboid, spanning its full cross-section. Each vertex
+// carries its plane coordinates so the field magnitude texture can be mapped onto it.
+// Slices with a custom normal stick out of the cuboid at the corners, the fragment
+// shader clips them to the cuboid bounds.
 class FieldPlane {
 public:
-    float vertices[12]; // 4 vertices * 3 floats (x, y, z)
+    // Offsets snap to this many steps over [-1, 1], so nearby slider positions share samples
+    static constexpr int OFFSET_STEPS = 512;
+
+    float vertices[20]; // 4 vertices * 5 floats (x, y, z, u, v)
     unsigned int indices[6]; // 2 triangles * 3 indices
 
-    FieldPlane(float width, float height, float z_position);
+    FieldPlane(float width, float height, float depth,
+        FieldPlaneOrientation orientation = FieldPlaneOrientation::XY, float offset = 0.0f);
+
+    // Set the orientation, custom_normal is only used for FieldPlaneOrientation::Custom
+    void setOrientation(FieldPlaneOrientation orientation, const glm::vec3& custom_normal = glm::vec3(0.0f, 0.0f, 1.0f));
+    // Set the offset along the normal in range [-1, 1], mapped to the cuboid extent along it
+    void setOffset(float offset_normalized);
+    // Update the cuboid dimensions while preserving orientation and offset
+    void updateBounds(float width, float height, float depth);
+
+    FieldPlaneOrientation getOrientation() const { return m_orientation; }
+    const glm::vec3& getNormal() const { return m_normal; }
+    float getOffset() const { return m_offset_step * 2.0f / OFFSET_STEPS - 1.0f; }
 
-    // Update z-position in range [-1, 1], mapped to cuboid depth
-    void updateZPosition(float z_normalized, float cuboid_depth);
+    // World-space corner at plane coordinates (0, 0) and the edges along u and v
+    const glm::vec3& getOrigin() const { return m_origin; }
+    const glm::vec3& getAxisU() const { return m_axis_u; }
+    const glm::vec3& getAxisV() const { return m_axis_v; }
+    glm::vec3 getCenter() const { return m_origin + 0.5f * (m_axis_u + m_axis_v); }
 
-    // Update dimensions (width and height) while preserving z-position
-    void updateDimensions(float width, float height, float cuboid_depth);
+    // Incremented whenever the geometry is regenerated
+    uint64_t getVersion() const { return m_version; }
 
 private:
-    float m_width;
-    float m_height;
-    float m_z_normalized; // Z-position in [-1, 1]
+    glm::vec3 m_half_extents; // Half of the cuboid dimensions
+    FieldPlaneOrientation m_orientation;
+    glm::vec3 m_normal;
+    int m_offset_step; // Snapped offset in [0, OFFSET_STEPS]
+    glm::vec3 m_origin{ 0.0f };
+    glm::vec3 m_axis_u{ 0.0f };
+    glm::vec3 m_axis_v{ 0.0f };
+    uint64_t m_version{ 0 };
 
-    // Generate geometry based on current dimensions and z-position
-    void generateGeometry(float cuboid_depth);
-};
\ No newline at end of file
+    // Generate geometry based on current bounds, orientation and offset
+    void generateGeometry();
+};
@@ -0,0 +1,119 @@
+#include "field_plane_texture.h"
+#include "gl_debug.h"
+#include <algorithm>
+#include <cmath>
+
+FieldPlaneTexture::FieldPlaneTexture(int resolution)
+    : m_resolution(std::max(resolution, 1)) {
+}
+
+FieldPlaneTexture::~FieldPlaneTexture() {
+    glDeleteTextures(1, &m_texture);
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteVertexArrays(1, &m_empty_VAO);
+}
+
+void FieldPlaneTexture::initialize() {
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &m_fbo);
+    glGenVertexArrays(1, &m_empty_VAO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindVertexArray(m_empty_VAO);
+    glBindVertexArray(0);
+    labelGLObject(GL_TEXTURE, m_texture, "Field plane magnitude texture");
+    labelGLObject(GL_FRAMEBUFFER, m_fbo, "Field plane bake FBO");
+    labelGLObject(GL_VERTEX_ARRAY, m_empty_VAO, "Field plane bake VAO");
+}
+
+void FieldPlaneTexture::setResolution(int resolution) {
+    resolution = std::max(resolution, 1);
+    if (resolution != m_resolution) {
+        m_resolution = resolution;
+        m_valid = false;
+    }
+}
+
+bool FieldPlaneTexture::isStale(uint64_t source_version, const FieldPlane& plane) const {
+    return !m_valid || source_version != m_source_version || plane.getVersion() != m_plane_version;
+}
+
+void FieldPlaneTexture::markComputed(uint64_t source_version, const FieldPlane& plane) {
+    m_valid = true;
+    m_source_version = source_version;
+    m_plane_version = plane.getVersion();
+}
+
+void FieldPlaneTexture::resizeTexture(const FieldPlane& plane) {
+    glm::vec2 size(glm::length(plane.getAxisU()), glm::length(plane.getAxisV()));
+    int texels_x = m_resolution, texels_y = m_resolution;
+    if (size.x >= size.y) {
+        texels_y = std::max(1, static_cast<int>(std::lround(m_resolution * size.y / std::max(size.x, 1e-6f))));
+    }
+    else {
+        texels_x = std::max(1, static_cast<int>(std::lround(m_resolution * size.x / size.y)));
+    }
+    if (texels_x == m_texels_x && texels_y == m_texels_y) {
+        return;
+    }
+    m_texels_x = texels_x;
+    m_texels_y = texels_y;
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_texels_x, m_texels_y, 0, GL_RED, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void FieldPlaneTexture::computeOnCPU(FieldSliceCache& cache, const DipoleStore& store, const FieldPlane& plane, float pixels_per_meter) {
+    GLDebugScope scope("Field plane CPU compute");
+    resizeTexture(plane);
+    const std::vector<float>& samples = cache.getSamples(store, plane, m_texels_x, m_texels_y, pixels_per_meter);
+
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_texels_x, m_texels_y, GL_RED, GL_FLOAT, samples.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GL_CHECK("Field plane CPU compute");
+    markComputed(store.getVersion(), plane);
+}
+
+void FieldPlaneTexture::computeOnGPU(const DipoleSourceBuffer& sources, uint64_t source_version, const FieldPlane& plane, float pixels_per_meter, Shader& bake_shader) {
+    GLDebugScope scope("Field plane GPU bake");
+    resizeTexture(plane);
+
+    GLint previous_viewport[4];
+    glGetIntegerv(GL_VIEWPORT, previous_viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+    glViewport(0, 0, m_texels_x, m_texels_y);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+
+    bake_shader.use_shader();
+    bake_shader.set_vec3("plane_origin", plane.getOrigin());
+    bake_shader.set_vec3("plane_axis_u", plane.getAxisU());
+    bake_shader.set_vec3("plane_axis_v", plane.getAxisV());
+    bake_shader.set_int("num_dipoles", (int)sources.size());
+    sources.bind(bake_shader);
+    bake_shader.set_float("pixels_per_meter", pixels_per_meter);
+    glBindVertexArray(m_empty_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(previous_viewport[0], previous_viewport[1], previous_viewport[2], previous_viewport[3]);
+    GL_CHECK("Field plane GPU bake");
+    markComputed(source_version, plane);
+}
+
+void FieldPlaneTexture::bind(unsigned int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+}
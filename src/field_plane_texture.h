@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "dipole_store.h"
+#include "dipole_source_buffer.h"
+#include "field_plane.h"
+#include "field_slice_cache.h"
+
+// Field magnitude sampled over a field plane, stored in a single-channel float texture.
+// It is only refreshed when the dipoles or the plane change. The per-frame field plane
+// pass just maps the sampled magnitude to colour, so Sensitivity and Opacity cost nothing.
+// Magnitudes come from the shared FieldSliceCache on the CPU by default, or are baked on
+// the GPU from a DipoleSourceBuffer.
+class FieldPlaneTexture {
+public:
+    explicit FieldPlaneTexture(int resolution = 512);
+    ~FieldPlaneTexture();
+
+    FieldPlaneTexture(const FieldPlaneTexture&) = delete;
+    FieldPlaneTexture& operator=(const FieldPlaneTexture&) = delete;
+
+    void initialize();
+
+    // Texel count along the longer side of the plane, the other side follows the aspect ratio
+    void setResolution(int resolution);
+    int getResolution() const { return m_resolution; }
+
+    // True if the cached magnitudes were computed for another store version or plane placement
+    bool isStale(uint64_t source_version, const FieldPlane& plane) const;
+
+    // Fetch the magnitudes from cache, computing them on the CPU on a miss, and upload them
+    void computeOnCPU(FieldSliceCache& cache, const DipoleStore& store, const FieldPlane& plane, float pixels_per_meter);
+    // Render the magnitudes straight into the texture, bake_shader reads the dipoles from
+    // sources, which must already hold source_version
+    void computeOnGPU(const DipoleSourceBuffer& sources, uint64_t source_version, const FieldPlane& plane, float pixels_per_meter, Shader& bake_shader);
+
+    void bind(unsigned int unit) const;
+    unsigned int getTexture() const { return m_texture; }
+
+private:
+    int m_resolution;
+    int m_texels_x{ 0 }, m_texels_y{ 0 };
+    unsigned int m_texture{ 0 };
+    unsigned int m_fbo{ 0 };
+    unsigned int m_empty_VAO{ 0 }; // Bake pass generates its triangle from gl_VertexID
+
+    // What the current texture contents were computed from
+    bool m_valid{ false };
+    uint64_t m_source_version{ 0 };
+    uint64_t m_plane_version{ 0 };
+
+    void resizeTexture(const FieldPlane& plane);
+    void markComputed(uint64_t source_version, const FieldPlane& plane);
+};
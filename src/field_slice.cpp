@@ -0,0 +1,60 @@
+#include "field_slice.h"
+#include "gl_debug.h"
+
+FieldSlice::FieldSlice(GpuResourceManager& resources, float width, float height, float depth,
+    FieldPlaneOrientation orientation, float offset, int resolution)
+    : orientation_index(static_cast<int>(orientation)), offset(offset), m_resources(resources),
+    m_plane(width, height, depth, orientation, offset), m_texture(resolution) {
+    m_texture.initialize();
+    glGenVertexArrays(1, &m_VAO);
+    glBindVertexArray(m_VAO);
+    glBindVertexArray(0);
+    labelGLObject(GL_VERTEX_ARRAY, m_VAO, "Field plane VAO");
+    m_VBO = &m_resources.createBuffer("Field plane VBO");
+    m_EBO = &m_resources.createBuffer("Field plane EBO");
+    updateGeometry();
+}
+
+FieldSlice::~FieldSlice() {
+    glDeleteVertexArrays(1, &m_VAO);
+    m_resources.destroyBuffer(*m_VBO);
+    m_resources.destroyBuffer(*m_EBO);
+}
+
+void FieldSlice::updateGeometry() {
+    GpuBuffer::UploadResult vertices = m_VBO->upload(m_plane.getVersion(), m_plane.vertices, sizeof(m_plane.vertices));
+    GpuBuffer::UploadResult indices = m_EBO->upload(m_plane.getVersion(), m_plane.indices, sizeof(m_plane.indices));
+    if (vertices == GpuBuffer::UploadResult::Reallocated || indices == GpuBuffer::UploadResult::Reallocated) {
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO->getBuffer());
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO->getBuffer());
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void FieldSlice::updateTexture(FieldSliceCache& cache, const DipoleStore& store, DipoleSourceBuffer& sources,
+    bool use_gpu, int resolution, float pixels_per_meter, Shader& bake_shader) {
+    m_texture.setResolution(resolution);
+    if (!m_texture.isStale(store.getVersion(), m_plane)) {
+        return;
+    }
+    if (use_gpu) {
+        sources.update(store);
+        m_texture.computeOnGPU(sources, store.getVersion(), m_plane, pixels_per_meter, bake_shader);
+    }
+    else {
+        m_texture.computeOnCPU(cache, store, m_plane, pixels_per_meter);
+    }
+}
+
+void FieldSlice::render() const {
+    m_texture.bind(0);
+    glBindVertexArray(m_VAO);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+}
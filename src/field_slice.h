@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "gpu_resources.h"
+#include "dipole_store.h"
+#include "dipole_source_buffer.h"
+#include "field_plane.h"
+#include "field_plane_texture.h"
+#include "field_slice_cache.h"
+
+// One field plane slice: its geometry, GPU buffers and magnitude texture
+class FieldSlice {
+public:
+    FieldSlice(GpuResourceManager& resources, float width, float height, float depth,
+        FieldPlaneOrientation orientation = FieldPlaneOrientation::XY, float offset = 0.0f, int resolution = 512);
+    ~FieldSlice();
+
+    FieldSlice(const FieldSlice&) = delete;
+    FieldSlice& operator=(const FieldSlice&) = delete;
+
+    FieldPlane& getPlane() { return m_plane; }
+    const FieldPlane& getPlane() const { return m_plane; }
+
+    // Upload the plane geometry if it was regenerated
+    void updateGeometry();
+    // Refresh the magnitude texture if the dipoles or the plane changed since it was computed
+    void updateTexture(FieldSliceCache& cache, const DipoleStore& store, DipoleSourceBuffer& sources,
+        bool use_gpu, int resolution, float pixels_per_meter, Shader& bake_shader);
+    // Draw with the field plane shader, which must be in use
+    void render() const;
+
+    // Settings edited in the UI
+    bool visible{ true };
+    int orientation_index{ 0 };         // FieldPlaneOrientation as an int for ImGui::Combo
+    glm::vec3 custom_normal{ 0.0f, 0.0f, 1.0f };
+    float offset{ 0.0f };               // In [-1, 1], snapped by the plane
+
+private:
+    GpuResourceManager& m_resources;
+    FieldPlane m_plane;
+    FieldPlaneTexture m_texture;
+    unsigned int m_VAO{ 0 };
+    GpuBuffer* m_VBO{ nullptr };
+    GpuBuffer* m_EBO{ nullptr };
+};
@@ -0,0 +1,219 @@
+#include "field_slice_cache.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// Dipoles flattened into plain arrays so the inner loop vectorizes
+struct DipoleSources {
+    std::vector<float> px, py, pz; // Positions
+    std::vector<float> dx, dy, dz; // Unit directions
+    std::vector<float> k;          // moment * pixels_per_meter^3, so r can stay in world units
+};
+
+// Sum the dipole fields over columns [col_begin, col_end) of rows [row_begin, row_end) and
+// store their magnitudes. The loop over texels is innermost and branch-free so the compiler
+// can vectorize it. Uses the same
+// field as MagneticDipole::calculateDipoleField, with the radial and tangential terms
+// combined into moment / r^3 * (direction + cos_theta * radial).
+static void computeRows(int row_begin, int row_end, int col_begin, int col_end, int texels_x, int texels_y,
+    const glm::vec3& origin, const glm::vec3& axis_u, const glm::vec3& axis_v, const DipoleSources& sources, float* out) {
+    const int count = col_end - col_begin;
+    std::vector<float> bx(count), by(count), bz(count), wx(count), wy(count), wz(count);
+    glm::vec3 step_u = axis_u / static_cast<float>(texels_x);
+    glm::vec3 step_v = axis_v / static_cast<float>(texels_y);
+
+    for (int row = row_begin; row < row_end; ++row) {
+        // Texel centres of this row
+        glm::vec3 row_start = origin + (row + 0.5f) * step_v + (col_begin + 0.5f) * step_u;
+        for (int i = 0; i < count; ++i) {
+            glm::vec3 w = row_start + static_cast<float>(i) * step_u;
+            wx[i] = w.x;
+            wy[i] = w.y;
+            wz[i] = w.z;
+        }
+        std::fill(bx.begin(), bx.end(), 0.0f);
+        std::fill(by.begin(), by.end(), 0.0f);
+        std::fill(bz.begin(), bz.end(), 0.0f);
+
+        for (size_t d = 0; d < sources.k.size(); ++d) {
+            float px = sources.px[d], py = sources.py[d], pz = sources.pz[d];
+            float ddx = sources.dx[d], ddy = sources.dy[d], ddz = sources.dz[d], k = sources.k[d];
+            for (int i = 0; i < count; ++i) {
+                float ax = wx[i] - px;
+                float ay = wy[i] - py;
+                float az = wz[i] - pz;
+                float r2 = ax * ax + ay * ay + az * az;
+                float r = std::sqrt(r2);
+                float inv_r = 1.0f / std::max(r, 0.0001f);
+                float cos_theta = (ax * ddx + ay * ddy + az * ddz) * inv_r;
+                float scale = r < 0.0001f ? 0.0f : k * inv_r * inv_r * inv_r; // Avoid divide-by-zero
+                float radial = cos_theta * inv_r;
+                bx[i] += scale * (ddx + radial * ax);
+                by[i] += scale * (ddy + radial * ay);
+                bz[i] += scale * (ddz + radial * az);
+            }
+        }
+
+        float* out_row = out + static_cast<size_t>(row) * texels_x + col_begin;
+        for (int i = 0; i < count; ++i) {
+            out_row[i] = std::sqrt(bx[i] * bx[i] + by[i] * by[i] + bz[i] * bz[i]);
+        }
+    }
+}
+
+static glm::ivec3 quantize(const glm::vec3& v) {
+    return glm::ivec3(std::lround(v.x * 1e4f), std::lround(v.y * 1e4f), std::lround(v.z * 1e4f));
+}
+
+static glm::vec3 dequantize(const glm::ivec3& v) {
+    return glm::vec3(v) * 1e-4f;
+}
+
+bool FieldSliceCache::Key::operator==(const Key& other) const {
+    return origin == other.origin && axis_u == other.axis_u && axis_v == other.axis_v &&
+        texels_x == other.texels_x && texels_y == other.texels_y;
+}
+
+bool FieldSliceCache::Key::sameGrid(const Key& other) const {
+    return axis_u == other.axis_u && axis_v == other.axis_v && texels_x == other.texels_x && texels_y == other.texels_y;
+}
+
+FieldSliceCache::FieldSliceCache(size_t capacity)
+    : m_capacity(std::max<size_t>(capacity, 1)) {
+}
+
+FieldSliceCache::Key FieldSliceCache::makeKey(const FieldPlane& plane, int texels_x, int texels_y) {
+    return { quantize(plane.getOrigin()), quantize(plane.getAxisU()), quantize(plane.getAxisV()), texels_x, texels_y };
+}
+
+void FieldSliceCache::clear() {
+    m_entries.clear();
+}
+
+const std::vector<float>& FieldSliceCache::getSamples(const DipoleStore& store, const FieldPlane& plane,
+    int texels_x, int texels_y, float pixels_per_meter) {
+    if (store.getVersion() != m_source_version) {
+        m_entries.clear();
+        m_source_version = store.getVersion();
+    }
+
+    Key key = makeKey(plane, texels_x, texels_y);
+    auto it = std::find_if(m_entries.begin(), m_entries.end(), [&key](const Entry& entry) { return entry.key == key; });
+    if (it != m_entries.end()) {
+        ++m_hits;
+        m_entries.splice(m_entries.begin(), m_entries, it);
+        return m_entries.front().samples;
+    }
+
+    // Look for an entry on the same texel lattice, shifted in plane by whole texels, and
+    // keep the one sharing the most texels
+    const Entry* source = nullptr;
+    glm::ivec2 shift(0);
+    int overlap_x = 0, overlap_y = 0;
+    const glm::vec3 step_u = dequantize(key.axis_u) / static_cast<float>(texels_x);
+    const glm::vec3 step_v = dequantize(key.axis_v) / static_cast<float>(texels_y);
+    const float uu = glm::dot(step_u, step_u), uv = glm::dot(step_u, step_v), vv = glm::dot(step_v, step_v);
+    const float det = uu * vv - uv * uv;
+    for (const Entry& entry : m_entries) {
+        if (!entry.key.sameGrid(key) || det <= 0.0f) {
+            continue;
+        }
+        // Texel (i, j) of the new slice sits on texel (i + a, j + b) of the entry
+        glm::vec3 delta = glm::vec3(key.origin - entry.key.origin) * 1e-4f;
+        float du = glm::dot(delta, step_u), dv = glm::dot(delta, step_v);
+        float a = (du * vv - dv * uv) / det;
+        float b = (dv * uu - du * uv) / det;
+        glm::ivec2 offset(static_cast<int>(std::lround(a)), static_cast<int>(std::lround(b)));
+        glm::vec3 residual = delta - static_cast<float>(offset.x) * step_u - static_cast<float>(offset.y) * step_v;
+        if (glm::dot(residual, residual) > 4e-8f) { // Off the lattice by more than the key quantization
+            continue;
+        }
+        int ox = texels_x - std::abs(offset.x);
+        int oy = texels_y - std::abs(offset.y);
+        if (ox > 0 && oy > 0 && (!source || ox * oy > overlap_x * overlap_y)) {
+            source = &entry;
+            shift = offset;
+            overlap_x = ox;
+            overlap_y = oy;
+        }
+    }
+    if (source) {
+        ++m_partial_hits;
+    }
+    else {
+        ++m_misses;
+    }
+
+    m_entries.emplace_front();
+    Entry& entry = m_entries.front();
+    entry.key = key;
+    entry.samples.assign(static_cast<size_t>(texels_x) * texels_y, 0.0f);
+
+    // Rows [row_begin, row_end) and, within them, columns [col_begin, col_end) are copied,
+    // everything else is summed below
+    int row_begin = 0, row_end = 0, col_begin = 0, col_end = 0;
+    if (source) {
+        row_begin = std::max(0, -shift.y);
+        row_end = row_begin + overlap_y;
+        col_begin = std::max(0, -shift.x);
+        col_end = col_begin + overlap_x;
+        for (int row = row_begin; row < row_end; ++row) {
+            const float* from = source->samples.data() + static_cast<size_t>(row + shift.y) * texels_x + col_begin + shift.x;
+            std::copy(from, from + overlap_x, entry.samples.data() + static_cast<size_t>(row) * texels_x + col_begin);
+        }
+    }
+
+    DipoleSources sources;
+    float ppm_cube = pixels_per_meter * pixels_per_meter * pixels_per_meter;
+    for (size_t i = 0; i < store.size(); ++i) {
+        glm::vec3 position = store.getPosition(i);
+        glm::vec3 direction = store.getDirection(i);
+        sources.px.push_back(position.x);
+        sources.py.push_back(position.y);
+        sources.pz.push_back(position.z);
+        sources.dx.push_back(direction.x);
+        sources.dy.push_back(direction.y);
+        sources.dz.push_back(direction.z);
+        sources.k.push_back(store.getMoment(i) * ppm_cube);
+    }
+
+    // The missing texels form at most three rectangles: full rows above and below the copied
+    // block and the columns beside it
+    struct Block { int row_begin, row_end, col_begin, col_end; };
+    std::vector<Block> blocks;
+    if (!source) {
+        blocks.push_back({ 0, texels_y, 0, texels_x });
+    }
+    else {
+        blocks.push_back({ 0, row_begin, 0, texels_x });
+        blocks.push_back({ row_end, texels_y, 0, texels_x });
+        blocks.push_back({ row_begin, row_end, 0, col_begin });
+        blocks.push_back({ row_begin, row_end, col_end, texels_x });
+    }
+
+    // Split rows among threads, as the field line tracer does for start points
+    std::vector<std::thread> threads;
+    for (const Block& block : blocks) {
+        int rows = block.row_end - block.row_begin;
+        if (rows <= 0 || block.col_end <= block.col_begin) continue;
+        unsigned int numThreads = std::min(std::max(1u, std::thread::hardware_concurrency()), (unsigned int)rows);
+        int rowsPerThread = (rows + numThreads - 1) / numThreads;
+        for (unsigned int t = 0; t < numThreads; ++t) {
+            int begin = block.row_begin + t * rowsPerThread;
+            int end = std::min(begin + rowsPerThread, block.row_end);
+            if (begin >= end) break;
+            threads.emplace_back(computeRows, begin, end, block.col_begin, block.col_end, texels_x, texels_y,
+                std::cref(plane.getOrigin()), std::cref(plane.getAxisU()), std::cref(plane.getAxisV()),
+                std::cref(sources), entry.samples.data());
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Drop the least recently used entry only now, it may have been the source of the copy
+    if (m_entries.size() > m_capacity) {
+        m_entries.pop_back();
+    }
+    return entry.samples;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "dipole_store.h"
+#include "field_plane.h"
+
+// Field magnitude samples for field plane slices, shared by every slice. Entries are keyed
+// by the slice geometry and texel grid, and the whole cache belongs to one dipole store
+// version, so moving a slice back to an earlier offset or adding a slice coincident with
+// another reuses the samples instead of summing the dipoles again. A slice on the same
+// texel lattice as an entry, same axes and resolution with its origin shifted in plane by
+// whole texels, copies the shared texels and sums only the rest. Samples are not shared
+// between different resolutions or orientations, or across offsets along the normal,
+// since those texel centres never coincide. Any edit to the store changes every sample,
+// so the cache is emptied on each new store version. Least recently used entries are
+// dropped beyond the capacity.
+class FieldSliceCache {
+public:
+    explicit FieldSliceCache(size_t capacity = 32);
+
+    // Samples of plane on a texels_x by texels_y grid of texel centres, row-major from the
+    // plane origin. Computed across threads on a miss.
+    const std::vector<float>& getSamples(const DipoleStore& store, const FieldPlane& plane,
+        int texels_x, int texels_y, float pixels_per_meter);
+
+    void clear();
+    size_t size() const { return m_entries.size(); }
+    uint64_t getHits() const { return m_hits; }
+    // Misses served in part from an overlapping entry
+    uint64_t getPartialHits() const { return m_partial_hits; }
+    uint64_t getMisses() const { return m_misses; }
+
+private:
+    struct Key {
+        glm::ivec3 origin, axis_u, axis_v; // Plane geometry quantized to 1e-4 world units
+        int texels_x, texels_y;
+        bool operator==(const Key& other) const;
+        // Same axes and resolution, so the texel lattices differ only by the origin
+        bool sameGrid(const Key& other) const;
+    };
+    struct Entry {
+        Key key;
+        std::vector<float> samples;
+    };
+
+    size_t m_capacity;
+    std::list<Entry> m_entries; // Most recently used first
+    uint64_t m_source_version{ UINT64_MAX };
+    uint64_t m_hits{ 0 };
+    uint64_t m_partial_hits{ 0 };
+    uint64_t m_misses{ 0 };
+
+    static Key makeKey(const FieldPlane& plane, int texels_x, int texels_y);
+};
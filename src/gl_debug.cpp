@@ -0,0 +1,138 @@
+#include "gl_debug.h"
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static bool debug_output_enabled = false;
+static std::vector<const char*> scope_labels; // Innermost label last
+static std::unordered_set<size_t> reported_messages; // Hashes of source, type, id and text, repeats are only reported once
+
+static const char* currentScopeLabel() {
+    return scope_labels.empty() ? "frame" : scope_labels.back();
+}
+
+static const char* sourceName(GLenum source) {
+    switch (source) {
+    case GL_DEBUG_SOURCE_API: return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+    case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+    case GL_DEBUG_SOURCE_APPLICATION: return "application";
+    default: return "other";
+    }
+}
+
+static const char* typeName(GLenum type) {
+    switch (type) {
+    case GL_DEBUG_TYPE_ERROR: return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behavior";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+    case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+    default: return "other";
+    }
+}
+
+static const char* severityName(GLenum severity) {
+    switch (severity) {
+    case GL_DEBUG_SEVERITY_HIGH: return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+    case GL_DEBUG_SEVERITY_LOW: return "low";
+    default: return "notification";
+    }
+}
+
+static void APIENTRY debugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+    GLsizei, const GLchar* message, const void*) {
+    // Push/pop group markers echo back as notifications, skip them along with other chatter
+    if (severity == GL_DEBUG_SEVERITY_NOTIFICATION || type == GL_DEBUG_TYPE_PUSH_GROUP || type == GL_DEBUG_TYPE_POP_GROUP) {
+        return;
+    }
+    // Drivers reuse ids across unrelated messages, so the text is part of the key
+    size_t key = std::hash<std::string>()(message);
+    for (GLuint field : { source, type, id }) {
+        key ^= std::hash<GLuint>()(field) + 0x9e3779b9 + (key << 6) + (key >> 2);
+    }
+    if (!reported_messages.insert(key).second) {
+        return;
+    }
+    std::cerr << "OpenGL " << typeName(type) << " (" << severityName(severity) << ", " << sourceName(source)
+        << ", id " << id << ") in " << currentScopeLabel() << ": " << message << std::endl;
+}
+
+static bool hasExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool initGLDebugOutput(GLADloadproc loader) {
+    // GLAD only loads the 4.3 entry points on 4.3+ contexts, older contexts exposing
+    // KHR_debug use the same unsuffixed names in core profile, so load them by hand
+    if (!GLAD_GL_VERSION_4_3) {
+        if (!hasExtension("GL_KHR_debug")) {
+            std::cout << "KHR_debug not available, falling back to glGetError polling in debug builds" << std::endl;
+            return false;
+        }
+        glad_glDebugMessageCallback = (PFNGLDEBUGMESSAGECALLBACKPROC)loader("glDebugMessageCallback");
+        glad_glDebugMessageControl = (PFNGLDEBUGMESSAGECONTROLPROC)loader("glDebugMessageControl");
+        glad_glObjectLabel = (PFNGLOBJECTLABELPROC)loader("glObjectLabel");
+        glad_glPushDebugGroup = (PFNGLPUSHDEBUGGROUPPROC)loader("glPushDebugGroup");
+        glad_glPopDebugGroup = (PFNGLPOPDEBUGGROUPPROC)loader("glPopDebugGroup");
+        if (!glad_glDebugMessageCallback || !glad_glObjectLabel || !glad_glPushDebugGroup || !glad_glPopDebugGroup) {
+            return false;
+        }
+    }
+
+    glEnable(GL_DEBUG_OUTPUT);
+    // Synchronous delivery makes the callback fire inside the offending call, at some driver
+    // cost. It is needed in every build: the callback reads the scope stack and the set of
+    // reported messages, which asynchronous delivery would race from a driver thread.
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(debugMessageCallback, nullptr);
+    debug_output_enabled = true;
+    return true;
+}
+
+bool isGLDebugOutputEnabled() {
+    return debug_output_enabled;
+}
+
+void labelGLObject(GLenum identifier, GLuint name, const char* label) {
+    if (debug_output_enabled && name != 0) {
+        glObjectLabel(identifier, name, -1, label);
+    }
+}
+
+void pollGLErrors(const char* context) {
+    if (debug_output_enabled) {
+        return;
+    }
+    GLenum err;
+    while ((err = glGetError()) != GL_NO_ERROR) {
+        std::cerr << "OpenGL error in " << context << ": " << err << std::endl;
+    }
+}
+
+GLDebugScope::GLDebugScope(const char* label) {
+    scope_labels.push_back(label);
+    if (debug_output_enabled) {
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, label);
+    }
+}
+
+GLDebugScope::~GLDebugScope() {
+    if (debug_output_enabled) {
+        glPopDebugGroup();
+    }
+    scope_labels.pop_back();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// GL diagnostics. Errors are reported through the KHR_debug message callback when the
+// context supports it, so no glGetError round-trips are needed. GL_CHECK polling is only
+// a fallback for contexts without debug output and is compiled out of release builds.
+
+// Install the debug-output callback if KHR_debug (or GL 4.3) is available.
+// Must be called after GLAD has been initialized. Returns true if the callback is active.
+bool initGLDebugOutput(GLADloadproc loader);
+bool isGLDebugOutputEnabled();
+
+// Attach a readable label to a GL object, shown in callback messages and GPU debuggers
+void labelGLObject(GLenum identifier, GLuint name, const char* label);
+
+// Poll glGetError and report anything pending under the given context.
+// Does nothing while the debug callback is active, use GL_CHECK instead of calling directly.
+void pollGLErrors(const char* context);
+
+#ifdef NDEBUG
+#define GL_CHECK(context) ((void)0)
+#else
+#define GL_CHECK(context) pollGLErrors(context)
+#endif
+
+// Names a region of GL calls for the lifetime of the scope. Callback messages raised
+// inside it are reported with the innermost label.
+class GLDebugScope {
+public:
+    explicit GLDebugScope(const char* label);
+    ~GLDebugScope();
+
+    GLDebugScope(const GLDebugScope&) = delete;
+    GLDebugScope& operator=(const GLDebugScope&) = delete;
+};
@@ -0,0 +1,96 @@
+#include "gpu_resources.h"
+#include "gl_debug.h"
+#include <algorithm>
+
+GpuBuffer::GpuBuffer(GpuResourceManager& manager, const char* label)
+    : m_manager(manager), m_label(label) {
+}
+
+GpuBuffer::~GpuBuffer() {
+    glDeleteBuffers(1, &m_buffer);
+}
+
+bool GpuBuffer::reserve(size_t bytes) {
+    if (m_buffer != 0 && bytes <= m_capacity) {
+        return false;
+    }
+    // Grow geometrically so repeated small growth does not reallocate every time
+    m_capacity = std::max<size_t>({ bytes, m_capacity * 2, 64 });
+    glDeleteBuffers(1, &m_buffer);
+    glGenBuffers(1, &m_buffer);
+    // Uploads go through the copy-write target so they never disturb the bound VAO's element buffer
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    if (m_manager.hasImmutableStorage()) {
+        glBufferStorage(GL_COPY_WRITE_BUFFER, m_capacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    }
+    else {
+        glBufferData(GL_COPY_WRITE_BUFFER, m_capacity, nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    labelGLObject(GL_BUFFER, m_buffer, m_label);
+    m_size = 0;
+    m_has_version = false;
+    return true;
+}
+
+GpuBuffer::UploadResult GpuBuffer::upload(uint64_t version, const void* data, size_t bytes) {
+    if (isCurrent(version)) {
+        return UploadResult::Unchanged;
+    }
+    bool reallocated = reserve(bytes);
+    if (bytes > 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, bytes, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        m_manager.recordUpload(bytes);
+    }
+    m_size = bytes;
+    m_version = version;
+    m_has_version = true;
+    GL_CHECK(m_label);
+    return reallocated ? UploadResult::Reallocated : UploadResult::Updated;
+}
+
+void GpuBuffer::uploadRange(uint64_t version, size_t offset, const void* data, size_t bytes) {
+    if (bytes > 0 && offset + bytes <= m_capacity) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        m_manager.recordUpload(bytes);
+        m_size = std::max(m_size, offset + bytes);
+    }
+    m_version = version;
+    m_has_version = true;
+    GL_CHECK(m_label);
+}
+
+GpuResourceManager::GpuResourceManager()
+    : m_immutable_storage(GLAD_GL_VERSION_4_4 != 0) {
+}
+
+GpuBuffer& GpuResourceManager::createBuffer(const char* label) {
+    m_buffers.push_back(std::make_unique<GpuBuffer>(*this, label));
+    return *m_buffers.back();
+}
+
+void GpuResourceManager::destroyBuffer(GpuBuffer& buffer) {
+    auto it = std::find_if(m_buffers.begin(), m_buffers.end(),
+        [&buffer](const std::unique_ptr<GpuBuffer>& owned) { return owned.get() == &buffer; });
+    if (it != m_buffers.end()) {
+        m_buffers.erase(it);
+    }
+}
+
+void GpuResourceManager::release() {
+    m_buffers.clear();
+}
+
+void GpuResourceManager::beginFrame() {
+    m_frame_uploads = 0;
+    m_frame_upload_bytes = 0;
+}
+
+void GpuResourceManager::recordUpload(size_t bytes) {
+    ++m_frame_uploads;
+    m_frame_upload_bytes += bytes;
+}
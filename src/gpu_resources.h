@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+
+class GpuResourceManager;
+
+// GPU buffer tagged with the version of the CPU data it holds. Uploads of an already
+// current version are skipped, so callers can offer their data every frame. Storage is
+// immutable (glBufferStorage) on GL 4.4 and updated with sub-range writes, growing
+// geometrically. Growth replaces the buffer object, which upload reports so VAOs and
+// texture buffer views can be re-pointed.
+class GpuBuffer {
+public:
+    enum class UploadResult { Unchanged, Updated, Reallocated };
+
+    GpuBuffer(GpuResourceManager& manager, const char* label);
+    ~GpuBuffer();
+
+    GpuBuffer(const GpuBuffer&) = delete;
+    GpuBuffer& operator=(const GpuBuffer&) = delete;
+
+    bool isCurrent(uint64_t version) const { return m_has_version && m_version == version; }
+
+    // Make sure at least bytes of storage exist, returns true if the buffer object was replaced
+    bool reserve(size_t bytes);
+    // Replace the contents with data tagged with version, skipped if version is current
+    UploadResult upload(uint64_t version, const void* data, size_t bytes);
+    // Overwrite part of the contents and tag the buffer with version, the range must already fit
+    void uploadRange(uint64_t version, size_t offset, const void* data, size_t bytes);
+
+    unsigned int getBuffer() const { return m_buffer; }
+    size_t getSize() const { return m_size; }
+    size_t getCapacity() const { return m_capacity; }
+
+private:
+    GpuResourceManager& m_manager;
+    const char* m_label;
+    unsigned int m_buffer{ 0 };
+    size_t m_size{ 0 };     // Bytes written by the last upload
+    size_t m_capacity{ 0 }; // Bytes of storage
+    uint64_t m_version{ 0 };
+    bool m_has_version{ false };
+};
+
+// Owns the versioned GPU buffers and counts what they upload each frame. An idle scene
+// should report zero uploads.
+class GpuResourceManager {
+public:
+    GpuResourceManager();
+
+    GpuResourceManager(const GpuResourceManager&) = delete;
+    GpuResourceManager& operator=(const GpuResourceManager&) = delete;
+
+    GpuBuffer& createBuffer(const char* label);
+    // Delete a buffer made by createBuffer, references to it become invalid
+    void destroyBuffer(GpuBuffer& buffer);
+    // Delete every buffer, call before the context is destroyed
+    void release();
+
+    // Reset the per-frame upload counters, call once at the start of each frame
+    void beginFrame();
+    void recordUpload(size_t bytes);
+
+    int getFrameUploadCount() const { return m_frame_uploads; }
+    size_t getFrameUploadBytes() const { return m_frame_upload_bytes; }
+    bool hasImmutableStorage() const { return m_immutable_storage; }
+
+private:
+    std::vector<std::unique_ptr<GpuBuffer>> m_buffers;
+    bool m_immutable_storage;
+    int m_frame_uploads{ 0 };
+    size_t m_frame_upload_bytes{ 0 };
+};
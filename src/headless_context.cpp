@@ -0,0 +1,150 @@
+#include "headless_context.h"
+#include <iostream>
+
+#if defined(MAGFIELD_HEADLESS_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#elif defined(MAGFIELD_HEADLESS_OSMESA)
+#include <GL/osmesa.h>
+#include <cstdlib>
+#endif
+
+#if defined(MAGFIELD_HEADLESS_EGL)
+
+static void* loadProc(const char* name) {
+    return reinterpret_cast<void*>(eglGetProcAddress(name));
+}
+
+HeadlessContext::~HeadlessContext() {
+    if (m_display) {
+        EGLDisplay display = static_cast<EGLDisplay>(m_display);
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (m_context) {
+            eglDestroyContext(display, static_cast<EGLContext>(m_context));
+        }
+        eglTerminate(display);
+    }
+}
+
+bool HeadlessContext::create() {
+    // Prefer Mesa's surfaceless platform so no X or Wayland server is needed
+    EGLDisplay display = EGL_NO_DISPLAY;
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (get_platform_display) {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        std::cerr << "Failed to initialize EGL display" << std::endl;
+        return false;
+    }
+    m_display = display;
+
+    // No surface will be created, so do not require window support (the default)
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, 0,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+        std::cerr << "Failed to find an EGL config for desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifndef NDEBUG
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT) {
+        std::cerr << "Failed to create EGL context" << std::endl;
+        return false;
+    }
+    m_context = context;
+
+    // Requires EGL_KHR_surfaceless_context, rendering only ever targets FBOs
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << "Failed to make the EGL context current without a surface" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const char* HeadlessContext::backendName() {
+    return "EGL";
+}
+
+#elif defined(MAGFIELD_HEADLESS_OSMESA)
+
+static void* loadProc(const char* name) {
+    return reinterpret_cast<void*>(OSMesaGetProcAddress(name));
+}
+
+HeadlessContext::~HeadlessContext() {
+    if (m_context) {
+        OSMesaDestroyContext(static_cast<OSMesaContext>(m_context));
+    }
+    std::free(m_buffer);
+}
+
+bool HeadlessContext::create() {
+    const int attribs[] = {
+        OSMESA_FORMAT, OSMESA_RGBA,
+        OSMESA_DEPTH_BITS, 24,
+        OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+        OSMESA_CONTEXT_MAJOR_VERSION, 3,
+        OSMESA_CONTEXT_MINOR_VERSION, 3,
+        0
+    };
+    OSMesaContext context = OSMesaCreateContextAttribs(attribs, nullptr);
+    if (!context) {
+        std::cerr << "Failed to create OSMesa context" << std::endl;
+        return false;
+    }
+    m_context = context;
+
+    // The default framebuffer is never drawn to, a single pixel is enough
+    m_buffer = std::calloc(1, 4);
+    if (!OSMesaMakeCurrent(context, m_buffer, GL_UNSIGNED_BYTE, 1, 1)) {
+        std::cerr << "Failed to make the OSMesa context current" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const char* HeadlessContext::backendName() {
+    return "OSMesa";
+}
+
+#else
+
+static void* loadProc(const char*) {
+    return nullptr;
+}
+
+HeadlessContext::~HeadlessContext() {
+}
+
+bool HeadlessContext::create() {
+    std::cerr << "Headless rendering is not available, build with MAGFIELD_HEADLESS_EGL or MAGFIELD_HEADLESS_OSMESA" << std::endl;
+    return false;
+}
+
+const char* HeadlessContext::backendName() {
+    return "none";
+}
+
+#endif
+
+GLADloadproc HeadlessContext::getProcLoader() const {
+    return loadProc;
+}
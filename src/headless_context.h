@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// GL 3.3 core context without a window, for rendering on machines with no display.
+// The backend is chosen at build time: define MAGFIELD_HEADLESS_EGL for a surfaceless
+// EGL context (Mesa or a GPU driver) or MAGFIELD_HEADLESS_OSMESA for Mesa's software
+// rasterizer, and link libEGL or libOSMesa accordingly. Without either, create() fails.
+// Rendering goes to an OffscreenTarget, the context's own surface is never drawn to.
+class HeadlessContext {
+public:
+    HeadlessContext() = default;
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    // Create the context and make it current
+    bool create();
+    // Function loader for GLAD and the debug output setup
+    GLADloadproc getProcLoader() const;
+
+    static const char* backendName();
+
+private:
+    void* m_display{ nullptr };
+    void* m_context{ nullptr };
+    void* m_buffer{ nullptr }; // OSMesa requires a colour buffer to make the context current
+};
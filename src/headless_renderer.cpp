@@ -0,0 +1,314 @@
+#include "headless_renderer.h"
+#include "headless_context.h"
+#include "offscreen_target.h"
+#include "gl_debug.h"
+#include "gpu_resources.h"
+#include "shader.h"
+#include "shaders.h"
+#include "camera.h"
+#include "camera_uniforms.h"
+#include "cuboid.h"
+#include "dipole_store.h"
+#include "dipole_source_buffer.h"
+#include "dipole_visualizer.h"
+#include "field_slice.h"
+#include "field_slice_cache.h"
+#include "field_line_tracer.h"
+#include "scene_passes.h"
+#include "scene_file.h"
+#include "field_line_exporter.h"
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <glm/gtc/quaternion.hpp>
+
+static bool parseOrientation(const std::string& name, FieldPlaneOrientation& orientation) {
+    if (name == "xy") orientation = FieldPlaneOrientation::XY;
+    else if (name == "yz") orientation = FieldPlaneOrientation::YZ;
+    else if (name == "xz") orientation = FieldPlaneOrientation::XZ;
+    else if (name == "custom") orientation = FieldPlaneOrientation::Custom;
+    else return false;
+    return true;
+}
+
+bool loadHeadlessConfig(const std::string& path, HeadlessConfig& config) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open headless config: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream in(line);
+        std::string key;
+        if (!(in >> key)) {
+            continue;
+        }
+
+        bool ok = true;
+        int flag = 0;
+        if (key == "size") {
+            ok = static_cast<bool>(in >> config.width >> config.height) && config.width > 0 && config.height > 0;
+        }
+        else if (key == "frames") {
+            ok = static_cast<bool>(in >> config.frames) && config.frames > 0;
+        }
+        else if (key == "output") {
+            ok = static_cast<bool>(in >> config.output_prefix);
+        }
+        else if (key == "format") {
+            std::string format;
+            ok = static_cast<bool>(in >> format) && (format == "png" || format == "ppm");
+            config.format = format == "ppm" ? ImageFormat::PPM : ImageFormat::PNG;
+        }
+        else if (key == "scene") {
+            ok = static_cast<bool>(in >> config.scene_path);
+        }
+        else if (key == "export_field_lines") {
+            ok = static_cast<bool>(in >> config.field_line_export_path);
+        }
+        else if (key == "dipole") {
+            HeadlessDipole dipole;
+            ok = static_cast<bool>(in >> dipole.position.x >> dipole.position.y >> dipole.position.z
+                >> dipole.direction.x >> dipole.direction.y >> dipole.direction.z >> dipole.moment)
+                && glm::length(dipole.direction) > 0.0f;
+            std::string pinned;
+            dipole.pinned = (in >> pinned) && pinned == "pinned";
+            config.dipoles.push_back(dipole);
+        }
+        else if (key == "slice") {
+            HeadlessSlice slice;
+            std::string orientation;
+            ok = static_cast<bool>(in >> orientation) && parseOrientation(orientation, slice.orientation);
+            if (ok && slice.orientation == FieldPlaneOrientation::Custom) {
+                ok = static_cast<bool>(in >> slice.normal.x >> slice.normal.y >> slice.normal.z);
+            }
+            ok = ok && static_cast<bool>(in >> slice.offset);
+            config.slices.push_back(slice);
+        }
+        else if (key == "keyframe") {
+            CameraKeyframe keyframe;
+            ok = static_cast<bool>(in >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+                >> keyframe.target.x >> keyframe.target.y >> keyframe.target.z >> keyframe.fov);
+            config.camera_path.addKeyframe(keyframe);
+        }
+        else if (key == "orbit") {
+            float radius, height, fov, duration;
+            ok = static_cast<bool>(in >> radius >> height >> fov >> duration);
+            config.camera_path.setOrbit(glm::vec3(0.0f), radius, height, fov, duration);
+        }
+        else if (key == "field_lines") { ok = static_cast<bool>(in >> flag); config.render_field_lines = flag != 0; }
+        else if (key == "field_line_color") { ok = static_cast<bool>(in >> flag); config.field_line_color = flag != 0; }
+        else if (key == "dipoles") { ok = static_cast<bool>(in >> flag); config.render_dipoles = flag != 0; }
+        else if (key == "gpu_compute") { ok = static_cast<bool>(in >> flag); config.gpu_compute = flag != 0; }
+        else if (key == "opacity") { ok = static_cast<bool>(in >> config.plane_opacity); }
+        else if (key == "sensitivity") { ok = static_cast<bool>(in >> config.sensitivity); }
+        else if (key == "resolution") { ok = static_cast<bool>(in >> config.plane_resolution) && config.plane_resolution > 0; }
+        else if (key == "background") {
+            ok = static_cast<bool>(in >> config.background.r >> config.background.g >> config.background.b);
+        }
+        else {
+            ok = false;
+        }
+
+        if (!ok) {
+            std::cerr << path << ":" << line_number << ": invalid directive '" << line << "'" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int runHeadless(const HeadlessConfig& config) {
+    HeadlessContext context;
+    if (!context.create()) {
+        return -1;
+    }
+    if (!gladLoadGLLoader(context.getProcLoader())) {
+        std::cerr << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+    initGLDebugOutput(context.getProcLoader());
+    std::cout << "Headless rendering with " << HeadlessContext::backendName() << ": " << glGetString(GL_RENDERER) << std::endl;
+
+    OffscreenTarget target;
+    if (!target.initialize(config.width, config.height)) {
+        return -1;
+    }
+
+    // Scene, sized like the viewer's cuboid for the same aspect ratio
+    float aspect_ratio = (float)config.width / config.height;
+    float cuboid_height = config.cuboid_width / aspect_ratio;
+    DipoleStore dipole_store(config.pixels_per_meter);
+    if (!config.scene_path.empty() && !loadScene(config.scene_path, dipole_store)) {
+        return -1;
+    }
+    for (const HeadlessDipole& dipole : config.dipoles) {
+        glm::vec3 direction = glm::normalize(dipole.direction);
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        dipole_store.add(dipole.position, glm::quatLookAt(direction, up), dipole.moment,
+            dipole.pinned ? DipoleFlags_Pinned : DipoleFlags_None);
+    }
+
+    GpuResourceManager gpu_resources;
+    Cuboid cuboid(config.cuboid_width, cuboid_height, config.cuboid_depth);
+    unsigned int cuboid_VAO, cuboid_VBO, cuboid_EBO;
+    glGenVertexArrays(1, &cuboid_VAO);
+    glGenBuffers(1, &cuboid_VBO);
+    glGenBuffers(1, &cuboid_EBO);
+    glBindVertexArray(cuboid_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, cuboid_VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cuboid.edge_vertices), cuboid.edge_vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cuboid_EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cuboid.edge_indices), cuboid.edge_indices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    std::vector<std::unique_ptr<FieldSlice>> field_slices;
+    if (config.slices.empty()) {
+        field_slices.push_back(std::make_unique<FieldSlice>(gpu_resources, config.cuboid_width, cuboid_height, config.cuboid_depth,
+            FieldPlaneOrientation::XY, 0.0f, config.plane_resolution));
+    }
+    for (const HeadlessSlice& settings : config.slices) {
+        auto slice = std::make_unique<FieldSlice>(gpu_resources, config.cuboid_width, cuboid_height, config.cuboid_depth,
+            settings.orientation, settings.offset, config.plane_resolution);
+        if (settings.orientation == FieldPlaneOrientation::Custom) {
+            slice->custom_normal = settings.normal;
+            slice->getPlane().setOrientation(settings.orientation, settings.normal);
+            slice->updateGeometry();
+        }
+        field_slices.push_back(std::move(slice));
+    }
+    FieldSliceCache field_slice_cache;
+
+    DipoleSourceBuffer dipole_sources;
+    dipole_sources.initialize(gpu_resources);
+
+    Shader field_shader(shader_vert, shader_frag);
+    Shader cuboid_shader(cuboid_vert, cuboid_frag);
+    Shader field_line_shader(field_line_vert, field_line_frag);
+    Shader dipole_shader(dipole_vert, dipole_frag);
+    Shader field_bake_shader(field_bake_vert, (dipole_sources.shaderHeader() + field_bake_frag).c_str());
+    CameraUniformBuffer camera_uniforms;
+    camera_uniforms.initialize(gpu_resources);
+    for (Shader* shader : { &field_shader, &cuboid_shader, &field_line_shader, &dipole_shader }) {
+        shader->bind_uniform_block("CameraBlock", CameraUniformBuffer::BINDING);
+    }
+    field_shader.use_shader();
+    field_shader.set_int("field_magnitude", 0);
+
+    DipoleVisualizer dipole_visualizer(
+        0.04f, 0.15f,
+        glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),
+        glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+        glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)
+    );
+    dipole_visualizer.initialize(gpu_resources);
+
+    // The scene is static, so field lines are traced and uploaded once for the whole sequence
+    FieldLineGeometry field_line_geometry;
+    glGenVertexArrays(1, &field_line_geometry.VAO);
+    glBindVertexArray(field_line_geometry.VAO);
+    glBindVertexArray(0);
+    StreamingBuffer field_line_buffer(fieldLineVertexSize(FieldLineVertexFormat::Compact), "Field line VBO");
+    std::vector<BaseMagnet*> magnets = { &dipole_store };
+    FieldLineTracer tracer(magnets, config.cuboid_width, cuboid_height, config.cuboid_depth,
+        0.01f, 1000, 0.001f, 0.05f, 0.1f, false, true);
+    if (!config.field_line_export_path.empty() && !exportFieldLines(tracer, config.field_line_export_path)) {
+        return -1;
+    }
+    if (config.render_field_lines && !dipole_store.empty()) {
+        std::vector<FieldLine> field_lines = tracer.traceFieldLines();
+        updateFieldLineGeometry(field_lines, tracer.getBoundsMin(), tracer.getBoundsMax(), FieldLineVertexFormat::Compact,
+            field_line_geometry.VAO, field_line_buffer, field_line_geometry.firsts, field_line_geometry.counts, field_line_geometry.decode);
+    }
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    Camera camera(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), 0.1f, 50.0f);
+    float sensitivity_scaled = powf(10, config.sensitivity - 1);
+    float start_time = config.camera_path.getStartTime();
+    float end_time = config.camera_path.getEndTime();
+    std::vector<uint8_t> pixels;
+    int written = 0;
+    for (int frame = 0; frame < config.frames; ++frame) {
+        float time = config.frames > 1 ? start_time + (end_time - start_time) * frame / (config.frames - 1) : start_time;
+        CameraKeyframe pose = config.camera_path.sample(time);
+        camera.setWorldPosition(pose.position);
+        camera.setPerspective(pose.fov, aspect_ratio);
+        camera.lookAt(pose.target);
+
+        // Bakes use their own framebuffer, so textures are brought up to date before binding the target
+        for (auto& slice : field_slices) {
+            if (slice->visible) {
+                slice->updateTexture(field_slice_cache, dipole_store, dipole_sources, config.gpu_compute,
+                    config.plane_resolution, config.pixels_per_meter, field_bake_shader);
+            }
+        }
+
+        target.bind();
+        glClearColor(config.background.r, config.background.g, config.background.b, config.background.a);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        camera_uniforms.update(camera.getViewMatrix(), camera.getProjectionMatrix());
+
+        if (config.render_dipoles) {
+            dipole_visualizer.updateInstances(dipole_store);
+            dipole_visualizer.render(dipole_shader);
+        }
+        drawCuboidPass(cuboid_shader, cuboid_VAO, glm::vec4(1.0f));
+        if (config.render_field_lines) {
+            drawFieldLinePass(field_line_shader, field_line_geometry, field_line_buffer, sensitivity_scaled, config.field_line_color);
+        }
+        drawFieldSlicesPass(field_shader, field_slices, camera.getWorldPosition(),
+            glm::vec3(config.cuboid_width, cuboid_height, config.cuboid_depth) * 0.5f, config.plane_opacity, sensitivity_scaled);
+
+        target.readPixels(pixels);
+        std::ostringstream path;
+        path << config.output_prefix << std::setw(5) << std::setfill('0') << frame << "." << imageFormatExtension(config.format);
+        if (!writeImage(path.str(), config.format, config.width, config.height, pixels)) {
+            break;
+        }
+        ++written;
+        std::cout << "Wrote " << path.str() << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    field_slices.clear();
+    glDeleteVertexArrays(1, &cuboid_VAO);
+    glDeleteBuffers(1, &cuboid_VBO);
+    glDeleteBuffers(1, &cuboid_EBO);
+    glDeleteVertexArrays(1, &field_line_geometry.VAO);
+    return written == config.frames ? 0 : -1;
+}
+
+int runHeadless(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: --headless <config> [output_prefix]" << std::endl;
+        return -1;
+    }
+    HeadlessConfig config;
+    if (!loadHeadlessConfig(argv[1], config)) {
+        return -1;
+    }
+    if (argc > 2) {
+        config.output_prefix = argv[2];
+    }
+    return runHeadless(config);
+}
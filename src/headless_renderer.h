@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "camera_path.h"
+#include "field_plane.h"
+#include "image_writer.h"
+
+// Dipole as listed in a headless config
+struct HeadlessDipole {
+    glm::vec3 position{ 0.0f };
+    glm::vec3 direction{ 0.0f, 1.0f, 0.0f };
+    float moment{ 1.0f };
+    bool pinned{ false };
+};
+
+// Field slice as listed in a headless config
+struct HeadlessSlice {
+    FieldPlaneOrientation orientation{ FieldPlaneOrientation::XY };
+    float offset{ 0.0f };
+    glm::vec3 normal{ 0.0f, 0.0f, 1.0f }; // Used by Custom slices
+};
+
+// Everything needed to render an image sequence without a window. Defaults match the
+// interactive viewer's startup state.
+struct HeadlessConfig {
+    int width{ 1080 };
+    int height{ 1080 };
+    int frames{ 1 };                          // Spread evenly over the camera path
+    std::string output_prefix{ "frame_" };    // Frame number and extension are appended
+    ImageFormat format{ ImageFormat::PNG };
+    CameraPath camera_path;                   // Empty means the viewer's default camera
+    std::string scene_path;                   // Scene file loaded before the listed dipoles are added
+    std::string field_line_export_path;       // Field lines are also streamed to this file if set
+    std::vector<HeadlessDipole> dipoles;
+    std::vector<HeadlessSlice> slices;        // Empty means a single XY slice through the centre
+    bool render_field_lines{ true };
+    bool field_line_color{ true };
+    bool render_dipoles{ true };
+    float plane_opacity{ 0.5f };
+    float sensitivity{ 1.0f };
+    int plane_resolution{ 512 };
+    bool gpu_compute{ false };
+    glm::vec4 background{ 0.2f, 0.3f, 0.3f, 1.0f };
+    float cuboid_width{ 4.0f };               // Height follows the image aspect ratio, as in the viewer
+    float cuboid_depth{ 4.0f };
+    float pixels_per_meter{ 100.0f };
+};
+
+// Read a config file of one directive per line, '#' starts a comment:
+//   size <width> <height>
+//   frames <count>
+//   output <prefix>
+//   format png|ppm
+//   scene <path>   (binary or .json scene file, see scene_file.h)
+//   export_field_lines <path>   (.vtk, .ply or binary, see field_line_exporter.h)
+//   dipole <x> <y> <z> <dx> <dy> <dz> <moment> [pinned]
+//   slice xy|yz|xz <offset>
+//   slice custom <nx> <ny> <nz> <offset>
+//   keyframe <time> <px> <py> <pz> <tx> <ty> <tz> <fov>
+//   orbit <radius> <height> <fov> <duration>
+//   field_lines 0|1, field_line_color 0|1, dipoles 0|1, gpu_compute 0|1
+//   opacity <value>, sensitivity <value>, resolution <texels>
+//   background <r> <g> <b>
+// Returns false and reports the line on any malformed directive.
+bool loadHeadlessConfig(const std::string& path, HeadlessConfig& config);
+
+// Render config.frames frames to image files, returns a process exit code
+int runHeadless(const HeadlessConfig& config);
+// Entry point for `--headless <config> [output_prefix]`, argv[0] is the --headless flag
+int runHeadless(int argc, char** argv);
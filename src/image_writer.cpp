@@ -0,0 +1,119 @@
+#include "image_writer.h"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Length, type, data and CRC of the type and data
+static void writeChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+    appendBigEndian(chunk, static_cast<uint32_t>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    uint32_t crc = crc32Update(0xFFFFFFFFu, chunk.data() + 4, chunk.size() - 4) ^ 0xFFFFFFFFu;
+    appendBigEndian(chunk, crc);
+    file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+bool writePNG(const std::string& path, int width, int height, const std::vector<uint8_t>& rgba) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open image file: " << path << std::endl;
+        return false;
+    }
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, static_cast<uint32_t>(width));
+    appendBigEndian(header, static_cast<uint32_t>(height));
+    header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8-bit RGBA, no interlace
+    writeChunk(file, "IHDR", header);
+
+    // Scanlines each start with filter type 0 (none)
+    size_t row_bytes = static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((row_bytes + 1) * height);
+    for (int y = 0; y < height; ++y) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba.begin() + y * row_bytes, rgba.begin() + (y + 1) * row_bytes);
+    }
+
+    // zlib stream of stored deflate blocks, at most 65535 bytes each
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 11);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    uint32_t adler_a = 1, adler_b = 0;
+    size_t offset = 0;
+    do {
+        size_t block = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + block == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(block));
+        zlib.push_back(static_cast<uint8_t>(block >> 8));
+        zlib.push_back(static_cast<uint8_t>(~block));
+        zlib.push_back(static_cast<uint8_t>(~block >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+        for (size_t i = offset; i < offset + block; ++i) {
+            adler_a = (adler_a + raw[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+        offset += block;
+    } while (offset < raw.size());
+    appendBigEndian(zlib, (adler_b << 16) | adler_a);
+    writeChunk(file, "IDAT", zlib);
+    writeChunk(file, "IEND", {});
+    return static_cast<bool>(file);
+}
+
+bool writePPM(const std::string& path, int width, int height, const std::vector<uint8_t>& rgba) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open image file: " << path << std::endl;
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+    for (size_t i = 0, count = static_cast<size_t>(width) * height; i < count; ++i) {
+        rgb[i * 3 + 0] = rgba[i * 4 + 0];
+        rgb[i * 3 + 1] = rgba[i * 4 + 1];
+        rgb[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+    file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    return static_cast<bool>(file);
+}
+
+bool writeImage(const std::string& path, ImageFormat format, int width, int height, const std::vector<uint8_t>& rgba) {
+    return format == ImageFormat::PNG ? writePNG(path, width, height, rgba) : writePPM(path, width, height, rgba);
+}
+
+const char* imageFormatExtension(ImageFormat format) {
+    return format == ImageFormat::PNG ? "png" : "ppm";
+}
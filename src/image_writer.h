@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Image file output for headless rendering. Pixels are tightly packed 8-bit RGBA rows,
+// top row first. PNGs are written with stored (uncompressed) deflate blocks so no zlib
+// is needed, PPMs drop the alpha channel.
+enum class ImageFormat { PNG, PPM };
+
+bool writePNG(const std::string& path, int width, int height, const std::vector<uint8_t>& rgba);
+bool writePPM(const std::string& path, int width, int height, const std::vector<uint8_t>& rgba);
+bool writeImage(const std::string& path, ImageFormat format, int width, int height, const std::vector<uint8_t>& rgba);
+
+// File extension without the dot
+const char* imageFormatExtension(ImageFormat format);
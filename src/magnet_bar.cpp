@@ -15,9 +15,6 @@ BarMagnet::BarMagnet(const glm::vec3& position, const glm::vec3& size, float dip
 
     // Initialize dipoles
     updateDipoles();
-
-    // Initialize trace start points
-    initializeTraceStartPoints();
 }
 
 BarMagnet::~BarMagnet() {
@@ -32,14 +29,14 @@ void BarMagnet::setSize(const glm::vec3& size) {
     // Ensure size is positive
     mSize = glm::max(size, glm::vec3(0.001f));
     updateDipoles();
-    initializeTraceStartPoints();
+    markTraceStartPointsDirty();
 }
 
 void BarMagnet::setDipoleDensity(float density) {
     // Ensure density is positive
     mDipoleDensity = std::max(density, 0.001f);
     updateDipoles();
-    initializeTraceStartPoints();
+    markTraceStartPointsDirty();
 }
 
 void BarMagnet::updateDipoles() {
@@ -75,7 +72,13 @@ void BarMagnet::updateDipoles() {
     }
 }
 
-void BarMagnet::initializeTraceStartPoints() {
+void BarMagnet::onWorldTransformChanged() {
+    markTraceStartPointsDirty();
+}
+
+void BarMagnet::updateTraceStartPoints() const {
+    // Resolve the sub-dipole transforms here as well, so field evaluation afterwards only reads cached state
+    resolveWorldTransforms();
     mTraceStartPoints.clear();
 
     constexpr int NUM_POINTS = 5; // Number of trace points across width
@@ -83,6 +86,7 @@ void BarMagnet::initializeTraceStartPoints() {
 
     // Calculate normalized width direction (along y-axis)
     glm::vec3 normWidthDir = getRight();
+    glm::vec3 center = getWorldPosition();
 
     // Calculate step size for points
     float step = mSize.y * SPACING / (NUM_POINTS - 1);
@@ -90,7 +94,7 @@ void BarMagnet::initializeTraceStartPoints() {
     // Generate points centered around the magnet's center
     for (int i = 0; i < NUM_POINTS; ++i) {
         float offset = (i - (NUM_POINTS - 1) / 2.0f) * step;
-        glm::vec3 position = getWorldPosition() + offset * normWidthDir;
+        glm::vec3 position = center + offset * normWidthDir;
 
         TraceStartPoint point;
         point.position = position;
@@ -26,11 +26,15 @@ public:
     // Calculate the total magnetic field at a given position by summing contributions from all dipoles
     glm::vec3 calculateMagneticField(const glm::vec3& pos) const override;
 
+protected:
+    // Invalidate trace points when the magnet moves, they are rebuilt on the next read
+    void onWorldTransformChanged() override;
+    // Rebuild trace start points across width
+    void updateTraceStartPoints() const override;
+
 private:
     // Helper method to rebuild the dipole list based on current size and density
     void updateDipoles();
-    // Helper method to initialize trace start points across width
-    void initializeTraceStartPoints();
 
     glm::vec3 mSize;                   // Size of the bar magnet (length, width, height)
     float mDipoleDensity;              // Dipoles per meter
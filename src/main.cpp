@@ -1,26 +1,20 @@
 ﻿#include "main.h"
 
-void checkGLError(const std::string& context) {
-    GLenum err;
-    while ((err = glGetError()) != GL_NO_ERROR) {
-        if (context == "UBO update") {
-            if (UBO_error_flagged) {
-                continue;
-            }
-            UBO_error_flagged = true;
-        }
-        std::cerr << "OpenGL error in " << context << ": " << err << std::endl;
+int main(int argc, char** argv)
+{
+    // Render image sequences without a window, for batch runs on machines without a display
+    if (argc > 1 && std::string(argv[1]) == "--headless") {
+        return runHeadless(argc - 1, argv + 1);
     }
-}
 
-int main()
-{
     // Initialize GLFW
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifndef NDEBUG
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+#endif
 
     // Create window object
     GLFWwindow* window = glfwCreateWindow(screen_width, screen_height, "Magnetic Field Viewer", NULL, NULL);
@@ -40,6 +34,9 @@ int main()
         return -1;
     }
 
+    // Report GL errors through the debug callback instead of polling glGetError
+    initGLDebugOutput((GLADloadproc)glfwGetProcAddress);
+
     // Create Viewport
     glViewport(0, 0, screen_width, screen_height);
     glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
@@ -74,24 +71,15 @@ int main()
     cuboid_height = cuboid_width / aspect_ratio;
     Cuboid cuboid(cuboid_width, cuboid_height, cuboid_depth);
 
-    // Initialize field plane
-    FieldPlane field_plane(cuboid_width, cuboid_height, field_plane_z);
+    // Versioned GPU buffers, only uploaded when their CPU data changes
+    GpuResourceManager gpu_resources;
 
-    // Setup field rendering VAO
-    unsigned int field_VAO, field_VBO, field_EBO;
-    glGenVertexArrays(1, &field_VAO);
-    glGenBuffers(1, &field_VBO);
-    glGenBuffers(1, &field_EBO);
-
-    glBindVertexArray(field_VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, field_VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(field_plane.vertices), field_plane.vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, field_EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(field_plane.indices), field_plane.indices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    // Initialize field plane slices, starting with a single XY slice through the centre.
+    // Their magnitudes are computed into a shared cache when the dipoles or a slice move.
+    std::vector<std::unique_ptr<FieldSlice>> field_slices;
+    field_slices.push_back(std::make_unique<FieldSlice>(gpu_resources, cuboid_width, cuboid_height, cuboid_depth,
+        FieldPlaneOrientation::XY, 0.0f, field_plane_resolution));
+    FieldSliceCache field_slice_cache;
 
     // Setup cuboid edges VAO
     unsigned int cuboid_VAO, cuboid_VBO, cuboid_EBO;
@@ -108,52 +96,65 @@ int main()
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    labelGLObject(GL_VERTEX_ARRAY, cuboid_VAO, "Cuboid VAO");
+    labelGLObject(GL_BUFFER, cuboid_VBO, "Cuboid VBO");
+    labelGLObject(GL_BUFFER, cuboid_EBO, "Cuboid EBO");
 
-    // Setup field line VAO
-    unsigned int field_line_VAO, field_line_VBO, field_line_EBO;
+    // Setup field line VAO, vertex attributes are pointed at the streaming buffer on first upload
+    unsigned int field_line_VAO;
     glGenVertexArrays(1, &field_line_VAO);
-    glGenBuffers(1, &field_line_VBO);
-    glGenBuffers(1, &field_line_EBO);
+    // Objects only exist once first bound, which labelling requires
+    glBindVertexArray(field_line_VAO);
+    glBindVertexArray(0);
+    labelGLObject(GL_VERTEX_ARRAY, field_line_VAO, "Field line VAO");
+    StreamingBuffer field_line_buffer(fieldLineVertexSize(field_line_vertex_format), "Field line VBO");
+
+    // GPU copy of the dipole store, the backend decides how the bake shader reads it
+    DipoleSourceBuffer dipole_sources;
+    dipole_sources.initialize(gpu_resources);
 
     // Initialize shaders
     Shader field_shader(shader_vert, shader_frag);
     Shader cuboid_shader(cuboid_vert, cuboid_frag);
     Shader field_line_shader(field_line_vert, field_line_frag);
-
-    // Initialize UBO for dipoles
-    unsigned int dipole_ubo;
-    glGenBuffers(1, &dipole_ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, dipole_ubo);
-    const int max_dipoles = 1024;
-    glBufferData(GL_UNIFORM_BUFFER, max_dipoles * sizeof(MagneticDipoleGL), nullptr, GL_STATIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-    // Bind UBO to binding point
-    GLuint block_index = glGetUniformBlockIndex(field_shader.program_ID, "DipoleBuffer");
-    if (block_index == GL_INVALID_INDEX) {
-        std::cerr << "Failed to find uniform block 'DipoleBuffer'" << std::endl;
-        glfwTerminate();
-        return -1;
+    Shader dipole_shader(dipole_vert, dipole_frag);
+    Shader field_bake_shader(field_bake_vert, (dipole_sources.shaderHeader() + field_bake_frag).c_str());
+    labelGLObject(GL_PROGRAM, field_shader.program_ID, "Field plane shader");
+    labelGLObject(GL_PROGRAM, cuboid_shader.program_ID, "Cuboid shader");
+    labelGLObject(GL_PROGRAM, field_line_shader.program_ID, "Field line shader");
+    labelGLObject(GL_PROGRAM, dipole_shader.program_ID, "Dipole shader");
+    labelGLObject(GL_PROGRAM, field_bake_shader.program_ID, "Field plane bake shader");
+
+    // Shared camera matrices, written once per frame
+    CameraUniformBuffer camera_uniforms;
+    camera_uniforms.initialize(gpu_resources);
+    for (Shader* shader : { &field_shader, &cuboid_shader, &field_line_shader, &dipole_shader }) {
+        if (!shader->bind_uniform_block("CameraBlock", CameraUniformBuffer::BINDING)) {
+            std::cerr << "Failed to find uniform block 'CameraBlock'" << std::endl;
+        }
     }
-    glUniformBlockBinding(field_shader.program_ID, block_index, 0);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, dipole_ubo);
 
-    // Reserve vector capacity to prevent reallocation
-    dipoles.reserve(max_dipoles);
-    dipole_visualizers.reserve(max_dipoles);
+    field_shader.use_shader();
+    field_shader.set_int("field_magnitude", 0);
 
-    // Initialize field line tracer
-    std::vector<BaseMagnet*> magnets;
-    for (auto& dipole : dipoles) {
-        magnets.push_back(&dipole);
-    }
+    // Shared dipole mesh, all dipoles in the store are drawn as instances of it
+    DipoleVisualizer dipole_visualizer(
+        dipole_sphere_radius, 0.15f,
+        glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),
+        glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+        glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)
+    );
+    dipole_visualizer.initialize(gpu_resources);
+
+    // Initialize field line tracer, the store acts as a single magnet summing all dipoles
+    std::vector<BaseMagnet*> magnets = { &dipole_store };
     FieldLineTracer tracer(magnets, cuboid_width, cuboid_height, cuboid_depth,
         trace_step_size, trace_max_steps, trace_adaptive_min_step,
         trace_adaptive_max_step, trace_adaptive_field_ref,
         trace_use_adaptive_step, render_field_lines);
     std::vector<FieldLine> fieldLines;
-    std::vector<float> field_line_vertices;
-    std::vector<unsigned int> field_line_indices;
+    FieldLineGeometry field_line_geometry;
+    field_line_geometry.VAO = field_line_VAO;
     bool field_lines_dirty = true; // Flag to indicate when field lines need updating
 
     // Initialize rendering variables
@@ -167,20 +168,40 @@ int main()
     bool last_render_field_lines = render_field_lines;
 
     // Variables for dipole dragging
-    int selected_dipole_index = -1; // -1 means no dipole selected
+    DipoleHandle selected_dipole; // Default handle is invalid, meaning no dipole selected
     DragMode drag_mode = DragMode::None;
     glm::dvec2 drag_start_mouse_pos;
     glm::vec3 drag_start_position;
     glm::quat drag_start_rotation;
 
     // Simulation variables
-    std::vector<glm::vec3> velocities(dipoles.size(), glm::vec3(0.0f)); // Linear velocities
-    std::vector<glm::vec3> angular_velocities(dipoles.size(), glm::vec3(0.0f)); // Angular velocities
     bool step_forward = false;
-    const float dipole_mass = 1.0f; // Mass of each dipole (kg)
-    const float moment_of_inertia = 0.1f; // Moment of inertia (kg·m²)
-    const float force_clamp = 100.0f; // Max force magnitude (N)
-    const float torque_clamp = 10.0f; // Max torque magnitude (N·m)
+    DipoleSimulation simulation;
+    DipoleEnsemble ensemble; // Jittered copies of the scene for parameter studies
+    std::vector<glm::vec3> render_positions; // Dipole poses blended between ticks for drawing
+    std::vector<glm::quat> render_rotations;
+
+    // Recorded simulation frames for replay and scrubbing
+    TrajectoryRecorder trajectory_recorder;
+
+    // Undo/redo history of scene edits, starting from the empty scene
+    SceneHistory scene_history;
+    scene_history.reset(dipole_store);
+
+    // Step through the history, the restored scene replaces any simulation or playback
+    auto step_history = [&](bool redo) {
+        if (!(redo ? scene_history.redo(dipole_store) : scene_history.undo(dipole_store))) {
+            return;
+        }
+        simulate = false;
+        trajectory_playback = false;
+        trajectory_playing = false;
+        if (!dipole_store.isValid(selected_dipole)) {
+            selected_dipole = DipoleHandle();
+            drag_mode = DragMode::None;
+        }
+        field_lines_dirty = true;
+    };
 
     // Random number generator for dipole randomization
     std::random_device rd;
@@ -202,10 +223,15 @@ int main()
     // Start render loop
     while (!glfwWindowShouldClose(window))
     {
-        // Process input
-        processInput(window, selected_dipole_index, drag_mode, drag_start_mouse_pos, drag_start_position, drag_start_rotation);
+        // Process input, a finished dipole drag is one undoable edit
+        DragMode previous_drag_mode = drag_mode;
+        processInput(window, selected_dipole, drag_mode, drag_start_mouse_pos, drag_start_position, drag_start_rotation);
+        if (drag_mode != previous_drag_mode && (previous_drag_mode == DragMode::Move || previous_drag_mode == DragMode::Rotate)) {
+            scene_history.commit(dipole_store, previous_drag_mode == DragMode::Move ? "Move Dipole" : "Rotate Dipole");
+        }
         countFPS();
         updateDeltaTime();
+        gpu_resources.beginFrame();
 
         // Check if UI scale changed
         if (ui_scale != last_ui_scale) {
@@ -263,27 +289,21 @@ int main()
 
         // Update cuboid and field plane size
         if (screen_changed) {
-            updateCuboidDimensions(cuboid, field_plane, cuboid_height, field_VAO, field_VBO, field_EBO, cuboid_VAO, cuboid_VBO, cuboid_EBO);
+            updateCuboidDimensions(cuboid, field_slices, cuboid_height, cuboid_VAO, cuboid_VBO, cuboid_EBO);
             tracer.updateBounds(cuboid_width, cuboid_height, cuboid_depth);
             field_lines_dirty = true;
             screen_changed = false;
         }
 
-        // Update field plane geometry if z-position changed
-        static float last_field_plane_z = field_plane_z;
-        if (field_plane_z != last_field_plane_z) {
-            field_plane.updateZPosition(field_plane_z, cuboid_depth);
-            last_field_plane_z = field_plane_z;
+        // Apply slice settings, planes only regenerate (and upload) if they actually moved
+        for (auto& slice : field_slices) {
+            slice->getPlane().setOrientation(static_cast<FieldPlaneOrientation>(slice->orientation_index), slice->custom_normal);
+            slice->getPlane().setOffset(slice->offset);
+            slice->updateGeometry();
         }
 
-        // Field plane disappearing fix
-        glBindBuffer(GL_ARRAY_BUFFER, field_VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(field_plane.vertices), field_plane.vertices, GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, field_EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(field_plane.indices), field_plane.indices, GL_STATIC_DRAW);
-        glBindVertexArray(0); // Unbind VAO for safety
-
         // Handle dipole dragging and camera dragging
+        int selected_dipole_index = dipole_store.indexOf(selected_dipole);
         if (selected_dipole_index >= 0 && (drag_mode == DragMode::Move || drag_mode == DragMode::Rotate))
         {
             double mouse_x, mouse_y;
@@ -306,7 +326,7 @@ int main()
                     glm::vec3 ray_world = glm::normalize(glm::vec3(glm::inverse(main_camera.getViewMatrix()) * ray_eye));
                     glm::vec3 ray_origin = main_camera.getWorldPosition();
 
-                    glm::vec3 dipole_pos = dipoles[selected_dipole_index].getWorldPosition();
+                    glm::vec3 dipole_pos = dipole_store.getPosition(selected_dipole_index);
                     glm::vec3 plane_normal = main_camera.getForward();
                     float plane_d = -glm::dot(dipole_pos, plane_normal);
 
@@ -324,13 +344,13 @@ int main()
                     float ortho_width = ortho_height * aspect_ratio;
                     glm::vec3 right = main_camera.getRight();
                     glm::vec3 up = main_camera.getUp();
-                    glm::vec3 dipole_pos = dipoles[selected_dipole_index].getWorldPosition();
+                    glm::vec3 dipole_pos = dipole_store.getPosition(selected_dipole_index);
                     glm::vec3 center = main_camera.getWorldPosition() + main_camera.getForward() * 5.0f;
                     glm::vec3 view_plane_pos = center + right * normalized_coords.x * ortho_width + up * normalized_coords.y * ortho_height;
                     new_pos = glm::vec3(view_plane_pos.x, view_plane_pos.y, dipole_pos.z);
                 }
 
-                dipoles[selected_dipole_index].setWorldPosition(new_pos);
+                dipole_store.setPosition(selected_dipole_index, new_pos);
                 field_lines_dirty = true;
             }
             else if (drag_mode == DragMode::Rotate)
@@ -340,11 +360,11 @@ int main()
                 float yaw = (float)delta.x * rotate_sensitivity;
                 float pitch = (float)delta.y * rotate_sensitivity;
 
-                glm::quat current_rotation = dipoles[selected_dipole_index].getWorldRotation();
+                glm::quat current_rotation = dipole_store.getRotation(selected_dipole_index);
                 glm::quat rot_yaw = glm::angleAxis(glm::radians(yaw), main_camera.getUp());
                 glm::quat rot_pitch = glm::angleAxis(glm::radians(-pitch), main_camera.getRight());
                 glm::quat new_rotation = rot_yaw * rot_pitch * current_rotation;
-                dipoles[selected_dipole_index].setWorldRotation(new_rotation);
+                dipole_store.setRotation(selected_dipole_index, new_rotation);
                 field_lines_dirty = true;
 
                 drag_start_mouse_pos = current_mouse_pos;
@@ -398,105 +418,77 @@ int main()
             saved_camera_rotation = main_camera.getWorldRotation();
         }
 
-        // Simulation step
-        if (simulate || step_forward) {
-            // Store current state for history
-            std::vector<DipoleState> current_state;
-            for (const auto& dipole : dipoles) {
-                DipoleState state;
-                state.position = dipole.getWorldPosition();
-                state.rotation = dipole.getWorldRotation();
-                state.moment = dipole.getMoment();
-                current_state.push_back(state);
-            }
+        // The pinned field grid covers the cuboid, it rebuilds lazily when this or a pinned dipole changes
+        dipole_store.setStaticFieldGrid(static_field_grid, glm::vec3(-cuboid_width, -cuboid_height, -cuboid_depth) / 2.0f,
+            glm::vec3(cuboid_width, cuboid_height, cuboid_depth) / 2.0f, static_field_cell_size);
 
-            // Calculate forces and torques
-            std::vector<glm::vec3> forces(dipoles.size(), glm::vec3(0.0f));
-            std::vector<glm::vec3> torques(dipoles.size(), glm::vec3(0.0f));
-            const float h = 0.001f; // Small step for numerical gradient
-            for (size_t i = 0; i < dipoles.size(); ++i) {
-                glm::vec3 pos_i = dipoles[i].getWorldPosition();
-                glm::vec3 m_i = dipoles[i].getMoment() * dipoles[i].getDirection();
-
-                // Calculate total field at dipole i from all other dipoles
-                glm::vec3 B_i(0.0f);
-                for (size_t j = 0; j < dipoles.size(); ++j) {
-                    if (i != j) {
-                        B_i += dipoles[j].calculateMagneticField(pos_i);
-                    }
-                }
+        // Simulating from a replayed frame discards the recorded frames after it
+        if ((simulate || step_forward) && trajectory_playback) {
+            trajectory_recorder.truncate(trajectory_frame);
+            trajectory_playback = false;
+            trajectory_playing = false;
+        }
 
-                // Torque: τ = m_i × B_i
-                torques[i] = glm::cross(m_i, B_i);
-                torques[i] = glm::clamp(torques[i], -torque_clamp, torque_clamp);
-
-                // Force: F_i = ∇(m_i · B)
-                glm::vec3 force(0.0f);
-                for (size_t j = 0; j < dipoles.size(); ++j) {
-                    if (i != j) {
-                        // Numerical gradient of potential energy U = m_i · B_j
-                        glm::vec3 B_xp = dipoles[j].calculateMagneticField(pos_i + glm::vec3(h, 0, 0));
-                        glm::vec3 B_xm = dipoles[j].calculateMagneticField(pos_i - glm::vec3(h, 0, 0));
-                        glm::vec3 B_yp = dipoles[j].calculateMagneticField(pos_i + glm::vec3(0, h, 0));
-                        glm::vec3 B_ym = dipoles[j].calculateMagneticField(pos_i - glm::vec3(0, h, 0));
-                        glm::vec3 B_zp = dipoles[j].calculateMagneticField(pos_i + glm::vec3(0, 0, h));
-                        glm::vec3 B_zm = dipoles[j].calculateMagneticField(pos_i - glm::vec3(0, 0, h));
-
-                        glm::vec3 grad_U;
-                        grad_U.x = (glm::dot(m_i, B_xp) - glm::dot(m_i, B_xm)) / (2.0f * h);
-                        grad_U.y = (glm::dot(m_i, B_yp) - glm::dot(m_i, B_ym)) / (2.0f * h);
-                        grad_U.z = (glm::dot(m_i, B_zp) - glm::dot(m_i, B_zm)) / (2.0f * h);
-
-                        force += grad_U;
-                    }
+        // Simulation ticks, frame time is spent in fixed ticks through the accumulator.
+        // Step Forward runs exactly one tick.
+        if (simulate || step_forward) {
+            simulation.setBounds(glm::vec3(-cuboid_width, -cuboid_height, -cuboid_depth) / 2.0f,
+                glm::vec3(cuboid_width, cuboid_height, cuboid_depth) / 2.0f);
+            int ticks = simulate ? simulation.accumulate(delta_time * simulation_speed) : 1;
+            for (int t = 0; t < ticks; ++t) {
+                simulation.tick(dipole_store, reverse_time);
+                if (record_trajectory) {
+                    trajectory_recorder.setBounds(glm::vec3(-cuboid_width, -cuboid_height, -cuboid_depth) / 2.0f,
+                        glm::vec3(cuboid_width, cuboid_height, cuboid_depth) / 2.0f);
+                    trajectory_recorder.record(dipole_store);
+                    trajectory_frame = static_cast<int>(trajectory_recorder.getLastFrame());
                 }
-                forces[i] = glm::clamp(force, -force_clamp, force_clamp);
             }
-
-            // Update positions and rotations
-            float dt = reverse_time ? -simulation_speed : simulation_speed;
-            dt *= delta_time * 0.1f;
-            for (size_t i = 0; i < dipoles.size(); ++i) {
-                // Update linear velocity and position
-                velocities[i] += (forces[i] / dipole_mass) * static_cast<float>(delta_time);
-                glm::vec3 new_pos = dipoles[i].getWorldPosition() + velocities[i] * dt;
-
-                // Clamp position to cuboid bounds
-                new_pos.x = glm::clamp(new_pos.x, -cuboid_width / 2.0f, cuboid_width / 2.0f);
-                new_pos.y = glm::clamp(new_pos.y, -cuboid_height / 2.0f, cuboid_height / 2.0f);
-                new_pos.z = glm::clamp(new_pos.z, -cuboid_depth / 2.0f, cuboid_depth / 2.0f);
-                dipoles[i].setWorldPosition(new_pos);
-
-                // Update angular velocity and rotation
-                angular_velocities[i] += (torques[i] / moment_of_inertia) * static_cast<float>(delta_time);
-                glm::quat w_dt = glm::quat(0.0f, angular_velocities[i] * dt * 0.5f);
-                glm::quat current_rot = dipoles[i].getWorldRotation();
-                glm::quat new_rot = current_rot + w_dt * current_rot;
-                new_rot = glm::normalize(new_rot);
-                dipoles[i].setWorldRotation(new_rot);
+            if (ticks > 0) {
+                field_lines_dirty = true; // Mark field lines for update
+            }
+        }
+        // Replay recorded frames, one per rendered frame, backwards with Reverse Time
+        else if (trajectory_playing) {
+            int next_frame = trajectory_frame + (reverse_time ? -1 : 1);
+            if (next_frame < static_cast<int>(trajectory_recorder.getFirstFrame()) || next_frame > static_cast<int>(trajectory_recorder.getLastFrame())) {
+                trajectory_playing = false;
+            }
+            else if (trajectory_recorder.seek(next_frame, dipole_store)) {
+                trajectory_frame = next_frame;
+                field_lines_dirty = true;
             }
-
-            field_lines_dirty = true; // Mark field lines for update
         }
 
         // Handle step forward
         if (step_forward) {
             step_forward = false;
+            scene_history.commit(dipole_store, "Step Forward");
+        }
+
+        // An ensemble run advances a substep at a time until the frame's budget is spent, so
+        // a long run keeps the window responsive and can be cancelled part way
+        if (ensemble_remaining > 0.0) {
+            double start_time = glfwGetTime();
+            double substep = std::max(ensemble.getSettings().tick / std::max(ensemble.getSettings().substeps, 1), 1e-6f);
+            do {
+                double slice = std::min(ensemble_remaining, substep);
+                ensemble.advance(static_cast<float>(slice));
+                ensemble_remaining -= slice;
+            } while (ensemble_remaining > 0.0 && glfwGetTime() - start_time < ensemble_frame_budget);
+            ensemble_run_time += glfwGetTime() - start_time;
         }
 
         // Update field lines if necessary
         if (field_lines_dirty || last_trace_use_adaptive_step != trace_use_adaptive_step || last_render_field_lines != render_field_lines) {
             std::cout << "Rendering field lines..." << std::endl;
             if (render_field_lines) {
-                magnets.clear();
-                for (auto& dipole : dipoles) {
-                    magnets.push_back(&dipole);
-                }
                 tracer.setTraceConfig(trace_step_size, trace_max_steps, trace_adaptive_min_step,
                     trace_adaptive_max_step, trace_adaptive_field_ref,
                     trace_use_adaptive_step, render_field_lines);
                 fieldLines = tracer.traceFieldLines();
-                updateFieldLineGeometry(fieldLines, field_line_VAO, field_line_VBO, field_line_EBO, field_line_vertices, field_line_indices);
+                updateFieldLineGeometry(fieldLines, tracer.getBoundsMin(), tracer.getBoundsMax(), field_line_vertex_format,
+                    field_line_VAO, field_line_buffer, field_line_geometry.firsts, field_line_geometry.counts, field_line_geometry.decode);
             }
             field_lines_dirty = false;
             last_trace_use_adaptive_step = trace_use_adaptive_step;
@@ -507,61 +499,38 @@ int main()
         glClearColor(.2f, .3f, .3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Update UBO with dipole data
-        std::vector<MagneticDipoleGL> dipoles_gl(dipoles.size());
-        for (size_t i = 0; i < dipoles.size(); ++i) {
-            dipoles_gl[i].position = dipoles[i].getWorldPosition();
-            dipoles_gl[i].direction = dipoles[i].getDirection();
-            dipoles_gl[i].moment = dipoles[i].getMoment();
+        // Refresh the magnitudes of visible slices if the dipoles or the slice moved
+        for (auto& slice : field_slices) {
+            if (slice->visible) {
+                slice->updateTexture(field_slice_cache, dipole_store, dipole_sources, field_plane_gpu_compute,
+                    field_plane_resolution, PIXELS_PER_METER, field_bake_shader);
+            }
         }
-        glBindBuffer(GL_UNIFORM_BUFFER, dipole_ubo);
-        glBufferData(GL_UNIFORM_BUFFER, max_dipoles * sizeof(MagneticDipoleGL), nullptr, GL_STATIC_DRAW);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, dipoles_gl.size() * sizeof(MagneticDipoleGL), dipoles_gl.data());
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
-        glBindVertexArray(0); // Unbind VAO for safety
-        checkGLError("UBO update");
+
+        // Camera matrices are built once per frame and shared with every program through the camera UBO
+        glm::mat4 view_matrix = main_camera.getViewMatrix();
+        glm::mat4 projection_matrix = main_camera.getProjectionMatrix();
+        camera_uniforms.update(view_matrix, projection_matrix);
 
         // Render dipole visualizers (opaque)
-        for (auto& visualizer : dipole_visualizers) {
-            visualizer.render(main_camera.getViewMatrix(), main_camera.getProjectionMatrix(), cuboid_shader);
+        // Blend between the last two ticks while simulating so motion is smooth at any tick rate
+        if (simulate && interpolate_simulation && simulation.interpolatePoses(dipole_store, render_positions, render_rotations)) {
+            dipole_visualizer.updateInstances(render_positions, render_rotations, dipole_store.indexOf(selected_dipole));
+        }
+        else {
+            dipole_visualizer.updateInstances(dipole_store, dipole_store.indexOf(selected_dipole));
         }
+        dipole_visualizer.render(dipole_shader);
 
-        // Render cuboid edges (opaque)
-        cuboid_shader.use_shader();
-        cuboid_shader.set_vec4("color", cuboid_color);
-        cuboid_shader.set_mat4("view", main_camera.getViewMatrix());
-        cuboid_shader.set_mat4("projection", main_camera.getProjectionMatrix());
-        cuboid_shader.set_mat4("model", glm::mat4(1.0f));
-        glBindVertexArray(cuboid_VAO);
-        glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0); // Unbind VAO for safety
-
-        // Render field lines (opaque)
-        if (render_field_lines && !field_line_indices.empty()) {
-            field_line_shader.use_shader();
-            field_line_shader.set_mat4("view", main_camera.getViewMatrix());
-            field_line_shader.set_mat4("projection", main_camera.getProjectionMatrix());
-            field_line_shader.set_mat4("model", glm::mat4(1.0f));
-            field_line_shader.set_float("sensitivity_scaled", powf(10, field_plane_sensitivity - 1));
-            field_line_shader.set_int("use_color", use_field_line_color ? 1 : 0);
-            glBindVertexArray(field_line_VAO);
-            glDrawElements(GL_LINES, field_line_indices.size(), GL_UNSIGNED_INT, 0);
-            glBindVertexArray(0);
+        // Render cuboid edges and field lines (opaque)
+        drawCuboidPass(cuboid_shader, cuboid_VAO, cuboid_color);
+        if (render_field_lines) {
+            drawFieldLinePass(field_line_shader, field_line_geometry, field_line_buffer, powf(10, field_plane_sensitivity - 1), use_field_line_color);
         }
 
-        // Render magnetic field (transparent, no depth write)
-        field_shader.use_shader();
-        field_shader.set_mat4("view", main_camera.getViewMatrix());
-        field_shader.set_mat4("projection", main_camera.getProjectionMatrix());
-        field_shader.set_int("num_dipoles", (int)dipoles.size());
-        field_shader.set_float("pixels_per_meter", PIXELS_PER_METER);
-        field_shader.set_vec2("resolution", glm::vec2(screen_width, screen_height));
-        field_shader.set_float("plane_opacity", field_plane_opacity);
-        field_shader.set_float("sensitivity_scaled", powf(10, field_plane_sensitivity - 1));
-        glDepthMask(GL_FALSE);
-        glBindVertexArray(field_VAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glDepthMask(GL_TRUE);
+        // Render magnetic field slices (transparent, no depth write), back to front so they blend correctly
+        drawFieldSlicesPass(field_shader, field_slices, main_camera.getWorldPosition(),
+            glm::vec3(cuboid_width, cuboid_height, cuboid_depth) * 0.5f, field_plane_opacity, powf(10, field_plane_sensitivity - 1));
 
         // Start ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -581,9 +550,9 @@ int main()
             glm::vec3 ray_origin, ray_direction;
             if (is_perspective) {
                 glm::vec4 ray_clip = glm::vec4(normalized_coords.x, normalized_coords.y, -1.0f, 1.0f);
-                glm::vec4 ray_eye = glm::inverse(main_camera.getProjectionMatrix()) * ray_clip;
+                glm::vec4 ray_eye = glm::inverse(projection_matrix) * ray_clip;
                 ray_eye = glm::vec4(ray_eye.x, ray_eye.y, -1.0f, 0.0f);
-                ray_direction = glm::normalize(glm::vec3(glm::inverse(main_camera.getViewMatrix()) * ray_eye));
+                ray_direction = glm::normalize(glm::vec3(glm::inverse(view_matrix) * ray_eye));
                 ray_origin = main_camera.getWorldPosition();
             }
             else {
@@ -597,11 +566,10 @@ int main()
             }
 
             float closest_dist = std::numeric_limits<float>::max();
-            const float sphere_radius = 0.04f; // From DipoleVisualizer
-            for (size_t i = 0; i < dipoles.size(); ++i) {
-                glm::vec3 dipole_pos = dipoles[i].getWorldPosition();
+            for (size_t i = 0; i < dipole_store.size(); ++i) {
+                glm::vec3 dipole_pos = dipole_store.getPosition(i);
                 float dist;
-                if (glm::intersectRaySphere(ray_origin, ray_direction, dipole_pos, sphere_radius * sphere_radius, dist)) {
+                if (glm::intersectRaySphere(ray_origin, ray_direction, dipole_pos, dipole_sphere_radius * dipole_sphere_radius, dist)) {
                     if (dist < closest_dist) {
                         closest_dist = dist;
                         hovered_dipole_index = i;
@@ -614,15 +582,13 @@ int main()
         if (show_labels) {
             ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(0.0f, 0.0f, 0.0f, 0.5f)); // Semi-transparent black background
             ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0.0f); // No border
-            for (size_t i = 0; i < dipoles.size(); ++i) {
+            for (size_t i = 0; i < dipole_store.size(); ++i) {
                 if (show_labels_on_hover && static_cast<int>(i) != hovered_dipole_index) {
                     continue;
                 }
 
-                glm::vec3 dipole_pos = dipoles[i].getWorldPosition();
-                glm::mat4 view = main_camera.getViewMatrix();
-                glm::mat4 proj = main_camera.getProjectionMatrix();
-                glm::vec4 clip_pos = proj * view * glm::vec4(dipole_pos, 1.0f);
+                glm::vec3 dipole_pos = dipole_store.getPosition(i);
+                glm::vec4 clip_pos = projection_matrix * view_matrix * glm::vec4(dipole_pos, 1.0f);
                 if (clip_pos.w <= 0.0f) continue; // Behind camera, skip
 
                 glm::vec3 ndc = glm::vec3(clip_pos) / clip_pos.w;
@@ -644,7 +610,7 @@ int main()
                     ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove |
                     ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_AlwaysAutoResize);
 
-                ImGui::Text("%d", i + 1);
+                ImGui::Text("%zu", i + 1);
                 ImGui::End();
             }
             ImGui::PopStyleVar();
@@ -652,10 +618,11 @@ int main()
         }
 
         ImGui::Begin("Magnetic Field Visualiser");
-        ImGui::Text("Drag Anywhere - Rotate\nScroll - Zoom\nCTRL + Drag - Move Object or Pan Camera\nALT + Drag - Rotate Object\nESC - Exit");
+        ImGui::Text("Drag Anywhere - Rotate\nScroll - Zoom\nCTRL + Drag - Move Object or Pan Camera\nALT + Drag - Rotate Object\nCTRL + Z / CTRL + Y - Undo / Redo\nESC - Exit");
         ImGui::Separator();
         ImGui::Text("Camera Settings");
         ImGui::Text("FPS: %.1f", 1.0f / delta_time);
+        ImGui::Text("GPU Buffer Uploads: %d (%zu bytes)", gpu_resources.getFrameUploadCount(), gpu_resources.getFrameUploadBytes());
         ImGui::SliderFloat("FOV", &fov, 30.0f, 120.0f, "%.1f");
         ImGui::Checkbox("Perspective Mode", &is_perspective);
         if (ImGui::Button("Reset Camera")) {
@@ -680,14 +647,48 @@ int main()
 
         ImGui::Separator();
         ImGui::Text("Field Plane Settings");
-        ImGui::SliderFloat("Z Position", &field_plane_z, -1.0f, 1.0f, "%.2f");
+        int remove_slice_index = -1;
+        for (size_t i = 0; i < field_slices.size(); ++i) {
+            FieldSlice& slice = *field_slices[i];
+            ImGui::PushID(static_cast<int>(i));
+            ImGui::Text("Slice %zu", i + 1);
+            ImGui::SameLine();
+            ImGui::Checkbox("Visible", &slice.visible);
+            ImGui::SameLine();
+            if (ImGui::Button("Remove")) {
+                remove_slice_index = static_cast<int>(i);
+            }
+            ImGui::Combo("Orientation", &slice.orientation_index, "XY\0YZ\0XZ\0Custom\0");
+            if (slice.orientation_index == static_cast<int>(FieldPlaneOrientation::Custom)) {
+                ImGui::SliderFloat3("Normal", &slice.custom_normal.x, -1.0f, 1.0f, "%.2f");
+            }
+            ImGui::SliderFloat("Offset", &slice.offset, -1.0f, 1.0f, "%.2f");
+            ImGui::PopID();
+        }
+        if (remove_slice_index >= 0) {
+            field_slices.erase(field_slices.begin() + remove_slice_index);
+        }
+        if (ImGui::Button("Add Slice")) {
+            field_slices.push_back(std::make_unique<FieldSlice>(gpu_resources, cuboid_width, cuboid_height, cuboid_depth,
+                FieldPlaneOrientation::XY, 0.0f, field_plane_resolution));
+        }
+        ImGui::Text("Slice Cache: %zu entries, %llu hits, %llu partial, %llu misses", field_slice_cache.size(),
+            (unsigned long long)field_slice_cache.getHits(), (unsigned long long)field_slice_cache.getPartialHits(),
+            (unsigned long long)field_slice_cache.getMisses());
         ImGui::SliderFloat("Opacity", &field_plane_opacity, 0.0f, 1.0f, "%.2f");
         ImGui::SliderFloat("Sensitivity", &field_plane_sensitivity, -5.0f, 5.0f, "%.2f");
+        ImGui::SliderInt("Resolution", &field_plane_resolution, 64, 2048);
+        ImGui::Checkbox("Compute Field Plane on GPU", &field_plane_gpu_compute);
 
         ImGui::Separator();
         ImGui::Text("Field Line Settings");
         ImGui::Checkbox("Render Field Lines", &render_field_lines);
         ImGui::Checkbox("Use Colored Field Lines", &use_field_line_color);
+        bool compact_field_lines = field_line_vertex_format == FieldLineVertexFormat::Compact;
+        if (ImGui::Checkbox("Compact Field Line Vertices", &compact_field_lines)) {
+            field_line_vertex_format = compact_field_lines ? FieldLineVertexFormat::Compact : FieldLineVertexFormat::Float;
+            field_lines_dirty = true;
+        }
         ImGui::Checkbox("Use Adaptive Step Size", &trace_use_adaptive_step);
         ImGui::SliderFloat("Step Size", &trace_step_size, 0.001f, 0.1f, "%.3f");
         ImGui::InputInt("Max Steps", &trace_max_steps, 100, 1000);
@@ -704,6 +705,27 @@ int main()
         if (ImGui::Button("Retrace Field Lines")) {
             field_lines_dirty = true;
         }
+        // Traces again with the current settings, streaming lines to disk instead of keeping them
+        ImGui::InputText("Export File", field_line_export_path, sizeof(field_line_export_path));
+        if (ImGui::Button("Export Field Lines")) {
+            exportFieldLines(tracer, field_line_export_path);
+        }
+        // Pinned dipoles are precomputed as one static field for the tracer and the simulation
+        if (ImGui::Checkbox("Static Field Grid", &static_field_grid)) {
+            field_lines_dirty = true;
+        }
+        if (static_field_grid) {
+            if (ImGui::SliderFloat("Static Cell Size", &static_field_cell_size, 0.05f, 1.0f, "%.2f")) {
+                field_lines_dirty = true;
+            }
+            if (const StaticFieldGrid* static_field = dipole_store.getStaticField()) {
+                ImGui::Text("%zu pinned, %zu cells, %.1f KB", static_field->getSourceCount(), static_field->getCellCount(),
+                    static_field->getByteSize() / 1024.0f);
+            }
+            else {
+                ImGui::Text("Grid not ready, pinned dipoles summed directly");
+            }
+        }
         ImGui::Separator();
 
         ImGui::Text("Simulation Settings");
@@ -711,13 +733,14 @@ int main()
         if (!simulate) {
             if (ImGui::Button("Start Simulation")) {
                 simulate = true;
-                velocities.assign(dipoles.size(), glm::vec3(0.0f));
-                angular_velocities.assign(dipoles.size(), glm::vec3(0.0f));
+                dipole_store.resetVelocities();
+                simulation.reset();
             }
         }
         else {
             if (ImGui::Button("Stop Simulation")) {
                 simulate = false;
+                scene_history.commit(dipole_store, "Simulation");
             }
         }
         ImGui::SameLine();
@@ -725,24 +748,211 @@ int main()
         if (ImGui::Button("Step Forward")) {
             step_forward = true;
         }
+        SimulationSettings& simulation_settings = simulation.getSettings();
+        int integrator_index = static_cast<int>(simulation_settings.integrator);
+        if (ImGui::Combo("Integrator", &integrator_index, "Explicit Euler\0Symplectic Euler\0Velocity Verlet\0RKMK4\0")) {
+            simulation_settings.integrator = static_cast<SimulationIntegrator>(integrator_index);
+        }
+        ImGui::SliderFloat("Tick (s)", &simulation_settings.tick, 0.001f, 0.1f, "%.4f", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderInt("Substeps per Tick", &simulation_settings.substeps, 1, 32);
+        ImGui::SliderInt("Max Ticks per Frame", &simulation_settings.max_ticks_per_frame, 1, 32);
+        if (simulation_settings.integrator == SimulationIntegrator::VelocityVerlet) {
+            // Individual steps, only dipoles in close encounters are subcycled
+            ImGui::Checkbox("Adaptive Block Steps", &simulation_settings.adaptive);
+            if (simulation_settings.adaptive) {
+                ImGui::SliderFloat("Error Tolerance", &simulation_settings.adaptive_tolerance, 1e-7f, 1e-2f, "%.1e", ImGuiSliderFlags_Logarithmic);
+                ImGui::SliderInt("Max Block Levels", &simulation_settings.max_block_levels, 0, 10);
+                const std::vector<int>& levels = simulation.getBlockLevels();
+                int finest_level = levels.empty() ? 0 : *std::max_element(levels.begin(), levels.end());
+                size_t subcycled = std::count_if(levels.begin(), levels.end(), [](int level) { return level > 0; });
+                ImGui::Text("%zu subcycled, finest 1/%d substep", subcycled, 1 << finest_level);
+            }
+        }
+        // Near field exact from neighbour lists, far field from aggregated grid cells
+        ImGui::Checkbox("Neighbour Lists", &simulation_settings.neighbour_lists);
+        if (simulation_settings.neighbour_lists) {
+            ImGui::SliderFloat("Near Cutoff", &simulation_settings.neighbour_cutoff, 0.05f, 2.0f, "%.2f");
+            ImGui::SliderFloat("List Skin", &simulation_settings.neighbour_skin, 0.0f, 0.5f, "%.2f");
+            // RESPA, far forces are re-evaluated once every interval substeps
+            if (simulation_settings.integrator == SimulationIntegrator::VelocityVerlet && !simulation_settings.adaptive) {
+                ImGui::SliderInt("Far Field Interval", &simulation_settings.far_field_interval, 1, 16);
+            }
+            const DipoleNeighbourGrid& grid = simulation.getNeighbourGrid();
+            ImGui::Text("%zu cells in %zu levels, %.1f neighbours/dipole, %llu rebuilds", grid.getCellCount(), grid.getLevelCount(),
+                grid.getAverageNeighbours(), (unsigned long long)grid.getRebuildCount());
+        }
+        // Resting islands stop integrating, their field is cached for the dipoles still moving
+        ImGui::Checkbox("Sleeping", &simulation_settings.sleeping);
+        if (simulation_settings.sleeping) {
+            ImGui::SliderFloat("Sleep Speed", &simulation_settings.sleep_velocity, 1e-4f, 1.0f, "%.4f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("Sleep Angular Speed", &simulation_settings.sleep_angular_velocity, 1e-4f, 1.0f, "%.4f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("Sleep Time (s)", &simulation_settings.sleep_time, 0.05f, 5.0f, "%.2f");
+            ImGui::SliderFloat("Island Radius", &simulation_settings.island_radius, 0.05f, 2.0f, "%.2f");
+            ImGui::SliderFloat("Field Refresh", &simulation_settings.sleep_field_refresh, 1e-4f, 0.1f, "%.4f", ImGuiSliderFlags_Logarithmic);
+            ImGui::Text("%zu asleep, %zu islands", simulation.getSleepingCount(), simulation.getIslandCount());
+        }
+        if (simulation.getBodyCount() > 0) {
+            ImGui::Text("%zu rigid bodies", simulation.getBodyCount());
+        }
+        ImGui::Checkbox("Interpolate Rendering", &interpolate_simulation);
+        ImGui::Text("%llu ticks, %.2f s dropped, %llu force evaluations/tick", (unsigned long long)simulation.getTickCount(),
+            simulation.getDroppedTime(), (unsigned long long)simulation.getForceEvaluations());
+
+        // Ensemble runs copies of the scene from jittered starts side by side, scene 0 is
+        // the scene as it is. Any scene's end state can be brought back into the editor.
+        ImGui::Text("Ensemble");
+        ImGui::SliderInt("Scenes", &ensemble_scenes, 1, 4096, "%d", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Ensemble Duration (s)", &ensemble_duration, 0.1f, 60.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Position Jitter", &ensemble_position_jitter, 0.0f, 0.5f, "%.3f");
+        ImGui::SliderFloat("Rotation Jitter", &ensemble_rotation_jitter, 0.0f, static_cast<float>(PI), "%.2f");
+        ImGui::BeginDisabled(ensemble_remaining > 0.0);
+        if (ImGui::Button("Run Ensemble")) {
+            ensemble.getSettings() = simulation_settings;
+            ensemble.setBounds(glm::vec3(-cuboid_width, -cuboid_height, -cuboid_depth) / 2.0f,
+                glm::vec3(cuboid_width, cuboid_height, cuboid_depth) / 2.0f);
+            double start_time = glfwGetTime();
+            ensemble.reset(dipole_store, ensemble_scenes, ensemble_position_jitter, ensemble_rotation_jitter, gen());
+            ensemble_run_time = glfwGetTime() - start_time;
+            ensemble_remaining = ensemble.getSceneCount() > 0 ? ensemble_duration : 0.0;
+            ensemble_scene = 0;
+        }
+        ImGui::EndDisabled();
+        if (ensemble_remaining > 0.0) {
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel Ensemble")) {
+                ensemble_remaining = 0.0;
+            }
+        }
+        if (ensemble.getSceneCount() > 0) {
+            ImGui::SameLine();
+            if (ImGui::Button("Lowest Energy")) {
+                for (size_t k = 0; k < ensemble.getSceneCount(); ++k) {
+                    if (ensemble.getKineticEnergy(k) + ensemble.getPotentialEnergy(k)
+                        < ensemble.getKineticEnergy(ensemble_scene) + ensemble.getPotentialEnergy(ensemble_scene)) {
+                        ensemble_scene = static_cast<int>(k);
+                    }
+                }
+            }
+            if (ensemble_remaining > 0.0) {
+                ImGui::ProgressBar(static_cast<float>(ensemble.getTime() / (ensemble.getTime() + ensemble_remaining)));
+            }
+            ImGui::Text("%zu scenes of %zu dipoles, %.2f s simulated in %.0f ms", ensemble.getSceneCount(), ensemble.getDipoleCount(),
+                ensemble.getTime(), ensemble_run_time * 1000.0);
+            ImGui::SliderInt("Ensemble Scene", &ensemble_scene, 0, static_cast<int>(ensemble.getSceneCount()) - 1);
+            ensemble_scene = std::min(std::max(ensemble_scene, 0), static_cast<int>(ensemble.getSceneCount()) - 1);
+            ImGui::Text("Kinetic %.4g, potential %.4g, max speed %.4g m/s", ensemble.getKineticEnergy(ensemble_scene),
+                ensemble.getPotentialEnergy(ensemble_scene), ensemble.getMaxSpeed(ensemble_scene));
+            ImGui::BeginDisabled(ensemble.getDipoleCount() != dipole_store.size());
+            if (ImGui::Button("Show Scene") && ensemble.copyScene(ensemble_scene, dipole_store)) {
+                simulate = false;
+                scene_history.commit(dipole_store, "Show Ensemble Scene");
+                field_lines_dirty = true;
+            }
+            ImGui::EndDisabled();
+        }
+
+        ImGui::Text("Trajectory");
+        ImGui::Checkbox("Record Trajectory", &record_trajectory);
+        if (!trajectory_recorder.empty()) {
+            // Scrubbing pauses the simulation and shows the recorded frame
+            if (ImGui::SliderInt("Frame", &trajectory_frame, static_cast<int>(trajectory_recorder.getFirstFrame()),
+                static_cast<int>(trajectory_recorder.getLastFrame())) && trajectory_recorder.seek(trajectory_frame, dipole_store)) {
+                simulate = false;
+                trajectory_playback = true;
+                field_lines_dirty = true;
+            }
+            if (ImGui::Button(trajectory_playing ? "Pause Playback" : "Play Back")) {
+                trajectory_playing = !trajectory_playing;
+                if (trajectory_playing) {
+                    simulate = false;
+                    trajectory_playback = true;
+                    // Restart from the far end if already at the end being played towards
+                    int end_frame = static_cast<int>(reverse_time ? trajectory_recorder.getFirstFrame() : trajectory_recorder.getLastFrame());
+                    if (trajectory_frame == end_frame) {
+                        trajectory_frame = static_cast<int>(reverse_time ? trajectory_recorder.getLastFrame() : trajectory_recorder.getFirstFrame());
+                        trajectory_recorder.seek(trajectory_frame, dipole_store);
+                        field_lines_dirty = true;
+                    }
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Clear Trajectory")) {
+                trajectory_recorder.clear();
+                trajectory_playback = false;
+                trajectory_playing = false;
+                trajectory_frame = 0;
+            }
+            ImGui::Text("%llu frames, %.1f KB, %.1f bytes/dipole/frame", (unsigned long long)trajectory_recorder.getFrameCount(),
+                trajectory_recorder.getByteSize() / 1024.0f, trajectory_recorder.getBytesPerDipoleFrame());
+        }
+        ImGui::InputText("Trajectory File", trajectory_file_path, sizeof(trajectory_file_path));
+        if (ImGui::Button("Save Trajectory")) {
+            trajectory_recorder.saveToFile(trajectory_file_path);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Load Trajectory") && trajectory_recorder.loadFromFile(trajectory_file_path)) {
+            simulate = false;
+            trajectory_playing = false;
+            trajectory_frame = static_cast<int>(trajectory_recorder.getFirstFrame());
+            trajectory_playback = trajectory_recorder.seek(trajectory_frame, dipole_store);
+            selected_dipole = DipoleHandle();
+            drag_mode = DragMode::None;
+            field_lines_dirty = true;
+        }
         ImGui::End();
 
         ImGui::Begin("Object List");
+        // Ctrl+Z undoes, Ctrl+Y or Ctrl+Shift+Z redoes, unless a text field has the keyboard
+        bool undo_shortcut = false, redo_shortcut = false;
+        if (!ImGui::GetIO().WantTextInput) {
+            undo_shortcut = ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_Z);
+            redo_shortcut = ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_Y) || ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiMod_Shift | ImGuiKey_Z);
+        }
+        ImGui::BeginDisabled(!scene_history.canUndo());
+        if (ImGui::Button("Undo") || (undo_shortcut && scene_history.canUndo())) {
+            step_history(false);
+        }
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::BeginDisabled(!scene_history.canRedo());
+        if (ImGui::Button("Redo") || (redo_shortcut && scene_history.canRedo())) {
+            step_history(true);
+        }
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::Text("%s | %s (%zu/%zu, %.1f KB)", scene_history.getUndoLabel().c_str(), scene_history.getRedoLabel().c_str(),
+            scene_history.getCurrentIndex() + 1, scene_history.getVersionCount(), scene_history.getByteSize() / 1024.0f);
+
         if (ImGui::Button("Add Dipole")) {
-            dipoles.emplace_back(
+            // Point along +Y, the forward (-Z) axis is rotated onto the direction
+            dipole_store.add(
                 glm::vec3(0.0f, 0.0f, 0.0f),
-                glm::vec3(0.0f, 1.0f, 0.0f),
+                glm::quatLookAt(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
                 1.0f
             );
-            dipole_visualizers.emplace_back(
-                0.04f, 0.15f, &dipoles.back(),
-                glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),
-                glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
-                glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)
-            );
-            dipole_visualizers.back().initialize();
-            velocities.push_back(glm::vec3(0.0f));
-            angular_velocities.push_back(glm::vec3(0.0f));
+            scene_history.commit(dipole_store, "Add Dipole");
+            field_lines_dirty = true;
+        }
+        // A bar magnet is a grid of dipoles along +Y sharing one body id, laid out like
+        // BarMagnet, so the simulation moves it as one rigid body
+        ImGui::InputFloat3("Bar Size (m)", &bar_magnet_size.x);
+        ImGui::InputFloat("Bar Density", &bar_magnet_density, 1.0f, 10.0f);
+        ImGui::InputFloat("Bar Moment", &bar_magnet_moment, 0.05f, 0.25f);
+        if (ImGui::Button("Add Bar Magnet")) {
+            glm::vec3 size = glm::max(bar_magnet_size, glm::vec3(0.001f));
+            glm::ivec3 counts = glm::clamp(glm::ivec3(size * std::max(bar_magnet_density, 0.001f)), glm::ivec3(1), glm::ivec3(64));
+            glm::vec3 spacing = size / glm::vec3(counts);
+            glm::quat rotation = glm::quatLookAt(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+            uint32_t body = dipole_store.createBodyId();
+            for (int x = 0; x < counts.x; ++x) {
+                for (int y = 0; y < counts.y; ++y) {
+                    for (int z = 0; z < counts.z; ++z) {
+                        glm::vec3 position = (glm::vec3(x, y, z) + 0.5f) * spacing - size * 0.5f;
+                        dipole_store.add(position, rotation, bar_magnet_moment, DipoleFlags_None, body);
+                    }
+                }
+            }
+            scene_history.commit(dipole_store, "Add Bar Magnet");
             field_lines_dirty = true;
         }
         if (ImGui::Button("Randomize Dipoles")) {
@@ -751,10 +961,9 @@ int main()
             std::uniform_real_distribution<float> dist_pos_z(-cuboid_depth / 2.0f, cuboid_depth / 2.0f);
             std::uniform_real_distribution<float> dist_rot(0.0f, 1.0f);
 
-            for (auto& dipole : dipoles) {
+            for (size_t i = 0; i < dipole_store.size(); ++i) {
                 // Random position
                 glm::vec3 new_pos(dist_pos_x(gen), dist_pos_y(gen), dist_pos_z(gen));
-                dipole.setWorldPosition(new_pos);
 
                 // Random rotation (uniform quaternion)
                 float u1 = dist_rot(gen);
@@ -768,68 +977,85 @@ int main()
                     sqrt_u1 * std::sin(2.0f * PI * u3),
                     sqrt_u1 * std::cos(2.0f * PI * u3)
                 );
-                dipole.setWorldRotation(random_rot);
+                dipole_store.setPose(i, new_pos, random_rot);
             }
+            scene_history.commit(dipole_store, "Randomize Dipoles");
+            field_lines_dirty = true;
+        }
+
+        // Scene files, .json for the readable format and binary otherwise
+        ImGui::InputText("Scene File", scene_file_path, sizeof(scene_file_path));
+        if (ImGui::Button("Save Scene")) {
+            saveScene(scene_file_path, dipole_store);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Load Scene") && loadScene(scene_file_path, dipole_store)) {
+            scene_history.commit(dipole_store, "Load Scene");
+            selected_dipole = DipoleHandle();
+            drag_mode = DragMode::None;
             field_lines_dirty = true;
         }
 
         ImGui::Checkbox("Show Labels", &show_labels);
         ImGui::Checkbox("Show Labels on Hover", &show_labels_on_hover);
 
-        for (size_t i = 0; i < dipoles.size(); ++i) {
+        for (size_t i = 0; i < dipole_store.size(); ++i) {
             ImGui::PushID(i);
-            ImGui::Text("Dipole %d", i + 1);
+            if (dipole_store.getBody(i) != NO_BODY) {
+                ImGui::Text("Dipole %zu (Body %u)", i + 1, dipole_store.getBody(i));
+            }
+            else {
+                ImGui::Text("Dipole %zu", i + 1);
+            }
 
-            glm::vec3 pos = dipoles[i].getWorldPosition();
+            glm::vec3 pos = dipole_store.getPosition(i);
             float pos_array[3] = { pos.x, pos.y, pos.z };
             if (ImGui::InputFloat3("Position", pos_array)) {
-                dipoles[i].setWorldPosition(glm::vec3(pos_array[0], pos_array[1], pos_array[2]));
+                dipole_store.setPosition(i, glm::vec3(pos_array[0], pos_array[1], pos_array[2]));
                 field_lines_dirty = true;
             }
+            // Fields apply while typing, the edit is recorded once the field loses focus
+            if (ImGui::IsItemDeactivatedAfterEdit()) {
+                scene_history.commit(dipole_store, "Move Dipole");
+            }
 
-            glm::vec3 euler = glm::degrees(glm::eulerAngles(dipoles[i].getWorldRotation()));
+            glm::vec3 euler = glm::degrees(glm::eulerAngles(dipole_store.getRotation(i)));
             float euler_array[3] = { euler.x, euler.y, euler.z };
             if (ImGui::InputFloat3("Rotation (Euler)", euler_array)) {
-                dipoles[i].setWorldRotationEuler(glm::vec3(euler_array[0], euler_array[1], euler_array[2]));
+                dipole_store.setRotation(i, glm::quat(glm::radians(glm::vec3(euler_array[0], euler_array[1], euler_array[2]))));
                 field_lines_dirty = true;
             }
+            if (ImGui::IsItemDeactivatedAfterEdit()) {
+                scene_history.commit(dipole_store, "Rotate Dipole");
+            }
 
-            float moment = dipoles[i].getMoment();
+            float moment = dipole_store.getMoment(i);
             if (ImGui::InputFloat("Moment", &moment, 0.25, 1.0)) {
-                dipoles[i].setMoment(moment);
+                dipole_store.setMoment(i, moment);
+                field_lines_dirty = true;
+            }
+            if (ImGui::IsItemDeactivatedAfterEdit()) {
+                scene_history.commit(dipole_store, "Change Moment");
+            }
+
+            // Pinned dipoles stay put in the simulation and feed the static field grid
+            bool pinned = (dipole_store.getFlags(i) & DipoleFlags_Pinned) != 0;
+            if (ImGui::Checkbox("Pinned", &pinned)) {
+                dipole_store.setFlags(i, (dipole_store.getFlags(i) & ~DipoleFlags_Pinned) | (pinned ? DipoleFlags_Pinned : DipoleFlags_None));
+                scene_history.commit(dipole_store, pinned ? "Pin Dipole" : "Unpin Dipole");
                 field_lines_dirty = true;
             }
 
             if (ImGui::Button("Remove Dipole")) {
-                if (dipoles.size() != dipole_visualizers.size()) {
-                    std::cerr << "Error: dipoles and dipole_visualizers sizes mismatch!" << std::endl;
-                }
-                else {
-                    if (i < dipoles.size() - 1) {
-                        std::swap(dipoles[i], dipoles.back());
-                        std::swap(dipole_visualizers[i], dipole_visualizers.back());
-                        dipole_visualizers[i].setParent(&dipoles[i]);
-                        std::swap(velocities[i], velocities.back());
-                        std::swap(angular_velocities[i], angular_velocities.back());
-                    }
-                    dipoles.pop_back();
-                    dipole_visualizers.pop_back();
-                    velocities.pop_back();
-                    angular_velocities.pop_back();
-                    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-                    glBindVertexArray(0);
-                    glBindBuffer(GL_ARRAY_BUFFER, 0);
-                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-                    checkGLError("After dipole removal");
-                }
-                if (selected_dipole_index == i) {
-                    selected_dipole_index = -1;
+                // The last dipole moves into this index, so revisit it next iteration
+                DipoleHandle handle = dipole_store.handleAt(i);
+                dipole_store.remove(handle);
+                if (selected_dipole == handle) {
+                    selected_dipole = DipoleHandle();
                     drag_mode = DragMode::None;
                 }
-                else if (selected_dipole_index > i) {
-                    --selected_dipole_index;
-                }
                 --i;
+                scene_history.commit(dipole_store, "Remove Dipole");
                 field_lines_dirty = true;
             }
 
@@ -853,23 +1079,21 @@ int main()
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
-    dipoles.clear();
-    dipole_visualizers.clear();
+    dipole_store.clear();
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    glDeleteVertexArrays(1, &field_VAO);
-    glDeleteBuffers(1, &field_VBO);
-    glDeleteBuffers(1, &field_EBO);
+    field_slices.clear();
+    dipole_visualizer.release();
+    dipole_sources.release();
+    field_line_buffer.release();
+    gpu_resources.release();
     glDeleteVertexArrays(1, &cuboid_VAO);
     glDeleteBuffers(1, &cuboid_VBO);
     glDeleteBuffers(1, &cuboid_EBO);
     glDeleteVertexArrays(1, &field_line_VAO);
-    glDeleteBuffers(1, &field_line_VBO);
-    glDeleteBuffers(1, &field_line_EBO);
-    glDeleteBuffers(1, &dipole_ubo);
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -911,7 +1135,7 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 }
 
 /* Window input event callback function */
-void processInput(GLFWwindow* window, int& selected_dipole_index, DragMode& drag_mode, glm::dvec2& drag_start_mouse_pos, glm::vec3& drag_start_position, glm::quat& drag_start_rotation)
+void processInput(GLFWwindow* window, DipoleHandle& selected_dipole, DragMode& drag_mode, glm::dvec2& drag_start_mouse_pos, glm::vec3& drag_start_position, glm::quat& drag_start_rotation)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
@@ -958,15 +1182,14 @@ void processInput(GLFWwindow* window, int& selected_dipole_index, DragMode& drag
                 ray_direction = glm::vec3(0.0f, 0.0f, -1.0f); // Ray travels along negative Z-axis
             }
 
-            selected_dipole_index = -1;
+            int selected_dipole_index = -1;
             float closest_dist = std::numeric_limits<float>::max();
-            const float sphere_radius = 0.04f; // From DipoleVisualizer
 
-            for (size_t i = 0; i < dipoles.size(); ++i)
+            for (size_t i = 0; i < dipole_store.size(); ++i)
             {
-                glm::vec3 dipole_pos = dipoles[i].getWorldPosition();
+                glm::vec3 dipole_pos = dipole_store.getPosition(i);
                 float dist;
-                if (glm::intersectRaySphere(ray_origin, ray_direction, dipole_pos, sphere_radius * sphere_radius, dist))
+                if (glm::intersectRaySphere(ray_origin, ray_direction, dipole_pos, dipole_sphere_radius * dipole_sphere_radius, dist))
                 {
                     if (dist < closest_dist)
                     {
@@ -975,6 +1198,7 @@ void processInput(GLFWwindow* window, int& selected_dipole_index, DragMode& drag
                     }
                 }
             }
+            selected_dipole = selected_dipole_index >= 0 ? dipole_store.handleAt(selected_dipole_index) : DipoleHandle();
 
             // Dragging a dipole
             if (selected_dipole_index >= 0)
@@ -982,29 +1206,29 @@ void processInput(GLFWwindow* window, int& selected_dipole_index, DragMode& drag
                 if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
                 {
                     drag_mode = DragMode::Move;
-                    drag_start_position = dipoles[selected_dipole_index].getWorldPosition();
+                    drag_start_position = dipole_store.getPosition(selected_dipole_index);
                 }
                 else if (glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS)
                 {
                     drag_mode = DragMode::Rotate;
-                    drag_start_rotation = dipoles[selected_dipole_index].getWorldRotation();
+                    drag_start_rotation = dipole_store.getRotation(selected_dipole_index);
                 }
                 else
                 {
                     drag_mode = DragMode::None;
-                    selected_dipole_index = -1;
+                    selected_dipole = DipoleHandle();
                 }
             }
             // Draggin the camera
             else if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
             {
                 drag_mode = DragMode::CameraDrag;
-                selected_dipole_index = -1;
+                selected_dipole = DipoleHandle();
             }
             else
             {
                 drag_mode = DragMode::None;
-                selected_dipole_index = -1;
+                selected_dipole = DipoleHandle();
             }
         }
     }
@@ -1013,7 +1237,7 @@ void processInput(GLFWwindow* window, int& selected_dipole_index, DragMode& drag
         if (is_dragging)
         {
             is_dragging = false;
-            selected_dipole_index = -1;
+            selected_dipole = DipoleHandle();
             drag_mode = DragMode::None;
         }
     }
@@ -1041,23 +1265,19 @@ void updateDeltaTime()
 }
 
 /* Cuboid dimension updater function */
-void updateCuboidDimensions(Cuboid& cuboid, FieldPlane& field_plane, float cuboid_height, unsigned int field_VAO, unsigned int field_VBO, unsigned int field_EBO, unsigned int cuboid_VAO, unsigned int cuboid_VBO, unsigned int cuboid_EBO)
+void updateCuboidDimensions(Cuboid& cuboid, std::vector<std::unique_ptr<FieldSlice>>& field_slices, float cuboid_height, unsigned int cuboid_VAO, unsigned int cuboid_VBO, unsigned int cuboid_EBO)
 {
+    GLDebugScope scope("Cuboid dimension update");
     cuboid.updateDimensions(cuboid_width, cuboid_height, cuboid_depth);
-    field_plane.updateDimensions(cuboid_width, cuboid_height, cuboid_depth);
+    for (auto& slice : field_slices) {
+        slice->getPlane().updateBounds(cuboid_width, cuboid_height, cuboid_depth);
+    }
 
     glBindBuffer(GL_ARRAY_BUFFER, cuboid_VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cuboid.edge_vertices), cuboid.edge_vertices, GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cuboid_EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cuboid.edge_indices), cuboid.edge_indices, GL_STATIC_DRAW);
 
-    glBindVertexArray(field_VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, field_VBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, field_EBO);
-    glBindVertexArray(0);
-
     glBindVertexArray(cuboid_VAO);
     glBindBuffer(GL_ARRAY_BUFFER, cuboid_VBO);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
@@ -1068,46 +1288,3 @@ void updateCuboidDimensions(Cuboid& cuboid, FieldPlane& field_plane, float cuboi
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
-
-/* Function to update field line geometry */
-void updateFieldLineGeometry(const std::vector<FieldLine>& fieldLines, unsigned int& field_line_VAO, unsigned int& field_line_VBO, unsigned int& field_line_EBO, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
-    vertices.clear();
-    indices.clear();
-    unsigned int vertexOffset = 0;
-
-    for (const auto& line : fieldLines) {
-        if (line.points.size() < 2) continue;
-        for (size_t i = 0; i < line.points.size(); ++i) {
-            const auto& point = line.points[i];
-            vertices.push_back(point.position.x);
-            vertices.push_back(point.position.y);
-            vertices.push_back(point.position.z);
-            vertices.push_back(point.field.x);
-            vertices.push_back(point.field.y);
-            vertices.push_back(point.field.z);
-
-            if (i < line.points.size() - 1) {
-                indices.push_back(vertexOffset + i);
-                indices.push_back(vertexOffset + i + 1);
-            }
-        }
-        vertexOffset += line.points.size();
-    }
-
-    glBindBuffer(GL_ARRAY_BUFFER, field_line_VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, field_line_EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-    glBindVertexArray(field_line_VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, field_line_VBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, field_line_EBO);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-}
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include <cmath>
 #include <deque>
 #include <random>
+#include <memory>
+#include <cstddef>
 
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_opengl3.h>
@@ -22,34 +24,36 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/intersect.hpp>
 
+#include "gl_debug.h"
+#include "gpu_resources.h"
+#include "streaming_buffer.h"
 #include "shader.h"
 #include "shaders.h"
 #include "dipole.h"
+#include "dipole_store.h"
+#include "dipole_source_buffer.h"
 #include "camera.h"
+#include "camera_uniforms.h"
 #include "cuboid.h"
 #include "dipole_visualizer.h"
 #include "field_plane.h"
+#include "field_plane_texture.h"
+#include "field_slice.h"
 #include "field_line_tracer.h"
+#include "field_line_vertex.h"
+#include "scene_passes.h"
+#include "headless_renderer.h"
+#include "scene_file.h"
+#include "field_line_exporter.h"
+#include "trajectory_recorder.h"
+#include "scene_history.h"
+#include "dipole_simulation.h"
+#include "dipole_ensemble.h"
 
 // Constants
 constexpr auto PI = 3.141529;
 constexpr auto PIXELS_PER_METER = 100.0f;
 
-// Magnetic dipole struct to be used in UBO, matches struct in shader.frag
-struct MagneticDipoleGL {
-    glm::vec3 position;  // 12 bytes
-    float padding1;      // 4 bytes padding to 16 bytes
-    glm::vec3 direction; // 12 bytes
-    float moment;        // 4 bytes supposed to be padding but this works for some reason idk why don't fkin ask
-};
-
-// Struct to store dipole state for history
-struct DipoleState {
-    glm::vec3 position;
-    glm::quat rotation;
-    float moment;
-};
-
 // Window settings
 int screen_width{ 1080 };              // Default window width
 int screen_height{ 1080 };             // Default window height
@@ -79,13 +83,20 @@ constexpr float cuboid_depth = 4.0f;   // Cuboid depth
 glm::vec4 cuboid_color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f); // White color for cuboid edges
 
 // Dipole settings
-std::vector<MagneticDipole> dipoles;   // Collection of magnetic dipoles
-std::vector<DipoleVisualizer> dipole_visualizers; // Visualizers for magnetic dipoles
+DipoleStore dipole_store(PIXELS_PER_METER); // Scene store for all magnetic dipoles
+constexpr float dipole_sphere_radius = 0.04f; // Visualizer sphere radius, also used for picking
+glm::vec3 bar_magnet_size = glm::vec3(0.2f, 0.6f, 0.2f); // Extent of bar magnets added from the UI (m)
+float bar_magnet_density = 10.0f;      // Bar magnet dipoles per meter along each axis
+float bar_magnet_moment = 0.1f;        // Moment of each bar magnet dipole
 
 // Field plane settings
-float field_plane_z = 0.0f;            // Z-position in [-1, 1]
 float field_plane_opacity = 0.5f;      // Opacity in [0, 1]
 float field_plane_sensitivity = 1.0f;  // Sensitivity, to be multiplied to a power of 10
+int field_plane_resolution = 512;      // Field magnitude texels along the longer side of the plane
+bool field_plane_gpu_compute = false;  // Bake the field plane magnitudes on the GPU instead of the CPU
+
+// Scene file settings
+char scene_file_path[256] = "scene.mfs"; // Path used by Save Scene and Load Scene
 
 // Label settings
 bool show_labels = true; // Added for label visibility toggle
@@ -95,6 +106,26 @@ bool show_labels_on_hover = false; // Added for hover-based label display
 bool simulate = false; // Whether simulation is running
 float simulation_speed = 1.0f; // Simulation time speed (seconds)
 bool reverse_time = false; // Whether to run simulation backward
+bool interpolate_simulation = true; // Draw dipoles blended between the last two fixed ticks
+bool static_field_grid = true; // Cache the combined field of pinned dipoles on a grid
+float static_field_cell_size = 0.25f; // Static field grid cell size (m)
+
+// Ensemble settings
+int ensemble_scenes = 256;             // Copies of the scene advanced together
+float ensemble_duration = 5.0f;        // Simulated seconds per ensemble run
+float ensemble_position_jitter = 0.05f; // Largest position offset of a copy per axis (m)
+float ensemble_rotation_jitter = 0.2f; // Largest rotation of a copy (rad)
+int ensemble_scene = 0;                // Scene whose results are shown
+double ensemble_run_time = 0.0;        // Wall time spent advancing the current or last run (s)
+double ensemble_remaining = 0.0;       // Simulated time left in the current run (s)
+double ensemble_frame_budget = 0.02;   // Wall time a frame may spend advancing the run (s)
+
+// Trajectory settings
+bool record_trajectory = false;   // Record each simulation step for replay
+bool trajectory_playback = false; // Showing a recorded frame instead of the live simulation
+bool trajectory_playing = false;  // Advancing through recorded frames
+int trajectory_frame = 0;         // Recorded frame shown by the scrubber
+char trajectory_file_path[256] = "trajectory.mft"; // Path used by Save/Load Trajectory
 
 // Enum for dipole dragging modes
 enum class DragMode { None, Move, Rotate, CameraDrag }; // Added CameraDrag
@@ -107,6 +138,8 @@ float trace_adaptive_max_step = 0.05f;  // Maximum step size for adaptive method
 float trace_adaptive_field_ref = 0.1f;  // Reference field strength for adaptive scaling
 bool trace_use_adaptive_step = false;   // Flag to switch between fixed and adaptive step size
 bool render_field_lines = true;         // Flag to enable/disable field line rendering
+FieldLineVertexFormat field_line_vertex_format = FieldLineVertexFormat::Compact; // GPU layout of field line points
+char field_line_export_path[256] = "field_lines.vtk"; // .vtk, .ply or binary .mfl
 
 // Timing and input variables
 int num_frames{ 0 };                   // Frame counter for FPS calculation
@@ -117,13 +150,10 @@ bool is_dragging{ false };             // Flag indicating if mouse is dragging
 bool is_perspective{ true };           // Flag for perspective vs orthographic mode
 glm::dvec2 last_mouse_pos = glm::dvec2(0.0); // Last mouse position for dragging
 
-// Errors and shit
-bool UBO_error_flagged = false;
-
 /* Window resize callback function prototype */
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 /* Window input event callback function prototype */
-void processInput(GLFWwindow* window, int& selected_dipole_index, enum class DragMode& drag_mode, glm::dvec2& drag_start_mouse_pos, glm::vec3& drag_start_position, glm::quat& drag_start_rotation);
+void processInput(GLFWwindow* window, DipoleHandle& selected_dipole, enum class DragMode& drag_mode, glm::dvec2& drag_start_mouse_pos, glm::vec3& drag_start_position, glm::quat& drag_start_rotation);
 /* FPS counter function prototype */
 void countFPS();
 /* Delta time updater function prototype */
@@ -131,6 +161,4 @@ void updateDeltaTime();
 /* Scroll callback function prototype */
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 /* Cuboid dimension updater function prototype */
-void updateCuboidDimensions(Cuboid& cuboid, FieldPlane& field_plane, float cuboid_height, unsigned int field_VAO, unsigned int field_VBO, unsigned int field_EBO, unsigned int cuboid_VAO, unsigned int cuboid_VBO, unsigned int cuboid_EBO);
-/* Field line geometry updater function prototype */
-void updateFieldLineGeometry(const std::vector<FieldLine>& fieldLines, unsigned int& field_line_VAO, unsigned int& field_line_VBO, unsigned int& field_line_EBO, std::vector<float>& vertices, std::vector<unsigned int>& indices);
\ No newline at end of file
+void updateCuboidDimensions(Cuboid& cuboid, std::vector<std::unique_ptr<FieldSlice>>& field_slices, float cuboid_height, unsigned int cuboid_VAO, unsigned int cuboid_VBO, unsigned int cuboid_EBO);
\ No newline at end of file
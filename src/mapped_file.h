@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The contents stay valid until close() or
+// destruction, and pages are only read from disk as they are touched.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    const unsigned char* data() const { return static_cast<const unsigned char*>(m_data); }
+    size_t size() const { return m_size; }
+
+private:
+    void* m_data{ nullptr };
+    size_t m_size{ 0 };
+#ifdef _WIN32
+    void* m_file{ nullptr };
+    void* m_mapping{ nullptr };
+#endif
+};
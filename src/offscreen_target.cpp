@@ -0,0 +1,66 @@
+#include "offscreen_target.h"
+#include "gl_debug.h"
+#include <cstring>
+#include <iostream>
+
+OffscreenTarget::~OffscreenTarget() {
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteRenderbuffers(1, &m_color);
+    glDeleteRenderbuffers(1, &m_depth);
+}
+
+bool OffscreenTarget::initialize(int width, int height) {
+    m_width = width;
+    m_height = height;
+    if (m_fbo == 0) {
+        glGenFramebuffers(1, &m_fbo);
+        glGenRenderbuffers(1, &m_color);
+        glGenRenderbuffers(1, &m_depth);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    labelGLObject(GL_FRAMEBUFFER, m_fbo, "Offscreen FBO");
+    labelGLObject(GL_RENDERBUFFER, m_color, "Offscreen colour");
+    labelGLObject(GL_RENDERBUFFER, m_depth, "Offscreen depth");
+    GL_CHECK("Offscreen target");
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Offscreen framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void OffscreenTarget::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, m_width, m_height);
+}
+
+void OffscreenTarget::readPixels(std::vector<uint8_t>& rgba) const {
+    size_t row_bytes = static_cast<size_t>(m_width) * 4;
+    rgba.resize(row_bytes * m_height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    GL_CHECK("Offscreen read back");
+
+    // GL rows start at the bottom, images at the top
+    std::vector<uint8_t> row(row_bytes);
+    for (int y = 0; y < m_height / 2; ++y) {
+        uint8_t* top = rgba.data() + y * row_bytes;
+        uint8_t* bottom = rgba.data() + (m_height - 1 - y) * row_bytes;
+        std::memcpy(row.data(), top, row_bytes);
+        std::memcpy(top, bottom, row_bytes);
+        std::memcpy(bottom, row.data(), row_bytes);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Framebuffer with RGBA8 colour and depth renderbuffers, for rendering frames that are
+// read back instead of presented
+class OffscreenTarget {
+public:
+    OffscreenTarget() = default;
+    ~OffscreenTarget();
+
+    OffscreenTarget(const OffscreenTarget&) = delete;
+    OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+    // Create or resize the attachments, returns false if the framebuffer is incomplete
+    bool initialize(int width, int height);
+    // Bind for drawing and set the viewport to cover it
+    void bind() const;
+    // Read the colour attachment as RGBA rows, top row first
+    void readPixels(std::vector<uint8_t>& rgba) const;
+
+    int getWidth() const { return m_width; }
+    int getHeight() const { return m_height; }
+
+private:
+    unsigned int m_fbo{ 0 };
+    unsigned int m_color{ 0 };
+    unsigned int m_depth{ 0 };
+    int m_width{ 0 };
+    int m_height{ 0 };
+};
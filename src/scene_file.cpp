@@ -0,0 +1,413 @@
+#include "scene_file.h"
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Columns are copied byte for byte, so the in-memory layouts must match the file's
+static_assert(sizeof(glm::vec3) == 12, "glm::vec3 must be tightly packed");
+static_assert(sizeof(glm::quat) == 16 && offsetof(glm::quat, x) == 0 && offsetof(glm::quat, w) == 12,
+    "glm::quat must be stored x, y, z, w");
+static_assert(sizeof(SceneFileHeader) == 72, "Scene file header layout changed");
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+}
+
+static bool hasExtension(const std::string& path, const char* extension) {
+    size_t length = std::strlen(extension);
+    if (path.size() < length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (std::tolower(static_cast<unsigned char>(path[path.size() - length + i])) != extension[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SceneView::open(const std::string& path) {
+    close();
+    if (!m_file.open(path)) {
+        std::cerr << "Failed to map scene file: " << path << std::endl;
+        return false;
+    }
+    const char* error = nullptr;
+    const SceneFileHeader* header = reinterpret_cast<const SceneFileHeader*>(m_file.data());
+    if (m_file.size() < sizeof(SceneFileHeader) || std::memcmp(header->magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) != 0) {
+        error = "not a scene file";
+    }
+    else if (header->version > SCENE_FILE_VERSION || header->header_size < offsetof(SceneFileHeader, bodies_offset)
+        || m_file.size() < header->header_size) {
+        error = "unsupported scene file version";
+    }
+    else {
+        // Every column must lie inside the file and be aligned for its element type
+        uint64_t count = header->source_count;
+        const struct { uint64_t offset; uint64_t element_size; } columns[] = {
+            { header->positions_offset, sizeof(glm::vec3) },
+            { header->rotations_offset, sizeof(glm::quat) },
+            { header->moments_offset, sizeof(float) },
+            { header->types_offset, sizeof(SceneSourceType) },
+            { header->flags_offset, sizeof(uint8_t) },
+        };
+        m_header = header;
+        for (const auto& c : columns) {
+            if (c.offset % alignof(float) != 0 || c.offset > m_file.size()
+                || count > (m_file.size() - c.offset) / c.element_size) {
+                error = "truncated or corrupt scene file";
+                break;
+            }
+        }
+        uint64_t bodies_offset = hasBodies() ? header->bodies_offset : 0;
+        if (!error && hasBodies() && (bodies_offset % alignof(uint32_t) != 0 || bodies_offset > m_file.size()
+            || count > (m_file.size() - bodies_offset) / sizeof(uint32_t))) {
+            error = "truncated or corrupt scene file";
+        }
+    }
+    if (error) {
+        std::cerr << "Failed to open scene file " << path << ": " << error << std::endl;
+        m_file.close();
+        m_header = nullptr;
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+
+bool saveSceneBinary(const std::string& path, const DipoleStore& store) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open scene file for writing: " << path << std::endl;
+        return false;
+    }
+
+    uint64_t count = store.size();
+    SceneFileHeader header{};
+    std::memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC));
+    header.version = SCENE_FILE_VERSION;
+    header.header_size = sizeof(SceneFileHeader);
+    header.source_count = count;
+    header.positions_offset = alignOffset(sizeof(SceneFileHeader));
+    header.rotations_offset = alignOffset(header.positions_offset + count * sizeof(glm::vec3));
+    header.moments_offset = alignOffset(header.rotations_offset + count * sizeof(glm::quat));
+    header.types_offset = alignOffset(header.moments_offset + count * sizeof(float));
+    header.flags_offset = alignOffset(header.types_offset + count * sizeof(SceneSourceType));
+    header.bodies_offset = alignOffset(header.flags_offset + count * sizeof(uint8_t));
+
+    std::vector<SceneSourceType> types(count, SceneSourceType::Dipole);
+    const struct { uint64_t offset; const void* data; size_t bytes; } columns[] = {
+        { header.positions_offset, store.getPositions().data(), count * sizeof(glm::vec3) },
+        { header.rotations_offset, store.getRotations().data(), count * sizeof(glm::quat) },
+        { header.moments_offset, store.getMoments().data(), count * sizeof(float) },
+        { header.types_offset, types.data(), count * sizeof(SceneSourceType) },
+        { header.flags_offset, store.getFlags().data(), count * sizeof(uint8_t) },
+        { header.bodies_offset, store.getBodies().data(), count * sizeof(uint32_t) },
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    static const char padding[SCENE_FILE_ALIGNMENT] = {};
+    for (const auto& c : columns) {
+        file.write(padding, static_cast<std::streamsize>(c.offset - written));
+        file.write(static_cast<const char*>(c.data), static_cast<std::streamsize>(c.bytes));
+        written = c.offset + c.bytes;
+    }
+    if (!file) {
+        std::cerr << "Failed to write scene file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool loadSceneBinary(const std::string& path, DipoleStore& store) {
+    SceneView view;
+    if (!view.open(path)) {
+        return false;
+    }
+    const SceneSourceType* types = view.types();
+    for (size_t i = 0; i < view.size(); ++i) {
+        if (types[i] != SceneSourceType::Dipole) {
+            std::cerr << "Failed to load scene file " << path << ": unsupported source type " << static_cast<int>(types[i]) << std::endl;
+            return false;
+        }
+    }
+    store.assign(view.size(), view.positions(), view.rotations(), view.moments(), view.flags(), view.bodies());
+    return true;
+}
+
+bool saveSceneJSON(const std::string& path, const DipoleStore& store) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open scene file for writing: " << path << std::endl;
+        return false;
+    }
+    file << std::setprecision(9);
+    file << "{\n  \"version\": " << SCENE_FILE_VERSION << ",\n  \"sources\": [";
+    for (size_t i = 0; i < store.size(); ++i) {
+        glm::vec3 p = store.getPosition(i);
+        glm::quat r = store.getRotation(i);
+        file << (i == 0 ? "\n" : ",\n")
+            << "    { \"type\": \"dipole\""
+            << ", \"position\": [" << p.x << ", " << p.y << ", " << p.z << "]"
+            << ", \"rotation\": [" << r.x << ", " << r.y << ", " << r.z << ", " << r.w << "]"
+            << ", \"moment\": " << store.getMoment(i)
+            << ", \"pinned\": " << ((store.getFlags(i) & DipoleFlags_Pinned) ? "true" : "false");
+        if (store.getBody(i) != NO_BODY) {
+            file << ", \"body\": " << store.getBody(i);
+        }
+        file << " }";
+    }
+    file << "\n  ]\n}\n";
+    if (!file) {
+        std::cerr << "Failed to write scene file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Minimal JSON reader, enough for scene files
+namespace {
+
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object } type{ Type::Null };
+    bool boolean{ false };
+    double number{ 0.0 };
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    const JsonValue* find(const char* key) const {
+        for (const auto& member : object) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : m_text(text) {}
+
+    bool parse(JsonValue& value) {
+        return parseValue(value, 0) && (skipWhitespace(), m_pos == m_text.size());
+    }
+    size_t getPosition() const { return m_pos; }
+
+private:
+    static constexpr int MAX_DEPTH = 64;
+
+    void skipWhitespace() {
+        while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+            ++m_pos;
+        }
+    }
+
+    bool consume(char c) {
+        skipWhitespace();
+        if (m_pos < m_text.size() && m_text[m_pos] == c) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool consumeWord(const char* word) {
+        size_t length = std::strlen(word);
+        if (m_text.compare(m_pos, length, word) == 0) {
+            m_pos += length;
+            return true;
+        }
+        return false;
+    }
+
+    bool parseString(std::string& out) {
+        if (!consume('"')) {
+            return false;
+        }
+        out.clear();
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            char c = m_text[m_pos++];
+            if (c == '\\' && m_pos < m_text.size()) {
+                char escaped = m_text[m_pos++];
+                switch (escaped) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u': return false; // Not needed for scene files
+                default: c = escaped; break;
+                }
+            }
+            out.push_back(c);
+        }
+        return consume('"');
+    }
+
+    bool parseValue(JsonValue& value, int depth) {
+        if (depth > MAX_DEPTH) {
+            return false;
+        }
+        skipWhitespace();
+        if (m_pos >= m_text.size()) {
+            return false;
+        }
+        char c = m_text[m_pos];
+        if (c == '{') {
+            ++m_pos;
+            value.type = JsonValue::Type::Object;
+            if (consume('}')) {
+                return true;
+            }
+            do {
+                std::pair<std::string, JsonValue> member;
+                if (!parseString(member.first) || !consume(':') || !parseValue(member.second, depth + 1)) {
+                    return false;
+                }
+                value.object.push_back(std::move(member));
+            } while (consume(','));
+            return consume('}');
+        }
+        if (c == '[') {
+            ++m_pos;
+            value.type = JsonValue::Type::Array;
+            if (consume(']')) {
+                return true;
+            }
+            do {
+                value.array.emplace_back();
+                if (!parseValue(value.array.back(), depth + 1)) {
+                    return false;
+                }
+            } while (consume(','));
+            return consume(']');
+        }
+        if (c == '"') {
+            value.type = JsonValue::Type::String;
+            return parseString(value.string);
+        }
+        if (consumeWord("true")) {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = true;
+            return true;
+        }
+        if (consumeWord("false")) {
+            value.type = JsonValue::Type::Bool;
+            return true;
+        }
+        if (consumeWord("null")) {
+            value.type = JsonValue::Type::Null;
+            return true;
+        }
+        const char* start = m_text.c_str() + m_pos;
+        char* end = nullptr;
+        value.number = std::strtod(start, &end);
+        if (end == start) {
+            return false;
+        }
+        value.type = JsonValue::Type::Number;
+        m_pos += static_cast<size_t>(end - start);
+        return true;
+    }
+
+    const std::string& m_text;
+    size_t m_pos{ 0 };
+};
+
+bool readFloats(const JsonValue* value, float* out, size_t count) {
+    if (!value || value->type != JsonValue::Type::Array || value->array.size() != count) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (value->array[i].type != JsonValue::Type::Number) {
+            return false;
+        }
+        out[i] = static_cast<float>(value->array[i].number);
+    }
+    return true;
+}
+
+} // namespace
+
+bool loadSceneJSON(const std::string& path, DipoleStore& store) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open scene file: " << path << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+
+    JsonValue root;
+    JsonParser parser(text);
+    if (!parser.parse(root) || root.type != JsonValue::Type::Object) {
+        std::cerr << "Failed to parse scene file " << path << " near offset " << parser.getPosition() << std::endl;
+        return false;
+    }
+    const JsonValue* version = root.find("version");
+    if (version && (version->type != JsonValue::Type::Number || version->number > SCENE_FILE_VERSION)) {
+        std::cerr << "Failed to load scene file " << path << ": unsupported scene file version" << std::endl;
+        return false;
+    }
+    const JsonValue* sources = root.find("sources");
+    if (!sources || sources->type != JsonValue::Type::Array) {
+        std::cerr << "Failed to load scene file " << path << ": missing \"sources\" array" << std::endl;
+        return false;
+    }
+
+    // Parse into columns first so a bad entry leaves the store untouched
+    size_t count = sources->array.size();
+    std::vector<glm::vec3> positions(count);
+    std::vector<glm::quat> rotations(count);
+    std::vector<float> moments(count, 1.0f);
+    std::vector<uint8_t> flags(count, DipoleFlags_None);
+    std::vector<uint32_t> bodies(count, NO_BODY);
+    for (size_t i = 0; i < count; ++i) {
+        const JsonValue& source = sources->array[i];
+        const JsonValue* type = source.find("type");
+        const JsonValue* moment = source.find("moment");
+        const JsonValue* pinned = source.find("pinned");
+        const JsonValue* body = source.find("body");
+        float rotation[4];
+        bool ok = source.type == JsonValue::Type::Object
+            && (!type || (type->type == JsonValue::Type::String && type->string == "dipole"))
+            && readFloats(source.find("position"), &positions[i].x, 3)
+            && readFloats(source.find("rotation"), rotation, 4)
+            && (!moment || moment->type == JsonValue::Type::Number)
+            && (!pinned || pinned->type == JsonValue::Type::Bool)
+            && (!body || (body->type == JsonValue::Type::Number && body->number >= 0.0 && body->number <= UINT32_MAX));
+        if (!ok) {
+            std::cerr << "Failed to load scene file " << path << ": invalid source " << i << std::endl;
+            return false;
+        }
+        rotations[i] = glm::normalize(glm::quat(rotation[3], rotation[0], rotation[1], rotation[2]));
+        if (moment) {
+            moments[i] = static_cast<float>(moment->number);
+        }
+        if (pinned && pinned->boolean) {
+            flags[i] = DipoleFlags_Pinned;
+        }
+        if (body) {
+            bodies[i] = static_cast<uint32_t>(body->number);
+        }
+    }
+    store.assign(count, positions.data(), rotations.data(), moments.data(), flags.data(), bodies.data());
+    return true;
+}
+
+bool saveScene(const std::string& path, const DipoleStore& store) {
+    return hasExtension(path, ".json") ? saveSceneJSON(path, store) : saveSceneBinary(path, store);
+}
+
+bool loadScene(const std::string& path, DipoleStore& store) {
+    return hasExtension(path, ".json") ? loadSceneJSON(path, store) : loadSceneBinary(path, store);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "dipole_store.h"
+#include "mapped_file.h"
+
+// Scene files. The binary format (.mfs) is a fixed header followed by structure-of-arrays
+// columns, each 64-byte aligned and laid out exactly as in memory, so a mapped file can be
+// read in place and loading is a bulk copy per column. The JSON format (.json) holds the
+// same data for small, hand-edited scenes. Binary files are little-endian.
+
+// Kind of field source in the types column
+enum class SceneSourceType : uint8_t {
+    Dipole = 0,
+};
+
+constexpr char SCENE_FILE_MAGIC[8] = { 'M', 'F', 'S', 'C', 'E', 'N', 'E', '\0' };
+constexpr uint32_t SCENE_FILE_VERSION = 2; // 2 added the bodies column
+constexpr size_t SCENE_FILE_ALIGNMENT = 64;
+
+// Offsets are from the start of the file, columns hold source_count elements each
+struct SceneFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t source_count;
+    uint64_t positions_offset; // glm::vec3
+    uint64_t rotations_offset; // glm::quat, stored x, y, z, w
+    uint64_t moments_offset;   // float
+    uint64_t types_offset;     // SceneSourceType
+    uint64_t flags_offset;     // DipoleFlags
+    uint64_t bodies_offset;    // uint32_t rigid body id, version 2 and later
+};
+
+// Mapped binary scene whose columns are used in place
+class SceneView {
+public:
+    // Map and validate a binary scene, reporting the problem if it is not one
+    bool open(const std::string& path);
+    void close() { m_file.close(); m_header = nullptr; }
+
+    size_t size() const { return m_header ? static_cast<size_t>(m_header->source_count) : 0; }
+    const glm::vec3* positions() const { return column<glm::vec3>(m_header->positions_offset); }
+    const glm::quat* rotations() const { return column<glm::quat>(m_header->rotations_offset); }
+    const float* moments() const { return column<float>(m_header->moments_offset); }
+    const SceneSourceType* types() const { return column<SceneSourceType>(m_header->types_offset); }
+    const uint8_t* flags() const { return column<uint8_t>(m_header->flags_offset); }
+    // Null for files written before bodies were stored
+    const uint32_t* bodies() const { return hasBodies() ? column<uint32_t>(m_header->bodies_offset) : nullptr; }
+
+private:
+    bool hasBodies() const { return m_header->version >= 2 && m_header->header_size >= offsetof(SceneFileHeader, bodies_offset) + sizeof(uint64_t); }
+
+    template <typename T>
+    const T* column(uint64_t offset) const { return reinterpret_cast<const T*>(m_file.data() + offset); }
+
+    MappedFile m_file;
+    const SceneFileHeader* m_header{ nullptr };
+};
+
+bool saveSceneBinary(const std::string& path, const DipoleStore& store);
+bool loadSceneBinary(const std::string& path, DipoleStore& store);
+bool saveSceneJSON(const std::string& path, const DipoleStore& store);
+bool loadSceneJSON(const std::string& path, DipoleStore& store);
+
+// Pick the format from the extension, .json for JSON and binary otherwise.
+// Loading replaces the store's dipoles and leaves it untouched on failure.
+bool saveScene(const std::string& path, const DipoleStore& store);
+bool loadScene(const std::string& path, DipoleStore& store);
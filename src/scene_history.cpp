@@ -0,0 +1,149 @@
+#include "scene_history.h"
+#include <algorithm>
+#include <cstring>
+
+constexpr size_t SceneHistory::CHUNK_DIPOLES;
+
+SceneHistory::Chunk::Chunk(const DipoleStore& store, size_t first, size_t count, std::shared_ptr<size_t> counter)
+    : positions(store.getPositions().begin() + first, store.getPositions().begin() + first + count),
+      rotations(store.getRotations().begin() + first, store.getRotations().begin() + first + count),
+      moments(store.getMoments().begin() + first, store.getMoments().begin() + first + count),
+      flags(store.getFlags().begin() + first, store.getFlags().begin() + first + count),
+      bodies(store.getBodies().begin() + first, store.getBodies().begin() + first + count),
+      byte_counter(std::move(counter)) {
+    *byte_counter += byteSize();
+}
+
+SceneHistory::Chunk::~Chunk() {
+    *byte_counter -= byteSize();
+}
+
+size_t SceneHistory::Chunk::byteSize() const {
+    return sizeof(Chunk) + positions.size() * (sizeof(glm::vec3) + sizeof(glm::quat) + sizeof(float) + sizeof(uint8_t) + sizeof(uint32_t));
+}
+
+bool SceneHistory::Chunk::matches(const DipoleStore& store, size_t first) const {
+    size_t count = positions.size();
+    if (first + count > store.size() || std::min(store.size() - first, CHUNK_DIPOLES) != count) {
+        return false;
+    }
+    // Bitwise comparison, an edit that writes back the same value is not a change
+    return std::memcmp(positions.data(), store.getPositions().data() + first, count * sizeof(glm::vec3)) == 0
+        && std::memcmp(rotations.data(), store.getRotations().data() + first, count * sizeof(glm::quat)) == 0
+        && std::memcmp(moments.data(), store.getMoments().data() + first, count * sizeof(float)) == 0
+        && std::memcmp(flags.data(), store.getFlags().data() + first, count * sizeof(uint8_t)) == 0
+        && std::memcmp(bodies.data(), store.getBodies().data() + first, count * sizeof(uint32_t)) == 0;
+}
+
+SceneHistory::SceneHistory(size_t max_versions)
+    : m_max_versions(std::max<size_t>(max_versions, 2)), m_chunk_bytes(std::make_shared<size_t>(0)) {
+}
+
+SceneHistory::Version SceneHistory::capture(const DipoleStore& store, const Version* base, const char* label) const {
+    Version version;
+    version.label = label;
+    version.dipole_count = store.size();
+    size_t num_chunks = (store.size() + CHUNK_DIPOLES - 1) / CHUNK_DIPOLES;
+    version.chunks.reserve(num_chunks);
+    for (size_t c = 0; c < num_chunks; ++c) {
+        size_t first = c * CHUNK_DIPOLES;
+        if (base && c < base->chunks.size() && base->chunks[c]->matches(store, first)) {
+            version.chunks.push_back(base->chunks[c]);
+        }
+        else {
+            version.chunks.push_back(std::make_shared<const Chunk>(store, first, std::min(CHUNK_DIPOLES, store.size() - first), m_chunk_bytes));
+        }
+    }
+    return version;
+}
+
+void SceneHistory::reset(const DipoleStore& store) {
+    m_versions.clear();
+    m_versions.push_back(capture(store, nullptr, ""));
+    m_current = 0;
+}
+
+bool SceneHistory::commit(const DipoleStore& store, const char* label) {
+    if (m_versions.empty()) {
+        reset(store);
+        return false;
+    }
+    const Version& current = m_versions[m_current];
+    Version version = capture(store, &current, label);
+    if (version.dipole_count == current.dipole_count && version.chunks == current.chunks) {
+        return false;
+    }
+
+    // A new edit replaces the redo branch
+    m_versions.erase(m_versions.begin() + m_current + 1, m_versions.end());
+    m_versions.push_back(std::move(version));
+    while (m_versions.size() > m_max_versions) {
+        m_versions.pop_front();
+    }
+    m_current = m_versions.size() - 1;
+    return true;
+}
+
+void SceneHistory::apply(const Version& from, const Version& to, DipoleStore& store) const {
+    if (from.dipole_count != to.dipole_count) {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::quat> rotations;
+        std::vector<float> moments;
+        std::vector<uint8_t> flags;
+        std::vector<uint32_t> bodies;
+        positions.reserve(to.dipole_count);
+        rotations.reserve(to.dipole_count);
+        moments.reserve(to.dipole_count);
+        flags.reserve(to.dipole_count);
+        bodies.reserve(to.dipole_count);
+        for (const auto& chunk : to.chunks) {
+            positions.insert(positions.end(), chunk->positions.begin(), chunk->positions.end());
+            rotations.insert(rotations.end(), chunk->rotations.begin(), chunk->rotations.end());
+            moments.insert(moments.end(), chunk->moments.begin(), chunk->moments.end());
+            flags.insert(flags.end(), chunk->flags.begin(), chunk->flags.end());
+            bodies.insert(bodies.end(), chunk->bodies.begin(), chunk->bodies.end());
+        }
+        store.assign(to.dipole_count, positions.data(), rotations.data(), moments.data(), flags.data(), bodies.data());
+        return;
+    }
+
+    // Same dipoles, write only the chunks the two versions do not share
+    for (size_t c = 0; c < to.chunks.size(); ++c) {
+        if (to.chunks[c] == from.chunks[c]) {
+            continue;
+        }
+        const Chunk& chunk = *to.chunks[c];
+        store.assignRange(c * CHUNK_DIPOLES, chunk.positions.size(), chunk.positions.data(), chunk.rotations.data(),
+            chunk.moments.data(), chunk.flags.data(), chunk.bodies.data());
+    }
+}
+
+bool SceneHistory::undo(DipoleStore& store) {
+    commit(store, "Other changes");
+    if (!canUndo()) {
+        return false;
+    }
+    --m_current;
+    apply(m_versions[m_current + 1], m_versions[m_current], store);
+    return true;
+}
+
+bool SceneHistory::redo(DipoleStore& store) {
+    // Uncommitted changes would replace the redo branch, so commit and stop there
+    if (commit(store, "Other changes") || !canRedo()) {
+        return false;
+    }
+    ++m_current;
+    apply(m_versions[m_current - 1], m_versions[m_current], store);
+    return true;
+}
+
+const std::string& SceneHistory::getUndoLabel() const {
+    static const std::string none;
+    return canUndo() ? m_versions[m_current].label : none;
+}
+
+const std::string& SceneHistory::getRedoLabel() const {
+    static const std::string none;
+    return canRedo() ? m_versions[m_current + 1].label : none;
+}
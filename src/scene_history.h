@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "dipole_store.h"
+
+// Undo/redo history of the dipole store. A version is a list of fixed-size chunks of
+// dipole state held by shared pointer. Committing compares the store with the current
+// version chunk by chunk and copies only the chunks that differ, the rest are shared with
+// the previous version, so history costs memory in proportion to what each edit changed
+// rather than to the scene size. The oldest versions are dropped beyond max_versions.
+class SceneHistory {
+public:
+    static constexpr size_t CHUNK_DIPOLES = 256;
+
+    explicit SceneHistory(size_t max_versions = 256);
+
+    SceneHistory(const SceneHistory&) = delete;
+    SceneHistory& operator=(const SceneHistory&) = delete;
+
+    // Discard all versions and start again from the store's current state
+    void reset(const DipoleStore& store);
+    // Record the store as a new version labelled label, discarding any redo versions.
+    // Returns false without recording if the store matches the current version.
+    bool commit(const DipoleStore& store, const char* label);
+
+    bool canUndo() const { return m_current > 0; }
+    bool canRedo() const { return m_current + 1 < m_versions.size(); }
+    // Step back or forward one version and apply it to the store. Changes not yet
+    // committed are committed first so redo can return to them. When the dipole count
+    // is unchanged only differing chunks are written and handles stay valid.
+    bool undo(DipoleStore& store);
+    bool redo(DipoleStore& store);
+
+    // Label of the edit undo or redo would revert or reapply, empty if there is none
+    const std::string& getUndoLabel() const;
+    const std::string& getRedoLabel() const;
+    size_t getVersionCount() const { return m_versions.size(); }
+    size_t getCurrentIndex() const { return m_current; }
+    // Bytes held by chunks across all versions, each shared chunk counted once
+    size_t getByteSize() const { return *m_chunk_bytes; }
+
+private:
+    struct Chunk {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::quat> rotations;
+        std::vector<float> moments;
+        std::vector<uint8_t> flags;
+        std::vector<uint32_t> bodies;
+        std::shared_ptr<size_t> byte_counter; // Live chunk bytes, shared with the history
+
+        Chunk(const DipoleStore& store, size_t first, size_t count, std::shared_ptr<size_t> counter);
+        ~Chunk();
+        size_t byteSize() const;
+        bool matches(const DipoleStore& store, size_t first) const;
+    };
+
+    struct Version {
+        std::string label;
+        size_t dipole_count{ 0 };
+        std::vector<std::shared_ptr<const Chunk>> chunks;
+    };
+
+    // Version of the store sharing every chunk of base that it still matches
+    Version capture(const DipoleStore& store, const Version* base, const char* label) const;
+    void apply(const Version& from, const Version& to, DipoleStore& store) const;
+
+    size_t m_max_versions;
+    std::deque<Version> m_versions;
+    size_t m_current{ 0 };
+    std::shared_ptr<size_t> m_chunk_bytes;
+};
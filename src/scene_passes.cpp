@@ -0,0 +1,128 @@
+#include "scene_passes.h"
+#include "gl_debug.h"
+#include <algorithm>
+#include <cstddef>
+
+void updateFieldLineGeometry(const std::vector<FieldLine>& fieldLines, const glm::vec3& bounds_min, const glm::vec3& bounds_max, FieldLineVertexFormat format, unsigned int field_line_VAO, StreamingBuffer& buffer, std::vector<GLint>& firsts, std::vector<GLsizei>& counts, FieldLineVertexDecode& decode) {
+    GLDebugScope scope("Field line geometry update");
+    firsts.clear();
+    counts.clear();
+
+    size_t total_points = 0;
+    for (const auto& line : fieldLines) {
+        if (line.points.size() < 2) continue;
+        total_points += line.points.size();
+    }
+    if (total_points == 0) {
+        return;
+    }
+
+    // Each line is drawn as its own strip, so points are written as-is without an index buffer
+    buffer.setElementSize(fieldLineVertexSize(format));
+    bool reallocated = false;
+    void* dst = buffer.beginWrite(total_points, reallocated);
+    if (!dst) {
+        buffer.endWrite();
+        return;
+    }
+
+    glm::vec3 extent = glm::max(bounds_max - bounds_min, glm::vec3(1e-6f));
+    if (format == FieldLineVertexFormat::Compact) {
+        decode.position_offset = bounds_min;
+        decode.position_scale = extent;
+        decode.log_encoded = 1;
+    }
+    else {
+        decode = FieldLineVertexDecode();
+    }
+    glm::vec3 inverse_extent = 1.0f / extent;
+    FieldLineVertexCompact* compact_dst = static_cast<FieldLineVertexCompact*>(dst);
+    FieldLineVertexFloat* float_dst = static_cast<FieldLineVertexFloat*>(dst);
+
+    GLint first = buffer.getBaseElement();
+    for (const auto& line : fieldLines) {
+        if (line.points.size() < 2) continue;
+        for (const auto& point : line.points) {
+            float field_strength = glm::length(point.field);
+            if (format == FieldLineVertexFormat::Compact) {
+                *compact_dst++ = encodeFieldLineVertex(point.position, field_strength, bounds_min, inverse_extent);
+            }
+            else {
+                *float_dst++ = { point.position, field_strength };
+            }
+        }
+        firsts.push_back(first);
+        counts.push_back(static_cast<GLsizei>(line.points.size()));
+        first += static_cast<GLint>(line.points.size());
+    }
+    buffer.endWrite();
+
+    if (reallocated) {
+        glBindVertexArray(field_line_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.getBuffer());
+        if (format == FieldLineVertexFormat::Compact) {
+            GLsizei stride = sizeof(FieldLineVertexCompact);
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(FieldLineVertexCompact, position));
+            glVertexAttribPointer(1, 1, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(FieldLineVertexCompact, field_strength));
+        }
+        else {
+            GLsizei stride = sizeof(FieldLineVertexFloat);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FieldLineVertexFloat, position));
+            glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FieldLineVertexFloat, field_strength));
+        }
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    GL_CHECK("Field line geometry update");
+}
+
+void drawCuboidPass(Shader& cuboid_shader, unsigned int cuboid_VAO, const glm::vec4& color) {
+    cuboid_shader.use_shader();
+    cuboid_shader.set_vec4("color", color);
+    cuboid_shader.set_mat4("model", glm::mat4(1.0f));
+    glBindVertexArray(cuboid_VAO);
+    glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0); // Unbind VAO for safety
+}
+
+void drawFieldLinePass(Shader& field_line_shader, const FieldLineGeometry& geometry, StreamingBuffer& buffer, float sensitivity_scaled, bool use_color) {
+    if (geometry.counts.empty()) {
+        return;
+    }
+    field_line_shader.use_shader();
+    field_line_shader.set_mat4("model", glm::mat4(1.0f));
+    field_line_shader.set_float("sensitivity_scaled", sensitivity_scaled);
+    field_line_shader.set_int("use_color", use_color ? 1 : 0);
+    field_line_shader.set_vec3("position_offset", geometry.decode.position_offset);
+    field_line_shader.set_vec3("position_scale", geometry.decode.position_scale);
+    field_line_shader.set_int("field_log_encoded", geometry.decode.log_encoded);
+    field_line_shader.set_vec2("field_log_range", glm::vec2(FIELD_LINE_LOG_MIN, FIELD_LINE_LOG_MAX));
+    glBindVertexArray(geometry.VAO);
+    glMultiDrawArrays(GL_LINE_STRIP, geometry.firsts.data(), geometry.counts.data(), static_cast<GLsizei>(geometry.counts.size()));
+    glBindVertexArray(0);
+    buffer.markUsed();
+}
+
+void drawFieldSlicesPass(Shader& field_shader, const std::vector<std::unique_ptr<FieldSlice>>& slices, const glm::vec3& camera_position,
+    const glm::vec3& bounds_half_extents, float opacity, float sensitivity_scaled) {
+    std::vector<const FieldSlice*> visible_slices;
+    for (const auto& slice : slices) {
+        if (slice->visible) {
+            visible_slices.push_back(slice.get());
+        }
+    }
+    std::sort(visible_slices.begin(), visible_slices.end(), [&camera_position](const FieldSlice* a, const FieldSlice* b) {
+        return glm::distance(a->getPlane().getCenter(), camera_position) > glm::distance(b->getPlane().getCenter(), camera_position);
+    });
+    field_shader.use_shader();
+    field_shader.set_vec3("bounds_half_extents", bounds_half_extents);
+    field_shader.set_float("plane_opacity", opacity);
+    field_shader.set_float("sensitivity_scaled", sensitivity_scaled);
+    glDepthMask(GL_FALSE);
+    for (const FieldSlice* slice : visible_slices) {
+        slice->render();
+    }
+    glDepthMask(GL_TRUE);
+}
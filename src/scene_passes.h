@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "streaming_buffer.h"
+#include "field_slice.h"
+#include "field_line_tracer.h"
+#include "field_line_vertex.h"
+
+// Render passes shared by the interactive window and the headless renderer. Each pass
+// expects the camera uniform block to already hold the frame's matrices.
+
+// Field lines as written by updateFieldLineGeometry, one line strip per line
+struct FieldLineGeometry {
+    unsigned int VAO{ 0 };
+    std::vector<GLint> firsts;    // First vertex of each line strip
+    std::vector<GLsizei> counts;  // Vertex count of each line strip
+    FieldLineVertexDecode decode; // How the shader unpacks the current upload
+};
+
+// Write traced lines into the streaming buffer in the given vertex format
+void updateFieldLineGeometry(const std::vector<FieldLine>& fieldLines, const glm::vec3& bounds_min, const glm::vec3& bounds_max, FieldLineVertexFormat format, unsigned int field_line_VAO, StreamingBuffer& buffer, std::vector<GLint>& firsts, std::vector<GLsizei>& counts, FieldLineVertexDecode& decode);
+
+// Cuboid edges (opaque)
+void drawCuboidPass(Shader& cuboid_shader, unsigned int cuboid_VAO, const glm::vec4& color);
+// Field lines (opaque), fences the streaming buffer segment they were drawn from
+void drawFieldLinePass(Shader& field_line_shader, const FieldLineGeometry& geometry, StreamingBuffer& buffer, float sensitivity_scaled, bool use_color);
+// Visible field slices (transparent, no depth write), back to front from camera_position
+void drawFieldSlicesPass(Shader& field_shader, const std::vector<std::unique_ptr<FieldSlice>>& slices, const glm::vec3& camera_position,
+    const glm::vec3& bounds_half_extents, float opacity, float sensitivity_scaled);
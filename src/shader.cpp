@@ -1,4 +1,5 @@
 #include "shader.h"
+#include <algorithm>
 
 Shader::Shader(const char* vertex_shader_source, const char* fragment_shader_source) {
     // Create shader program
@@ -18,7 +19,53 @@ Shader::Shader(const char* vertex_shader_source, const char* fragment_shader_sou
     if (!success) {
         glGetProgramInfoLog(program_ID, 512, nullptr, error_message);
         std::cout << "Error linking shader program: " << error_message << "\n";
+        return;
     }
+    cache_uniform_locations();
+}
+
+void Shader::cache_uniform_locations() {
+    GLint count = 0, max_length = 0;
+    glGetProgramiv(program_ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program_ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<char> name(std::max(max_length, 1));
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program_ID, i, (GLsizei)name.size(), &length, &size, &type, name.data());
+        std::string uniform_name(name.data(), length);
+        GLint location = glGetUniformLocation(program_ID, uniform_name.c_str());
+        if (location < 0) {
+            continue; // Uniform block members have no location
+        }
+        // Arrays are reported as name[0], but set by their plain name
+        if (uniform_name.size() > 3 && uniform_name.compare(uniform_name.size() - 3, 3, "[0]") == 0) {
+            uniform_name.resize(uniform_name.size() - 3);
+        }
+        uniform_locations.emplace_back(hash_uniform_name(uniform_name.c_str()), location);
+    }
+    std::sort(uniform_locations.begin(), uniform_locations.end());
+    for (size_t i = 1; i < uniform_locations.size(); ++i) {
+        if (uniform_locations[i].first == uniform_locations[i - 1].first) {
+            std::cout << "Uniform name hash collision in shader program " << program_ID << "\n";
+        }
+    }
+}
+
+GLint Shader::get_uniform_location(UniformName name) const {
+    auto it = std::lower_bound(uniform_locations.begin(), uniform_locations.end(), std::make_pair(name.hash, GLint(-1)),
+        [](const std::pair<uint32_t, GLint>& a, const std::pair<uint32_t, GLint>& b) { return a.first < b.first; });
+    return (it != uniform_locations.end() && it->first == name.hash) ? it->second : -1;
+}
+
+bool Shader::bind_uniform_block(const char* block_name, unsigned int binding) {
+    GLuint block_index = glGetUniformBlockIndex(program_ID, block_name);
+    if (block_index == GL_INVALID_INDEX) {
+        return false;
+    }
+    glUniformBlockBinding(program_ID, block_index, binding);
+    return true;
 }
 
 Shader::~Shader() {
@@ -55,26 +102,26 @@ void Shader::add_shader(unsigned int program, const char* shader_source, GLenum
     glDeleteShader(shader);
 }
 
-void Shader::set_float(const std::string& name, float value) const {
-    glUniform1f(glGetUniformLocation(program_ID, name.c_str()), value);
+void Shader::set_float(UniformName name, float value) const {
+    glUniform1f(get_uniform_location(name), value);
 }
 
-void Shader::set_vec2(const std::string& name, glm::vec2 vec) const {
-    glUniform2f(glGetUniformLocation(program_ID, name.c_str()), vec.x, vec.y);
+void Shader::set_vec2(UniformName name, glm::vec2 vec) const {
+    glUniform2f(get_uniform_location(name), vec.x, vec.y);
 }
 
-void Shader::set_vec3(const std::string& name, glm::vec3 vec) const {
-    glUniform3f(glGetUniformLocation(program_ID, name.c_str()), vec.x, vec.y, vec.z);
+void Shader::set_vec3(UniformName name, glm::vec3 vec) const {
+    glUniform3f(get_uniform_location(name), vec.x, vec.y, vec.z);
 }
 
-void Shader::set_vec4(const std::string& name, glm::vec4 vec) const {
-    glUniform4f(glGetUniformLocation(program_ID, name.c_str()), vec.x, vec.y, vec.z, vec.w);
+void Shader::set_vec4(UniformName name, glm::vec4 vec) const {
+    glUniform4f(get_uniform_location(name), vec.x, vec.y, vec.z, vec.w);
 }
 
-void Shader::set_mat4(const std::string& name, glm::mat4 mat) const {
-    glUniformMatrix4fv(glGetUniformLocation(program_ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+void Shader::set_mat4(UniformName name, glm::mat4 mat) const {
+    glUniformMatrix4fv(get_uniform_location(name), 1, GL_FALSE, glm::value_ptr(mat));
 }
 
-void Shader::set_int(const std::string& name, int value) const {
-    glUniform1i(glGetUniformLocation(program_ID, name.c_str()), value);
-}
\ No newline at end of file
+void Shader::set_int(UniformName name, int value) const {
+    glUniform1i(get_uniform_location(name), value);
+}
@@ -1,26 +1,14 @@
 #version 330 core
 
-in vec3 world_pos; // Interpolated world position from vertex shader
+in vec3 world_pos;
+in vec2 plane_uv;
 out vec4 frag_color;
 
-uniform float pixels_per_meter;
-uniform vec2 resolution;
+uniform sampler2D field_magnitude; // Field strength over the plane, see FieldPlaneTexture
+uniform vec3 bounds_half_extents;  // Slices with a custom normal are clipped to the cuboid
 uniform float plane_opacity;
 uniform float sensitivity_scaled;
 
-// Magnetic dipole struct
-struct MagneticDipole {
-    vec3 position;
-    vec3 direction;
-    float moment;
-};
-
-// Use UBO in a uniform array to pass in large sets of dipole data
-layout (std140) uniform DipoleBuffer {
-    MagneticDipole dipoles[1024]; // Up to 1024 dipoles
-};
-uniform int num_dipoles;
-
 float hue2rgb(float f1, float f2, float hue) {
     if (hue < 0.0)
         hue += 1.0;
@@ -60,53 +48,13 @@ vec3 hsl2rgb(float h, float s, float l) {
     return hsl2rgb(vec3(h, s, l));
 }
 
-vec3 calculateMagneticField(vec3 pos, MagneticDipole dipole) {
-    vec3 A = pos - dipole.position;
-    float r = length(A);
-    if (r < 0.0001) return vec3(0.0); // Avoid divide-by-zero
-    vec3 A_rad = A / r;
-
-    // Find a perpendicular axis for tangential plane
-    vec3 perpAxis;
-    if (abs(A_rad.x) < abs(A_rad.y) && abs(A_rad.x) < abs(A_rad.z)) {
-        perpAxis = vec3(1.0, 0.0, 0.0);
-    } else if (abs(A_rad.y) < abs(A_rad.z)) {
-        perpAxis = vec3(0.0, 1.0, 0.0);
-    } else {
-        perpAxis = vec3(0.0, 0.0, 1.0);
-    }
-
-    vec3 A_tan1 = normalize(cross(A_rad, perpAxis));
-    vec3 A_tan2 = cross(A_rad, A_tan1);
-
-    float cos_theta = dot(A_rad, dipole.direction);
-    vec3 dirTangential = dipole.direction - cos_theta * A_rad;
-    float sin_theta_mag = length(dirTangential);
-
-    float r_meters = r / pixels_per_meter;
-    float r_cube = r_meters * r_meters * r_meters;
-
-    float B_r = (2.0 * dipole.moment * cos_theta) / r_cube;
-    vec3 B_field = B_r * A_rad;
-
-    if (sin_theta_mag > 0.0001) {
-        vec3 A_tan_dir = dirTangential / sin_theta_mag;
-        float B_theta = (dipole.moment * sin_theta_mag) / r_cube;
-        B_field += B_theta * A_tan_dir;
-    }
-
-    return B_field;
-}
-
 void main() {
-    // Calculate total magnetic field at world_pos
-    vec3 field_str = vec3(0.0);
-    for (int i = 0; i < num_dipoles; i++) {
-        field_str += calculateMagneticField(world_pos, dipoles[i]);
+    if (any(greaterThan(abs(world_pos), bounds_half_extents * 1.0001))) {
+        discard;
     }
 
     // Map field strength to color
-    float field_str_len = length(field_str);
+    float field_str_len = texture(field_magnitude, plane_uv).r;
     float normalized_field = min(field_str_len * 0.000001 * sensitivity_scaled, 1.0);
     vec3 col = hsl2rgb((1.0 - normalized_field) * (300.0 / 360.0), 1.0, min(normalized_field * 2.0, 0.5));
     frag_color = vec4(col, plane_opacity);
@@ -1,12 +1,26 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <iostream>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// FNV-1a hash of a uniform name, constexpr so names given as literals hash at compile time
+constexpr uint32_t hash_uniform_name(const char* name, uint32_t hash = 2166136261u) {
+    return *name ? hash_uniform_name(name + 1, (hash ^ static_cast<uint8_t>(*name)) * 16777619u) : hash;
+}
+
+// Hashed uniform name, built implicitly from the string literals passed to the set_* calls
+struct UniformName {
+    uint32_t hash;
+    constexpr UniformName(const char* uniform_name) : hash(hash_uniform_name(uniform_name)) {}
+    UniformName(const std::string& uniform_name) : hash(hash_uniform_name(uniform_name.c_str())) {}
+};
+
 class Shader
 {
 public:
@@ -17,14 +31,23 @@ public:
 
     void use_shader();
 
-    void set_float(const std::string& name, float value) const;
-    void set_vec2(const std::string& name, glm::vec2 vec) const;
-    void set_vec3(const std::string& name, glm::vec3 vec) const;
-    void set_vec4(const std::string& name, glm::vec4 vec) const;
-    void set_mat4(const std::string& name, glm::mat4 mat) const;
-    void set_int(const std::string& name, int value) const;
+    // Uniform setters look up locations cached at link time, unknown names are ignored like location -1
+    void set_float(UniformName name, float value) const;
+    void set_vec2(UniformName name, glm::vec2 vec) const;
+    void set_vec3(UniformName name, glm::vec3 vec) const;
+    void set_vec4(UniformName name, glm::vec4 vec) const;
+    void set_mat4(UniformName name, glm::mat4 mat) const;
+    void set_int(UniformName name, int value) const;
+
+    GLint get_uniform_location(UniformName name) const;
+    // Assign a uniform block to a binding point, returns false if the program has no such block
+    bool bind_uniform_block(const char* block_name, unsigned int binding);
 
 private:
+    // Active uniform locations sorted by name hash
+    std::vector<std::pair<uint32_t, GLint>> uniform_locations;
+
+    void cache_uniform_locations();
     // Updated to take shader source string instead of file path
     void add_shader(unsigned int program, const char* shader_source, GLenum shader_type);
 };
\ No newline at end of file
@@ -1,12 +1,17 @@
 #version 330 core
 layout (location = 0) in vec3 pos;
+layout (location = 1) in vec2 uv; // Plane coordinates, for sampling the field magnitude texture
 
-uniform mat4 view;
-uniform mat4 projection;
-out vec3 world_pos; // Pass world position to fragment shader
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+};
+out vec3 world_pos;
+out vec2 plane_uv;
 
 void main()
 {
     gl_Position = projection * view * vec4(pos, 1.0);
     world_pos = pos; // Vertex position is already in world space
+    plane_uv = uv;
 }
\ No newline at end of file
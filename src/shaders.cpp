@@ -0,0 +1,353 @@
+#include "shaders.h"
+
+const char* shader_vert = R"(
+#version 330 core
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec2 uv; // Plane coordinates, for sampling the field magnitude texture
+
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+};
+out vec3 world_pos;
+out vec2 plane_uv;
+
+void main()
+{
+    gl_Position = projection * view * vec4(pos, 1.0);
+    world_pos = pos; // Vertex position is already in world space
+    plane_uv = uv;
+}
+)";
+
+const char* shader_frag = R"(
+#version 330 core
+
+in vec3 world_pos;
+in vec2 plane_uv;
+out vec4 frag_color;
+
+uniform sampler2D field_magnitude; // Field strength over the plane, see FieldPlaneTexture
+uniform vec3 bounds_half_extents;  // Slices with a custom normal are clipped to the cuboid
+uniform float plane_opacity;
+uniform float sensitivity_scaled;
+
+float hue2rgb(float f1, float f2, float hue) {
+    if (hue < 0.0)
+        hue += 1.0;
+    else if (hue > 1.0)
+        hue -= 1.0;
+    float res;
+    if ((6.0 * hue) < 1.0)
+        res = f1 + (f2 - f1) * 6.0 * hue;
+    else if ((2.0 * hue) < 1.0)
+        res = f2;
+    else if ((3.0 * hue) < 2.0)
+        res = f1 + (f2 - f1) * ((2.0 / 3.0) - hue) * 6.0;
+    else
+        res = f1;
+    return res;
+}
+
+vec3 hsl2rgb(vec3 hsl) {
+    vec3 rgb;
+    if (hsl.y == 0.0) {
+        rgb = vec3(hsl.z); // Luminance
+    } else {
+        float f2;
+        if (hsl.z < 0.5)
+            f2 = hsl.z * (1.0 + hsl.y);
+        else
+            f2 = hsl.z + hsl.y - hsl.y * hsl.z;
+        float f1 = 2.0 * hsl.z - f2;
+        rgb.r = hue2rgb(f1, f2, hsl.x + (1.0 / 3.0));
+        rgb.g = hue2rgb(f1, f2, hsl.x);
+        rgb.b = hue2rgb(f1, f2, hsl.x - (1.0 / 3.0));
+    }
+    return rgb;
+}
+
+vec3 hsl2rgb(float h, float s, float l) {
+    return hsl2rgb(vec3(h, s, l));
+}
+
+void main() {
+    if (any(greaterThan(abs(world_pos), bounds_half_extents * 1.0001))) {
+        discard;
+    }
+
+    // Map field strength to color
+    float field_str_len = texture(field_magnitude, plane_uv).r;
+    float normalized_field = min(field_str_len * 0.000001 * sensitivity_scaled, 1.0);
+    vec3 col = hsl2rgb((1.0 - normalized_field) * (300.0 / 360.0), 1.0, min(normalized_field * 2.0, 0.5));
+    frag_color = vec4(col, plane_opacity);
+}
+)";
+
+const char* field_bake_vert = R"(
+#version 330 core
+
+out vec2 plane_uv;
+
+void main()
+{
+    // Single triangle covering the viewport, no vertex buffer needed
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    plane_uv = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+const char* field_bake_frag = R"(
+in vec2 plane_uv;
+out float field_magnitude;
+
+uniform float pixels_per_meter;
+uniform vec3 plane_origin; // Corner of the field plane at plane coordinates (0, 0)
+uniform vec3 plane_axis_u; // Edge of the field plane along u
+uniform vec3 plane_axis_v; // Edge of the field plane along v
+
+// Magnetic dipole struct
+struct MagneticDipole {
+    vec3 position;
+    vec3 direction;
+    float moment;
+};
+
+// Dipole sources from DipoleSourceBuffer, two vec4 per dipole: (position, moment) and (direction, 0).
+// The #version line and DIPOLE_SOURCES_SSBO define are prepended by DipoleSourceBuffer::shaderHeader.
+#ifdef DIPOLE_SOURCES_SSBO
+layout (std430, binding = 0) readonly buffer DipoleSources {
+    vec4 dipole_data[];
+};
+
+MagneticDipole fetchDipole(int i) {
+    vec4 position_moment = dipole_data[2 * i];
+    return MagneticDipole(position_moment.xyz, dipole_data[2 * i + 1].xyz, position_moment.w);
+}
+#else
+uniform samplerBuffer dipole_data;
+
+MagneticDipole fetchDipole(int i) {
+    vec4 position_moment = texelFetch(dipole_data, 2 * i);
+    return MagneticDipole(position_moment.xyz, texelFetch(dipole_data, 2 * i + 1).xyz, position_moment.w);
+}
+#endif
+uniform int num_dipoles;
+
+vec3 calculateMagneticField(vec3 pos, MagneticDipole dipole) {
+    vec3 A = pos - dipole.position;
+    float r = length(A);
+    if (r < 0.0001) return vec3(0.0); // Avoid divide-by-zero
+    vec3 A_rad = A / r;
+
+    // Find a perpendicular axis for tangential plane
+    vec3 perpAxis;
+    if (abs(A_rad.x) < abs(A_rad.y) && abs(A_rad.x) < abs(A_rad.z)) {
+        perpAxis = vec3(1.0, 0.0, 0.0);
+    } else if (abs(A_rad.y) < abs(A_rad.z)) {
+        perpAxis = vec3(0.0, 1.0, 0.0);
+    } else {
+        perpAxis = vec3(0.0, 0.0, 1.0);
+    }
+
+    vec3 A_tan1 = normalize(cross(A_rad, perpAxis));
+    vec3 A_tan2 = cross(A_rad, A_tan1);
+
+    float cos_theta = dot(A_rad, dipole.direction);
+    vec3 dirTangential = dipole.direction - cos_theta * A_rad;
+    float sin_theta_mag = length(dirTangential);
+
+    float r_meters = r / pixels_per_meter;
+    float r_cube = r_meters * r_meters * r_meters;
+
+    float B_r = (2.0 * dipole.moment * cos_theta) / r_cube;
+    vec3 B_field = B_r * A_rad;
+
+    if (sin_theta_mag > 0.0001) {
+        vec3 A_tan_dir = dirTangential / sin_theta_mag;
+        float B_theta = (dipole.moment * sin_theta_mag) / r_cube;
+        B_field += B_theta * A_tan_dir;
+    }
+
+    return B_field;
+}
+
+void main() {
+    // Calculate total magnetic field at this texel of the plane
+    vec3 world_pos = plane_origin + plane_uv.x * plane_axis_u + plane_uv.y * plane_axis_v;
+    vec3 field_str = vec3(0.0);
+    for (int i = 0; i < num_dipoles; i++) {
+        field_str += calculateMagneticField(world_pos, fetchDipole(i));
+    }
+    field_magnitude = length(field_str);
+}
+)";
+
+const char* cuboid_vert = R"(
+#version 330 core
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec4 in_color;
+
+uniform mat4 model;
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+};
+
+out vec4 vertex_color; // Pass color to fragment shader
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(pos, 1.0);
+    vertex_color = in_color;
+}
+)";
+
+const char* cuboid_frag = R"(
+#version 330 core
+out vec4 frag_color;
+
+in vec4 vertex_color; // Color from vertex shader
+uniform vec4 color; // Fallback uniform color
+
+void main()
+{
+    // Use vertex color if available (non-zero), otherwise use uniform color
+    if (vertex_color.a > 0.0) {
+        frag_color = vertex_color;
+    } else {
+        frag_color = color;
+    }
+}
+)";
+
+const char* dipole_vert = R"(
+#version 330 core
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec4 in_color;
+layout (location = 2) in vec3 instance_position;
+layout (location = 3) in vec4 instance_rotation; // Quaternion (x, y, z, w)
+layout (location = 4) in vec4 instance_color;
+
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+};
+uniform int use_vertex_color; // 1 for mesh vertex colors, 0 for per-instance color
+
+out vec4 vertex_color; // Pass color to fragment shader
+
+vec3 rotate(vec4 q, vec3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    vec3 world_pos = instance_position + rotate(instance_rotation, pos);
+    gl_Position = projection * view * vec4(world_pos, 1.0);
+    vertex_color = (use_vertex_color == 1) ? in_color : instance_color;
+}
+)";
+
+const char* dipole_frag = R"(
+#version 330 core
+out vec4 frag_color;
+
+in vec4 vertex_color; // Color from vertex shader
+
+void main()
+{
+    frag_color = vertex_color;
+}
+)";
+
+const char* field_line_vert = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;           // World position, or normalized over the cuboid bounds
+layout (location = 1) in float aFieldStrength; // Field magnitude, or normalized log10 magnitude
+
+out float field_strength;
+
+uniform mat4 model;
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+};
+uniform vec3 position_offset; // Decodes compact positions, zero for float vertices
+uniform vec3 position_scale;  // Decodes compact positions, one for float vertices
+uniform int field_log_encoded;
+uniform vec2 field_log_range; // log10 magnitude range of the compact encoding
+
+void main()
+{
+    if (field_log_encoded == 1) {
+        field_strength = aFieldStrength > 0.0 ? pow(10.0, mix(field_log_range.x, field_log_range.y, aFieldStrength)) : 0.0;
+    } else {
+        field_strength = aFieldStrength;
+    }
+    vec3 position = position_offset + aPos * position_scale;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+}
+)";
+
+const char* field_line_frag = R"(
+#version 330 core
+in float field_strength;
+out vec4 frag_color;
+
+uniform int use_color; // 0 for white, 1 for colored
+uniform float sensitivity_scaled;
+
+float hue2rgb(float f1, float f2, float hue) {
+    if (hue < 0.0)
+        hue += 1.0;
+    else if (hue > 1.0)
+        hue -= 1.0;
+    float res;
+    if ((6.0 * hue) < 1.0)
+        res = f1 + (f2 - f1) * 6.0 * hue;
+    else if ((2.0 * hue) < 1.0)
+        res = f2;
+    else if ((3.0 * hue) < 2.0)
+        res = f1 + (f2 - f1) * ((2.0 / 3.0) - hue) * 6.0;
+    else
+        res = f1;
+    return res;
+}
+
+vec3 hsl2rgb(vec3 hsl) {
+    vec3 rgb;
+    if (hsl.y == 0.0) {
+        rgb = vec3(hsl.z); // Luminance
+    } else {
+        float f2;
+        if (hsl.z < 0.5)
+            f2 = hsl.z * (1.0 + hsl.y);
+        else
+            f2 = hsl.z + hsl.y - hsl.y * hsl.z;
+        float f1 = 2.0 * hsl.z - f2;
+        rgb.r = hue2rgb(f1, f2, hsl.x + (1.0 / 3.0));
+        rgb.g = hue2rgb(f1, f2, hsl.x);
+        rgb.b = hue2rgb(f1, f2, hsl.x - (1.0 / 3.0));
+    }
+    return rgb;
+}
+
+vec3 hsl2rgb(float h, float s, float l) {
+    return hsl2rgb(vec3(h, s, l));
+}
+
+void main()
+{
+    if (use_color == 1) {
+        // Existing color mapping (blue for weak, red for strong)
+        float normalized_field = min(field_strength * 0.000001 * sensitivity_scaled, 1.0);
+        vec3 col = hsl2rgb((1.0 - normalized_field) * (300.0 / 360.0), 1.0, min(normalized_field * 2.0, 0.5));
+        frag_color = vec4(col, 1.0f);
+    } else {
+        // Plain white
+        frag_color = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+}
+)";
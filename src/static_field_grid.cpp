@@ -0,0 +1,392 @@
+#include "static_field_grid.h"
+#include "dipole.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// Run body(begin, end) over [0, count) split evenly across the hardware threads
+template <typename Body>
+static void parallelFor(size_t count, Body body) {
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::min(num_threads, std::max<size_t>(count / 64, 1));
+    std::vector<std::thread> threads;
+    size_t chunk = (count + num_threads - 1) / num_threads;
+    for (size_t t = 1; t < num_threads; ++t) {
+        size_t begin = std::min(t * chunk, count);
+        size_t end = std::min(begin + chunk, count);
+        threads.emplace_back([&body, begin, end]() { body(begin, end); });
+    }
+    body(0, std::min(chunk, count));
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Sources merged into one dipole for distant nodes
+struct SourceCluster {
+    glm::dvec3 moment{ 0.0 };
+    // Column a sums each source's position times its moment along a, the spread of the
+    // moments that one dipole at the centroid misses
+    glm::dmat3 moment_positions{ 0.0 };
+    glm::dvec3 weighted_position{ 0.0 };
+    double weight = 0.0;
+    glm::vec3 box_min{ 0.0f };
+    glm::vec3 box_max{ 0.0f };
+    uint32_t count = 0;
+    uint32_t source = 0; // The only source when count is 1
+
+    void add(const SourceCluster& other) {
+        box_min = count > 0 ? glm::min(box_min, other.box_min) : other.box_min;
+        box_max = count > 0 ? glm::max(box_max, other.box_max) : other.box_max;
+        source = count > 0 ? source : other.source;
+        moment += other.moment;
+        moment_positions += other.moment_positions;
+        weighted_position += other.weighted_position;
+        weight += other.weight;
+        count += other.count;
+    }
+    // Moment weighted centroid, the box centre when every moment is zero
+    glm::vec3 centroid() const {
+        return weight > 0.0 ? glm::vec3(weighted_position / weight) : (box_min + box_max) * 0.5f;
+    }
+};
+
+// Add the field of cluster at pos to second order in its extent, and its Jacobian to first order
+static void addClusterField(const SourceCluster& cluster, const glm::vec3& pos, float pixels_per_meter, glm::dvec3& field, glm::dmat3& gradient) {
+    // Moment vector as the direction with unit moment, the field is linear in both
+    glm::vec3 centroid = cluster.centroid();
+    glm::vec3 moment(cluster.moment);
+    field += glm::dvec3(MagneticDipole::calculateDipoleField(pos, centroid, moment, 1.0f, pixels_per_meter));
+    gradient += glm::dmat3(MagneticDipole::calculateDipoleFieldGradient(pos, centroid, moment, 1.0f, pixels_per_meter));
+
+    // Moving a source off the centroid by o changes its field by minus the Jacobian times o.
+    // Summed over the cluster that needs only the spread S, column a being the offsets
+    // weighted by the moments along a, which folds the Jacobian above into
+    // -k / r^5 (tr(S) A - 3 S^T A - 5 (A . S A) A / r^2 + S A).
+    glm::dvec3 A = glm::dvec3(pos) - glm::dvec3(centroid);
+    double r2 = glm::dot(A, A);
+    if (r2 < 1e-8) {
+        return;
+    }
+    glm::dmat3 spread = cluster.moment_positions - glm::outerProduct(glm::dvec3(centroid), cluster.moment);
+    double k = static_cast<double>(pixels_per_meter) * pixels_per_meter * pixels_per_meter;
+    double scale = k / (r2 * r2 * std::sqrt(r2));
+    glm::dvec3 spread_A = spread * A;
+    double trace = spread[0][0] + spread[1][1] + spread[2][2];
+    field -= scale * (trace * A - 3.0 * (glm::transpose(spread) * A) - 5.0 * glm::dot(A, spread_A) / r2 * A + spread_A);
+}
+
+template <typename Visit>
+void StaticFieldGrid::forEachNearSource(const glm::ivec3& cell, Visit visit) const {
+    glm::ivec3 first = glm::max(cell - NEAR_CELLS, glm::ivec3(0));
+    glm::ivec3 last = glm::min(cell + NEAR_CELLS, m_dims - 1);
+    for (int z = first.z; z <= last.z; ++z) {
+        for (int y = first.y; y <= last.y; ++y) {
+            // Cells along x are contiguous, so the row is one run of sources
+            size_t row = cellIndex(glm::ivec3(0, y, z));
+            for (int x = first.x; x <= last.x; ++x) {
+                glm::ivec3 offset = glm::ivec3(x, y, z) - cell;
+                for (uint32_t n = m_cell_offsets[row + x]; n < m_cell_offsets[row + x + 1]; ++n) {
+                    visit(m_cell_sources[n], offset);
+                }
+            }
+        }
+    }
+}
+
+void StaticFieldGrid::build(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& directions, const std::vector<float>& moments,
+    float pixels_per_meter, const glm::vec3& bounds_min, const glm::vec3& bounds_max, float cell_size) {
+    clear();
+    m_positions = positions;
+    m_directions = directions;
+    m_moments = moments;
+    m_pixels_per_meter = pixels_per_meter;
+    if (m_positions.empty()) {
+        return;
+    }
+
+    glm::vec3 extent = glm::max(bounds_max - bounds_min, glm::vec3(1e-3f));
+    float longest = std::max(extent.x, std::max(extent.y, extent.z));
+    m_cell_size = std::max({ cell_size, longest / MAX_CELLS_PER_AXIS, 1e-3f });
+    m_dims = glm::max(glm::ivec3(glm::ceil(extent / m_cell_size)), glm::ivec3(1));
+    m_min = bounds_min;
+
+    // Bin the sources, ones outside the bounds go to the nearest boundary cell so cells
+    // next to them still sum them exactly
+    const size_t num_cells = getCellCount();
+    std::vector<uint32_t> source_cells(m_positions.size());
+    m_cell_offsets.assign(num_cells + 1, 0);
+    for (size_t s = 0; s < m_positions.size(); ++s) {
+        glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor((m_positions[s] - m_min) / m_cell_size)), glm::ivec3(0), m_dims - 1);
+        source_cells[s] = static_cast<uint32_t>(cellIndex(cell));
+        ++m_cell_offsets[source_cells[s] + 1];
+    }
+    for (size_t c = 0; c < num_cells; ++c) {
+        m_cell_offsets[c + 1] += m_cell_offsets[c];
+    }
+    m_cell_sources.resize(m_positions.size());
+    std::vector<uint32_t> fill(m_cell_offsets.begin(), m_cell_offsets.end() - 1);
+    for (size_t s = 0; s < m_positions.size(); ++s) {
+        m_cell_sources[fill[source_cells[s]]++] = static_cast<uint32_t>(s);
+    }
+
+    // Pyramid of source clusters, level 0 is the cells and each level above halves the
+    // dims. A cluster keeps its summed moment vector at the moment weighted centroid and
+    // the box around its sources, which can reach past its cells for sources outside the bounds.
+    std::vector<glm::ivec3> level_dims(1, m_dims);
+    std::vector<std::vector<SourceCluster>> levels(1, std::vector<SourceCluster>(num_cells));
+    for (size_t c = 0; c < num_cells; ++c) {
+        SourceCluster& cluster = levels[0][c];
+        for (uint32_t n = m_cell_offsets[c]; n < m_cell_offsets[c + 1]; ++n) {
+            uint32_t s = m_cell_sources[n];
+            SourceCluster single;
+            single.moment = glm::dvec3(m_directions[s]) * static_cast<double>(m_moments[s]);
+            single.moment_positions = glm::outerProduct(glm::dvec3(m_positions[s]), single.moment);
+            single.weight = std::abs(m_moments[s]);
+            single.weighted_position = glm::dvec3(m_positions[s]) * single.weight;
+            single.box_min = single.box_max = m_positions[s];
+            single.count = 1;
+            single.source = s;
+            cluster.add(single);
+        }
+    }
+    while (glm::any(glm::greaterThan(level_dims.back(), glm::ivec3(1)))) {
+        const glm::ivec3 child_dims = level_dims.back();
+        const glm::ivec3 dims = (child_dims + 1) / 2;
+        std::vector<SourceCluster> parents(static_cast<size_t>(dims.x) * dims.y * dims.z);
+        const std::vector<SourceCluster>& children = levels.back();
+        for (int z = 0; z < child_dims.z; ++z) {
+            for (int y = 0; y < child_dims.y; ++y) {
+                for (int x = 0; x < child_dims.x; ++x) {
+                    const SourceCluster& child = children[(static_cast<size_t>(z) * child_dims.y + y) * child_dims.x + x];
+                    if (child.count > 0) {
+                        parents[(static_cast<size_t>(z / 2) * dims.y + y / 2) * dims.x + x / 2].add(child);
+                    }
+                }
+            }
+        }
+        level_dims.push_back(dims);
+        levels.push_back(std::move(parents));
+    }
+
+    // Field and Jacobian at every node of the sources outside the NEAR_CELLS cells around it,
+    // walking the pyramid from the top. A cluster wholly inside that region is skipped, one
+    // cutting into it or too close for its extent is opened, and a cell that still cannot
+    // stand in for its sources sums them exactly. Sums are kept in double precision.
+    const glm::ivec3 node_dims = m_dims + 1;
+    const size_t num_nodes = static_cast<size_t>(node_dims.x) * node_dims.y * node_dims.z;
+    m_node_fields.resize(num_nodes);
+    m_node_gradients.resize(num_nodes);
+    const int top = static_cast<int>(levels.size()) - 1;
+    parallelFor(num_nodes, [&](size_t begin, size_t end) {
+        std::vector<glm::ivec4> stack; // Cell and level
+        for (size_t n = begin; n < end; ++n) {
+            glm::ivec3 node(static_cast<int>(n % node_dims.x), static_cast<int>(n / node_dims.x % node_dims.y),
+                static_cast<int>(n / (static_cast<size_t>(node_dims.x) * node_dims.y)));
+            glm::vec3 pos = nodePosition(node);
+            glm::ivec3 near_first = node - NEAR_CELLS;
+            glm::ivec3 near_last = node + (NEAR_CELLS - 1);
+            glm::dvec3 field(0.0);
+            glm::dmat3 gradient(0.0);
+            stack.assign(1, glm::ivec4(0, 0, 0, top));
+            while (!stack.empty()) {
+                glm::ivec4 entry = stack.back();
+                stack.pop_back();
+                const int level = entry.w;
+                const glm::ivec3 cell(entry);
+                const glm::ivec3& dims = level_dims[level];
+                const SourceCluster& cluster = levels[level][(static_cast<size_t>(cell.z) * dims.y + cell.y) * dims.x + cell.x];
+                if (cluster.count == 0) {
+                    continue;
+                }
+                glm::ivec3 first = cell * (1 << level);
+                glm::ivec3 last = glm::min(first + ((1 << level) - 1), m_dims - 1);
+                if (glm::all(glm::greaterThanEqual(first, near_first)) && glm::all(glm::lessThanEqual(last, near_last))) {
+                    continue;
+                }
+                bool overlaps = glm::all(glm::lessThanEqual(first, near_last)) && glm::all(glm::greaterThanEqual(last, near_first));
+                if (!overlaps && cluster.count == 1) {
+                    // A lone source is cheaper exact than as a cluster
+                    field += glm::dvec3(sourceField(cluster.source, pos));
+                    gradient += glm::dmat3(sourceGradient(cluster.source, pos));
+                    continue;
+                }
+                if (!overlaps) {
+                    float distance = glm::length(pos - glm::clamp(pos, cluster.box_min, cluster.box_max));
+                    if (glm::length(cluster.box_max - cluster.box_min) < CLUSTER_OPENING * distance) {
+                        addClusterField(cluster, pos, m_pixels_per_meter, field, gradient);
+                        continue;
+                    }
+                    if (level == 0) {
+                        size_t c = cellIndex(cell);
+                        for (uint32_t i = m_cell_offsets[c]; i < m_cell_offsets[c + 1]; ++i) {
+                            field += glm::dvec3(sourceField(m_cell_sources[i], pos));
+                            gradient += glm::dmat3(sourceGradient(m_cell_sources[i], pos));
+                        }
+                        continue;
+                    }
+                }
+                const glm::ivec3& child_dims = level_dims[level - 1];
+                for (int k = 0; k < 8; ++k) {
+                    glm::ivec3 child = cell * 2 + glm::ivec3(k & 1, (k >> 1) & 1, (k >> 2) & 1);
+                    if (glm::all(glm::lessThan(child, child_dims))) {
+                        stack.push_back(glm::ivec4(child, level - 1));
+                    }
+                }
+            }
+            m_node_fields[n] = glm::vec3(field);
+            m_node_gradients[n] = glm::mat3(gradient);
+        }
+    });
+}
+
+void StaticFieldGrid::clear() {
+    m_positions.clear();
+    m_directions.clear();
+    m_moments.clear();
+    m_dims = glm::ivec3(0);
+    m_cell_offsets.clear();
+    m_cell_sources.clear();
+    m_node_fields.clear();
+    m_node_gradients.clear();
+}
+
+size_t StaticFieldGrid::getByteSize() const {
+    return m_positions.size() * (2 * sizeof(glm::vec3) + sizeof(float) + sizeof(uint32_t))
+        + m_cell_offsets.size() * sizeof(uint32_t)
+        + m_node_fields.size() * (sizeof(glm::vec3) + sizeof(glm::mat3));
+}
+
+glm::vec3 StaticFieldGrid::sourceField(size_t source, const glm::vec3& pos) const {
+    return MagneticDipole::calculateDipoleField(pos, m_positions[source], m_directions[source], m_moments[source], m_pixels_per_meter);
+}
+
+glm::mat3 StaticFieldGrid::sourceGradient(size_t source, const glm::vec3& pos) const {
+    return MagneticDipole::calculateDipoleFieldGradient(pos, m_positions[source], m_directions[source], m_moments[source], m_pixels_per_meter);
+}
+
+bool StaticFieldGrid::locate(const glm::vec3& pos, glm::ivec3& cell, glm::vec3& local) const {
+    if (empty()) {
+        return false;
+    }
+    glm::vec3 relative = (pos - m_min) / m_cell_size;
+    if (glm::any(glm::lessThan(relative, glm::vec3(0.0f))) || glm::any(glm::greaterThan(relative, glm::vec3(m_dims)))) {
+        return false;
+    }
+    cell = glm::clamp(glm::ivec3(glm::floor(relative)), glm::ivec3(0), m_dims - 1);
+    local = relative - glm::vec3(cell);
+    return true;
+}
+
+glm::vec3 StaticFieldGrid::sample(const glm::vec3& pos) const {
+    glm::vec3 field;
+    evaluate(pos, field, nullptr);
+    return field;
+}
+
+void StaticFieldGrid::sample(const glm::vec3& pos, glm::vec3& field, glm::mat3& gradient) const {
+    evaluate(pos, field, &gradient);
+}
+
+void StaticFieldGrid::evaluate(const glm::vec3& pos, glm::vec3& field, glm::mat3* gradient) const {
+    field = glm::vec3(0.0f);
+    if (gradient) {
+        *gradient = glm::mat3(0.0f);
+    }
+    glm::ivec3 cell;
+    glm::vec3 local;
+    if (!locate(pos, cell, local)) {
+        for (size_t s = 0; s < m_positions.size(); ++s) {
+            field += sourceField(s, pos);
+            if (gradient) {
+                *gradient += sourceGradient(s, pos);
+            }
+        }
+        return;
+    }
+
+    glm::vec3 corner_fields[8];
+    glm::mat3 corner_gradients[8];
+    for (int k = 0; k < 8; ++k) {
+        size_t n = nodeIndex(cell + glm::ivec3(k & 1, (k >> 1) & 1, (k >> 2) & 1));
+        corner_fields[k] = m_node_fields[n];
+        corner_gradients[k] = m_node_gradients[n];
+    }
+    forEachNearSource(cell, [&](uint32_t s, const glm::ivec3& offset) {
+        field += sourceField(s, pos);
+        if (gradient) {
+            *gradient += sourceGradient(s, pos);
+        }
+        // A source on the outer shell is outside the near cells of the corners on the far
+        // side of that axis, so those corners still hold it
+        for (int k = 0; k < 8; ++k) {
+            bool holds = false;
+            for (int a = 0; a < 3; ++a) {
+                int bit = (k >> a) & 1;
+                holds = holds || (offset[a] == -NEAR_CELLS && bit == 1) || (offset[a] == NEAR_CELLS && bit == 0);
+            }
+            if (holds) {
+                glm::vec3 corner = nodePosition(cell + glm::ivec3(k & 1, (k >> 1) & 1, (k >> 2) & 1));
+                corner_fields[k] -= sourceField(s, corner);
+                corner_gradients[k] -= sourceGradient(s, corner);
+            }
+        }
+    });
+    interpolate(local, corner_fields, corner_gradients, field, gradient);
+}
+
+void StaticFieldGrid::interpolate(const glm::vec3& local, const glm::vec3* corner_fields, const glm::mat3* corner_gradients,
+    glm::vec3& field, glm::mat3* gradient) const {
+    // Cubic Hermite basis along each axis, for the value and the derivative at either end,
+    // and their derivatives along the axis
+    const float h = m_cell_size;
+    float value_weights[3][2], slope_weights[3][2], value_rates[3][2], slope_rates[3][2];
+    for (int a = 0; a < 3; ++a) {
+        float t = local[a];
+        float t2 = t * t;
+        float t3 = t2 * t;
+        value_weights[a][0] = 2.0f * t3 - 3.0f * t2 + 1.0f;
+        value_weights[a][1] = -2.0f * t3 + 3.0f * t2;
+        slope_weights[a][0] = (t3 - 2.0f * t2 + t) * h;
+        slope_weights[a][1] = (t3 - t2) * h;
+        value_rates[a][0] = (6.0f * t2 - 6.0f * t) / h;
+        value_rates[a][1] = -value_rates[a][0];
+        slope_rates[a][0] = 3.0f * t2 - 4.0f * t + 1.0f;
+        slope_rates[a][1] = 3.0f * t2 - 2.0f * t;
+    }
+
+    // Tensor product of the value weights, plus one slope term per axis with the slope
+    // weight on that axis. Cross derivatives are not stored and taken as zero.
+    for (int k = 0; k < 8; ++k) {
+        const int bits[3] = { k & 1, (k >> 1) & 1, (k >> 2) & 1 };
+        const glm::vec3& corner_field = corner_fields[k];
+        const glm::mat3& corner_gradient = corner_gradients[k];
+        // Product of the value weights of every axis except the ones skipped
+        auto values_except = [&](int skip_a, int skip_b) {
+            float product = 1.0f;
+            for (int a = 0; a < 3; ++a) {
+                if (a != skip_a && a != skip_b) {
+                    product *= value_weights[a][bits[a]];
+                }
+            }
+            return product;
+        };
+
+        field += values_except(-1, -1) * corner_field;
+        for (int a = 0; a < 3; ++a) {
+            field += slope_weights[a][bits[a]] * values_except(a, -1) * corner_gradient[a];
+        }
+        if (!gradient) {
+            continue;
+        }
+        for (int c = 0; c < 3; ++c) {
+            glm::vec3 column = value_rates[c][bits[c]] * values_except(c, -1) * corner_field;
+            for (int a = 0; a < 3; ++a) {
+                float rate = a == c ? slope_rates[a][bits[a]] * values_except(a, -1)
+                    : slope_weights[a][bits[a]] * value_rates[c][bits[c]] * values_except(a, c);
+                column += rate * corner_gradient[a];
+            }
+            (*gradient)[c] += column;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Combined field of a fixed set of source dipoles, precomputed so a query costs a handful of
+// sources instead of all of them. The bounds are cut into cubic cells. Sources up to
+// NEAR_CELLS cells from a query's cell are summed exactly, their field is too sharp to
+// interpolate. Every other source is smooth across the cell, so its field and Jacobian are
+// interpolated from the cell's 8 corner nodes with cubic Hermite weights, the Jacobian
+// supplying the slopes. Each node is stored once and leaves out the sources within NEAR_CELLS
+// of itself. A query's cell leaves out a shell one cell wider, so the sources in that shell
+// are taken off the corners that still hold them, which keeps all 8 corners on the same far
+// field. Queries outside the bounds sum every source exactly.
+class StaticFieldGrid {
+public:
+    StaticFieldGrid() = default;
+
+    // Cache the sources, positions, directions and moments are copied so the grid stays
+    // valid after the caller changes them. Cells are at least cell_size on a side and
+    // coarsened to at most MAX_CELLS_PER_AXIS per axis. Distant sources are merged into
+    // clusters from a pyramid of cells, so each node costs about the log of the source count
+    // rather than all of them, and the nodes are spread over the hardware threads.
+    void build(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& directions, const std::vector<float>& moments,
+        float pixels_per_meter, const glm::vec3& bounds_min, const glm::vec3& bounds_max, float cell_size);
+    void clear();
+
+    bool empty() const { return m_positions.empty(); }
+    size_t getSourceCount() const { return m_positions.size(); }
+    size_t getCellCount() const { return static_cast<size_t>(m_dims.x) * m_dims.y * m_dims.z; }
+    size_t getByteSize() const;
+
+    // Field at pos
+    glm::vec3 sample(const glm::vec3& pos) const;
+    // Field at pos and its Jacobian, column k is the derivative along axis k
+    void sample(const glm::vec3& pos, glm::vec3& field, glm::mat3& gradient) const;
+
+    static constexpr int MAX_CELLS_PER_AXIS = 64;
+    // Rings of cells summed exactly around a query. The dipole field has no length scale,
+    // so the interpolation error is set by this ring alone, one ring leaves a few percent
+    // in the force and two bring it under half a percent.
+    static constexpr int NEAR_CELLS = 2;
+    // A cluster of sources stands in for them at a node once its extent is below this
+    // fraction of its distance to the node
+    static constexpr float CLUSTER_OPENING = 0.3f;
+
+private:
+    glm::vec3 sourceField(size_t source, const glm::vec3& pos) const;
+    glm::mat3 sourceGradient(size_t source, const glm::vec3& pos) const;
+    // Field at pos, and its Jacobian if gradient is set
+    void evaluate(const glm::vec3& pos, glm::vec3& field, glm::mat3* gradient) const;
+    // Add the far field interpolated from the corners at local in [0, 1], and its Jacobian if gradient is set
+    void interpolate(const glm::vec3& local, const glm::vec3* corner_fields, const glm::mat3* corner_gradients,
+        glm::vec3& field, glm::mat3* gradient) const;
+    // Cell containing pos and the position within it in [0, 1], false outside the bounds
+    bool locate(const glm::vec3& pos, glm::ivec3& cell, glm::vec3& local) const;
+    size_t cellIndex(const glm::ivec3& cell) const { return (static_cast<size_t>(cell.z) * m_dims.y + cell.y) * m_dims.x + cell.x; }
+    size_t nodeIndex(const glm::ivec3& node) const { return (static_cast<size_t>(node.z) * (m_dims.y + 1) + node.y) * (m_dims.x + 1) + node.x; }
+    glm::vec3 nodePosition(const glm::ivec3& node) const { return m_min + glm::vec3(node) * m_cell_size; }
+    // Calls visit with every source up to NEAR_CELLS cells from cell, including its own, and
+    // the offset of the source's cell from cell
+    template <typename Visit>
+    void forEachNearSource(const glm::ivec3& cell, Visit visit) const;
+
+    // Sources
+    std::vector<glm::vec3> m_positions;
+    std::vector<glm::vec3> m_directions;
+    std::vector<float> m_moments;
+    float m_pixels_per_meter{ 100.0f };
+
+    glm::vec3 m_min{ 0.0f };
+    float m_cell_size{ 1.0f };
+    glm::ivec3 m_dims{ 0 };
+
+    // Sources binned by cell, CSR by cell index
+    std::vector<uint32_t> m_cell_offsets;
+    std::vector<uint32_t> m_cell_sources;
+
+    // Field and Jacobian at each node of sources more than NEAR_CELLS cells away, by node index
+    std::vector<glm::vec3> m_node_fields;
+    std::vector<glm::mat3> m_node_gradients;
+};
@@ -0,0 +1,121 @@
+#include "streaming_buffer.h"
+#include "gl_debug.h"
+#include <algorithm>
+#include <iostream>
+
+StreamingBuffer::StreamingBuffer(size_t element_size, const char* label)
+    : m_element_size(element_size), m_label(label), m_persistent(GLAD_GL_VERSION_4_4 != 0) {
+}
+
+StreamingBuffer::~StreamingBuffer() {
+    release();
+}
+
+void StreamingBuffer::setElementSize(size_t element_size) {
+    if (element_size != m_element_size) {
+        release();
+        m_element_size = element_size;
+    }
+}
+
+void StreamingBuffer::release() {
+    for (GLsync& fence : m_fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (m_buffer) {
+        if (m_persistent && m_mapped) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+    }
+    m_mapped = nullptr;
+    m_segment_capacity = 0;
+}
+
+void StreamingBuffer::allocate(size_t segment_capacity) {
+    // Storage is immutable in persistent mode, so growth always means a new buffer object
+    release();
+    m_segment_capacity = segment_capacity;
+    m_segment = 0;
+    size_t total_bytes = SEGMENT_COUNT * m_segment_capacity * m_element_size;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (m_persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, total_bytes, nullptr, flags);
+        m_mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, total_bytes, flags);
+        if (!m_mapped) {
+            // Driver refused the persistent mapping, fall back to per-write mapping
+            std::cerr << "Persistent mapping failed for " << m_label << ", using mapped writes" << std::endl;
+            glDeleteBuffers(1, &m_buffer);
+            m_persistent = false;
+            glGenBuffers(1, &m_buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        }
+    }
+    if (!m_persistent) {
+        glBufferData(GL_ARRAY_BUFFER, total_bytes, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    labelGLObject(GL_BUFFER, m_buffer, m_label);
+    GL_CHECK(m_label);
+}
+
+void StreamingBuffer::waitForSegment(int segment) {
+    GLsync& fence = m_fences[segment];
+    if (!fence) {
+        return;
+    }
+    // Segments are only revisited after SEGMENT_COUNT - 1 other writes, so this rarely blocks
+    GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (result == GL_TIMEOUT_EXPIRED) {
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void* StreamingBuffer::beginWrite(size_t count, bool& reallocated) {
+    reallocated = false;
+    if (count > m_segment_capacity) {
+        allocate(std::max(count, m_segment_capacity * 2));
+        reallocated = true;
+    }
+    else {
+        m_segment = (m_segment + 1) % SEGMENT_COUNT;
+    }
+    waitForSegment(m_segment);
+
+    size_t offset = m_segment * m_segment_capacity * m_element_size;
+    if (m_persistent) {
+        return static_cast<char*>(m_mapped) + offset;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    // The fence already guarantees the GPU is done with this segment
+    m_mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset, std::max<size_t>(count, 1) * m_element_size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    return m_mapped;
+}
+
+void StreamingBuffer::endWrite() {
+    if (!m_persistent) {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_mapped = nullptr;
+    }
+}
+
+void StreamingBuffer::markUsed() {
+    GLsync& fence = m_fences[m_segment];
+    if (fence) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+// Vertex buffer for data that is rewritten wholesale from the CPU, such as traced field
+// lines. Storage is split into a ring of segments: each write goes to the next segment,
+// guarded by a fence placed after the last draw that read it, so uploads never stall
+// on the GPU or reallocate unless the data outgrows the segment size. Capacity doubles
+// on growth. Uses persistently mapped coherent storage on GL 4.4, and unsynchronized
+// glMapBufferRange on older contexts.
+class StreamingBuffer {
+public:
+    static constexpr int SEGMENT_COUNT = 3;
+
+    StreamingBuffer(size_t element_size, const char* label);
+    ~StreamingBuffer();
+
+    StreamingBuffer(const StreamingBuffer&) = delete;
+    StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+
+    // Begin writing count elements, returns the destination. Returns true in reallocated
+    // if the buffer object was recreated, in which case vertex attributes must be re-pointed.
+    void* beginWrite(size_t count, bool& reallocated);
+    // Finish the write started by beginWrite. Its data starts at getBaseElement().
+    void endWrite();
+
+    // Change the element layout, drops the current storage if the size differs
+    void setElementSize(size_t element_size);
+
+    // Place a fence for the current segment, call after issuing draws that read it
+    void markUsed();
+    // Unmap and delete the buffer and fences, call before the context is destroyed
+    void release();
+
+    unsigned int getBuffer() const { return m_buffer; }
+    // Index of the first element of the most recent write, add to draw offsets
+    GLint getBaseElement() const { return static_cast<GLint>(m_segment * m_segment_capacity); }
+    bool isPersistent() const { return m_persistent; }
+
+private:
+    void allocate(size_t segment_capacity);
+    void waitForSegment(int segment);
+
+    size_t m_element_size;
+    const char* m_label;
+    bool m_persistent;
+    unsigned int m_buffer{ 0 };
+    size_t m_segment_capacity{ 0 }; // In elements
+    int m_segment{ 0 };
+    void* m_mapped{ nullptr }; // Whole-buffer mapping in persistent mode, current segment otherwise
+    GLsync m_fences[SEGMENT_COUNT] = {};
+};
@@ -0,0 +1,389 @@
+#include "trajectory_recorder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static constexpr char TRAJECTORY_FILE_MAGIC[8] = { 'M', 'F', 'T', 'R', 'A', 'J', '\0', '\0' };
+static constexpr uint32_t TRAJECTORY_FILE_VERSION = 1;
+static constexpr uint8_t FRAME_KEYFRAME = 1 << 0;
+
+static void writeVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static bool readVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && in < end; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Small signed deltas map to small unsigned values: 0, -1, 1, -2, ...
+static uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Linear extrapolation of a component from the two previous frames
+static int64_t predict(int64_t last, int64_t before_last) {
+    return 2 * last - before_last;
+}
+
+static void writeFloat(std::vector<uint8_t>& out, float value) {
+    uint8_t bytes[sizeof(float)];
+    std::memcpy(bytes, &value, sizeof(float));
+    out.insert(out.end(), bytes, bytes + sizeof(float));
+}
+
+static bool readFloat(const uint8_t*& in, const uint8_t* end, float& value) {
+    if (end - in < static_cast<ptrdiff_t>(sizeof(float))) {
+        return false;
+    }
+    std::memcpy(&value, in, sizeof(float));
+    in += sizeof(float);
+    return true;
+}
+
+TrajectoryRecorder::TrajectoryRecorder(size_t capacity_bytes, uint32_t keyframe_interval)
+    : m_capacity_bytes(capacity_bytes), m_keyframe_interval(std::max(keyframe_interval, 1u)) {
+}
+
+void TrajectoryRecorder::setBounds(const glm::vec3& bounds_min, const glm::vec3& bounds_max) {
+    if (bounds_min != m_bounds_min || bounds_max != m_bounds_max) {
+        m_bounds_min = bounds_min;
+        m_bounds_max = bounds_max;
+        m_force_keyframe = true;
+    }
+}
+
+TrajectoryRecorder::QuantizedDipole TrajectoryRecorder::quantize(const glm::vec3& position, glm::quat rotation, const QuantizedDipole* previous) const {
+    QuantizedDipole q;
+    glm::vec3 extent = glm::max(m_bounds_max - m_bounds_min, glm::vec3(1e-6f));
+    glm::vec3 normalized = glm::clamp((position - m_bounds_min) / extent, 0.0f, 1.0f);
+    for (int i = 0; i < 3; ++i) {
+        q.position[i] = static_cast<uint16_t>(std::lround(normalized[i] * 65535.0f));
+    }
+    // q and -q are the same rotation, keep the sign that continues the previous frame so deltas stay small
+    if (previous) {
+        glm::quat last(previous->rotation[3], previous->rotation[0], previous->rotation[1], previous->rotation[2]);
+        if (glm::dot(last, rotation) < 0.0f) {
+            rotation = -rotation;
+        }
+    }
+    const float components[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+    for (int i = 0; i < 4; ++i) {
+        q.rotation[i] = static_cast<int16_t>(std::lround(glm::clamp(components[i], -1.0f, 1.0f) * 32767.0f));
+    }
+    return q;
+}
+
+void TrajectoryRecorder::record(const DipoleStore& store) {
+    size_t count = store.size();
+    bool keyframe = m_force_keyframe || m_segments.empty() || count != m_encoder.dipoles.size()
+        || m_segments.back().frame_offsets.size() >= m_keyframe_interval
+        || !std::equal(store.getMoments().begin(), store.getMoments().end(), m_encoder.moments.begin());
+
+    FrameState state;
+    state.bounds_min = m_bounds_min;
+    state.bounds_max = m_bounds_max;
+    state.moments = store.getMoments();
+    state.dipoles.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const QuantizedDipole* previous = i < m_encoder.dipoles.size() ? &m_encoder.dipoles[i] : nullptr;
+        state.dipoles[i] = quantize(store.getPosition(i), store.getRotation(i), previous);
+    }
+
+    if (keyframe) {
+        Segment segment;
+        segment.first_frame = m_next_frame;
+        m_segments.push_back(std::move(segment));
+        m_force_keyframe = false;
+    }
+    Segment& segment = m_segments.back();
+    size_t previous_size = segment.bytes.size();
+    segment.frame_offsets.push_back(static_cast<uint32_t>(previous_size));
+    if (!keyframe) {
+        state.previous = m_encoder.dipoles;
+    }
+    encodeFrame(state, keyframe, segment.bytes);
+    segment.dipole_frames += count;
+    m_byte_size += segment.bytes.size() - previous_size;
+    m_encoder = std::move(state);
+    ++m_next_frame;
+    dropOldSegments();
+}
+
+void TrajectoryRecorder::encodeFrame(const FrameState& state, bool keyframe, std::vector<uint8_t>& out) const {
+    out.push_back(keyframe ? FRAME_KEYFRAME : 0);
+    writeVarint(out, state.dipoles.size());
+    if (keyframe) {
+        for (int i = 0; i < 3; ++i) writeFloat(out, state.bounds_min[i]);
+        for (int i = 0; i < 3; ++i) writeFloat(out, state.bounds_max[i]);
+        for (float moment : state.moments) {
+            writeFloat(out, moment);
+        }
+    }
+    // The frame after a keyframe has only one earlier frame, which is then its prediction
+    const std::vector<QuantizedDipole>& before_last = m_encoder.previous.empty() ? m_encoder.dipoles : m_encoder.previous;
+    for (size_t i = 0; i < state.dipoles.size(); ++i) {
+        const QuantizedDipole& q = state.dipoles[i];
+        for (int c = 0; c < 3; ++c) {
+            int64_t base = keyframe ? 0 : predict(m_encoder.dipoles[i].position[c], before_last[i].position[c]);
+            writeVarint(out, zigzag(static_cast<int64_t>(q.position[c]) - base));
+        }
+        for (int c = 0; c < 4; ++c) {
+            int64_t base = keyframe ? 0 : predict(m_encoder.dipoles[i].rotation[c], before_last[i].rotation[c]);
+            writeVarint(out, zigzag(static_cast<int64_t>(q.rotation[c]) - base));
+        }
+    }
+}
+
+bool TrajectoryRecorder::decodeFrame(const Segment& segment, size_t index, FrameState& state) const {
+    const uint8_t* in = segment.bytes.data() + segment.frame_offsets[index];
+    const uint8_t* end = index + 1 < segment.frame_offsets.size()
+        ? segment.bytes.data() + segment.frame_offsets[index + 1]
+        : segment.bytes.data() + segment.bytes.size();
+    if (in >= end) {
+        return false;
+    }
+    bool keyframe = (*in++ & FRAME_KEYFRAME) != 0;
+    uint64_t count;
+    if (!readVarint(in, end, count) || (keyframe != (index == 0)) || (!keyframe && count != state.dipoles.size())) {
+        return false;
+    }
+    if (keyframe) {
+        // Every dipole takes a float moment and seven varints of at least a byte, so a count
+        // beyond that is corrupt and must not size the buffers
+        if (count > static_cast<uint64_t>(end - in) / (sizeof(float) + 7)) {
+            return false;
+        }
+        state.moments.resize(static_cast<size_t>(count));
+        state.dipoles.assign(static_cast<size_t>(count), QuantizedDipole{});
+        state.previous.clear();
+        for (int i = 0; i < 3; ++i) if (!readFloat(in, end, state.bounds_min[i])) return false;
+        for (int i = 0; i < 3; ++i) if (!readFloat(in, end, state.bounds_max[i])) return false;
+        for (float& moment : state.moments) {
+            if (!readFloat(in, end, moment)) return false;
+        }
+    }
+    else {
+        // Shift the history, the frame after a keyframe is predicted from the keyframe alone
+        std::vector<QuantizedDipole> before_last = state.previous.empty() ? state.dipoles : std::move(state.previous);
+        state.previous = state.dipoles;
+        for (size_t i = 0; i < state.dipoles.size(); ++i) {
+            QuantizedDipole& q = state.dipoles[i];
+            for (int c = 0; c < 3; ++c) {
+                q.position[c] = static_cast<uint16_t>(predict(q.position[c], before_last[i].position[c]));
+            }
+            for (int c = 0; c < 4; ++c) {
+                q.rotation[c] = static_cast<int16_t>(predict(q.rotation[c], before_last[i].rotation[c]));
+            }
+        }
+    }
+    for (QuantizedDipole& q : state.dipoles) {
+        uint64_t value;
+        for (int c = 0; c < 3; ++c) {
+            if (!readVarint(in, end, value)) return false;
+            q.position[c] = static_cast<uint16_t>(q.position[c] + unzigzag(value));
+        }
+        for (int c = 0; c < 4; ++c) {
+            if (!readVarint(in, end, value)) return false;
+            q.rotation[c] = static_cast<int16_t>(q.rotation[c] + unzigzag(value));
+        }
+    }
+    return in == end;
+}
+
+bool TrajectoryRecorder::seek(uint64_t frame, DipoleStore& store) {
+    if (empty() || frame < getFirstFrame() || frame > getLastFrame()) {
+        return false;
+    }
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), frame,
+        [](uint64_t f, const Segment& segment) { return f < segment.first_frame; }) - 1;
+    const Segment& segment = *it;
+    size_t target = static_cast<size_t>(frame - segment.first_frame);
+
+    // Continue from the last decoded frame when it is earlier in the same segment
+    size_t start = 0;
+    if (m_decoded_frame != UINT64_MAX && m_decoded_frame >= segment.first_frame && m_decoded_frame <= frame) {
+        start = static_cast<size_t>(m_decoded_frame - segment.first_frame) + 1;
+    }
+    for (size_t i = start; i <= target; ++i) {
+        if (!decodeFrame(segment, i, m_decoder)) {
+            std::cerr << "Corrupt trajectory frame " << segment.first_frame + i << std::endl;
+            m_decoded_frame = UINT64_MAX;
+            return false;
+        }
+    }
+    m_decoded_frame = frame;
+
+    size_t count = m_decoder.dipoles.size();
+    glm::vec3 extent = glm::max(m_decoder.bounds_max - m_decoder.bounds_min, glm::vec3(1e-6f));
+    std::vector<glm::vec3> positions(count);
+    std::vector<glm::quat> rotations(count);
+    for (size_t i = 0; i < count; ++i) {
+        const QuantizedDipole& q = m_decoder.dipoles[i];
+        positions[i] = m_decoder.bounds_min + glm::vec3(q.position[0], q.position[1], q.position[2]) / 65535.0f * extent;
+        rotations[i] = glm::normalize(glm::quat(q.rotation[3], q.rotation[0], q.rotation[1], q.rotation[2]));
+    }
+    if (store.size() == count) {
+        for (size_t i = 0; i < count; ++i) {
+            store.setPose(i, positions[i], rotations[i]);
+            if (store.getMoment(i) != m_decoder.moments[i]) {
+                store.setMoment(i, m_decoder.moments[i]);
+            }
+        }
+    }
+    else {
+        store.assign(count, positions.data(), rotations.data(), m_decoder.moments.data(), nullptr);
+    }
+    return true;
+}
+
+void TrajectoryRecorder::truncate(uint64_t frame) {
+    while (!m_segments.empty() && m_segments.back().first_frame > frame) {
+        m_byte_size -= m_segments.back().bytes.size();
+        m_segments.pop_back();
+    }
+    if (!m_segments.empty()) {
+        Segment& segment = m_segments.back();
+        size_t keep = static_cast<size_t>(frame - segment.first_frame) + 1;
+        if (keep < segment.frame_offsets.size()) {
+            size_t bytes = segment.frame_offsets[keep];
+            m_byte_size -= segment.bytes.size() - bytes;
+            // Dipole counts are constant within a segment
+            segment.dipole_frames = segment.dipole_frames / segment.frame_offsets.size() * keep;
+            segment.bytes.resize(bytes);
+            segment.frame_offsets.resize(keep);
+        }
+    }
+    m_next_frame = empty() ? 0 : getLastFrame() + 1;
+    m_force_keyframe = true;
+    if (m_decoded_frame != UINT64_MAX && m_decoded_frame > frame) {
+        m_decoded_frame = UINT64_MAX;
+    }
+}
+
+void TrajectoryRecorder::clear() {
+    m_segments.clear();
+    m_byte_size = 0;
+    m_next_frame = 0;
+    m_encoder = FrameState();
+    m_force_keyframe = true;
+    m_decoded_frame = UINT64_MAX;
+}
+
+uint64_t TrajectoryRecorder::getLastFrame() const {
+    return m_segments.empty() ? 0 : m_segments.back().first_frame + m_segments.back().frame_offsets.size() - 1;
+}
+
+float TrajectoryRecorder::getBytesPerDipoleFrame() const {
+    uint64_t dipole_frames = 0;
+    for (const Segment& segment : m_segments) {
+        dipole_frames += segment.dipole_frames;
+    }
+    return dipole_frames > 0 ? static_cast<float>(m_byte_size) / dipole_frames : 0.0f;
+}
+
+void TrajectoryRecorder::dropOldSegments() {
+    // Never drop the segment being recorded into
+    while (m_byte_size > m_capacity_bytes && m_segments.size() > 1) {
+        if (m_decoded_frame != UINT64_MAX && m_decoded_frame < m_segments[1].first_frame) {
+            m_decoded_frame = UINT64_MAX;
+        }
+        m_byte_size -= m_segments.front().bytes.size();
+        m_segments.pop_front();
+    }
+}
+
+bool TrajectoryRecorder::saveToFile(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open trajectory file for writing: " << path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> out(TRAJECTORY_FILE_MAGIC, TRAJECTORY_FILE_MAGIC + sizeof(TRAJECTORY_FILE_MAGIC));
+    writeVarint(out, TRAJECTORY_FILE_VERSION);
+    writeVarint(out, m_segments.size());
+    file.write(reinterpret_cast<const char*>(out.data()), out.size());
+    for (const Segment& segment : m_segments) {
+        out.clear();
+        writeVarint(out, segment.first_frame);
+        writeVarint(out, segment.dipole_frames);
+        writeVarint(out, segment.frame_offsets.size());
+        for (uint32_t offset : segment.frame_offsets) {
+            writeVarint(out, offset);
+        }
+        writeVarint(out, segment.bytes.size());
+        file.write(reinterpret_cast<const char*>(out.data()), out.size());
+        file.write(reinterpret_cast<const char*>(segment.bytes.data()), segment.bytes.size());
+    }
+    if (!file) {
+        std::cerr << "Failed to write trajectory file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool TrajectoryRecorder::loadFromFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open trajectory file: " << path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const uint8_t* in = data.data();
+    const uint8_t* end = in + data.size();
+
+    std::deque<Segment> segments;
+    size_t byte_size = 0;
+    uint64_t version = 0, segment_count = 0;
+    bool ok = data.size() >= sizeof(TRAJECTORY_FILE_MAGIC) && std::memcmp(in, TRAJECTORY_FILE_MAGIC, sizeof(TRAJECTORY_FILE_MAGIC)) == 0;
+    in += ok ? sizeof(TRAJECTORY_FILE_MAGIC) : 0;
+    ok = ok && readVarint(in, end, version) && version <= TRAJECTORY_FILE_VERSION && readVarint(in, end, segment_count);
+    for (uint64_t s = 0; ok && s < segment_count; ++s) {
+        Segment segment;
+        uint64_t frame_count = 0, size = 0, value = 0;
+        ok = readVarint(in, end, segment.first_frame) && readVarint(in, end, segment.dipole_frames)
+            && readVarint(in, end, frame_count) && frame_count > 0 && frame_count <= static_cast<uint64_t>(end - in);
+        // Frames start at offset 0 and each takes at least its flags byte, so offsets rise strictly
+        for (uint64_t f = 0; ok && f < frame_count; ++f) {
+            ok = readVarint(in, end, value)
+                && (f == 0 ? value == 0 : value > segment.frame_offsets.back()) && value <= UINT32_MAX;
+            segment.frame_offsets.push_back(static_cast<uint32_t>(value));
+        }
+        ok = ok && readVarint(in, end, size) && size <= static_cast<uint64_t>(end - in)
+            && segment.frame_offsets.back() < size
+            && (segments.empty() || segment.first_frame == segments.back().first_frame + segments.back().frame_offsets.size());
+        if (ok) {
+            segment.bytes.assign(in, in + size);
+            in += size;
+            byte_size += segment.bytes.size();
+            segments.push_back(std::move(segment));
+        }
+    }
+    if (!ok) {
+        std::cerr << "Failed to load trajectory file " << path << ": not a trajectory file or corrupt" << std::endl;
+        return false;
+    }
+
+    clear();
+    m_segments = std::move(segments);
+    m_byte_size = byte_size;
+    m_next_frame = empty() ? 0 : getLastFrame() + 1;
+    return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "dipole_store.h"
+
+// Records simulated dipole states for replay without re-simulating. Each frame is
+// quantized (16-bit positions within the bounds, 16-bit quaternion components) and stored
+// as zigzag varint residuals against a linear extrapolation of the two previous frames, so
+// smooth motion costs about a byte per component.
+// Keyframes with absolute values start every keyframe interval, and whenever the dipole
+// count, a moment or the bounds change, so any frame decodes from at most one interval of
+// deltas. Keyframes open segments, the oldest segments are dropped once the recording
+// exceeds its byte capacity, which makes the recording a ring buffer of recent history.
+class TrajectoryRecorder {
+public:
+    explicit TrajectoryRecorder(size_t capacity_bytes = 256u << 20, uint32_t keyframe_interval = 60);
+
+    // Quantization range for positions, a change starts a new keyframe
+    void setBounds(const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+    // Append the store's current state as the next frame
+    void record(const DipoleStore& store);
+    // Decode frame and apply it to the store, returns false if it is not recorded.
+    // Poses are set in place when the dipole count matches so handles stay valid.
+    bool seek(uint64_t frame, DipoleStore& store);
+    // Drop every frame after frame, recording continues from a new keyframe
+    void truncate(uint64_t frame);
+    void clear();
+
+    bool empty() const { return m_segments.empty(); }
+    uint64_t getFirstFrame() const { return m_segments.empty() ? 0 : m_segments.front().first_frame; }
+    uint64_t getLastFrame() const;
+    uint64_t getFrameCount() const { return empty() ? 0 : getLastFrame() - getFirstFrame() + 1; }
+    size_t getByteSize() const { return m_byte_size; }
+    // Average encoded bytes per dipole per frame, for judging the compression
+    float getBytesPerDipoleFrame() const;
+
+    bool saveToFile(const std::string& path) const;
+    bool loadFromFile(const std::string& path);
+
+private:
+    struct QuantizedDipole {
+        uint16_t position[3];
+        int16_t rotation[4]; // x, y, z, w
+    };
+
+    // Keyframe followed by delta frames, frame_offsets[i] is where frame first_frame + i starts
+    struct Segment {
+        uint64_t first_frame{ 0 };
+        std::vector<uint32_t> frame_offsets;
+        std::vector<uint8_t> bytes;
+        uint64_t dipole_frames{ 0 }; // Sum of dipole counts over its frames
+    };
+
+    // Decoded frame, also the reference the next delta frame is predicted from
+    struct FrameState {
+        glm::vec3 bounds_min{ 0.0f };
+        glm::vec3 bounds_max{ 0.0f };
+        std::vector<float> moments;
+        std::vector<QuantizedDipole> dipoles;
+        std::vector<QuantizedDipole> previous; // Frame before, empty on keyframes
+    };
+
+    QuantizedDipole quantize(const glm::vec3& position, glm::quat rotation, const QuantizedDipole* previous) const;
+    void encodeFrame(const FrameState& state, bool keyframe, std::vector<uint8_t>& out) const;
+    // Decode the frame at offset in segment on top of state, returns false on corrupt data
+    bool decodeFrame(const Segment& segment, size_t index, FrameState& state) const;
+    void dropOldSegments();
+
+    size_t m_capacity_bytes;
+    uint32_t m_keyframe_interval;
+    glm::vec3 m_bounds_min{ -1.0f };
+    glm::vec3 m_bounds_max{ 1.0f };
+    std::deque<Segment> m_segments;
+    size_t m_byte_size{ 0 };
+    uint64_t m_next_frame{ 0 };
+    FrameState m_encoder;             // Last recorded frame
+    bool m_force_keyframe{ true };
+
+    // Playback cursor, lets sequential seeks continue from the last decoded frame
+    FrameState m_decoder;
+    uint64_t m_decoded_frame{ UINT64_MAX };
+};
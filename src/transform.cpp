@@ -1,10 +1,10 @@
 #include "transform.h"
+#include <algorithm>
 #include <iostream>
 
 Transform::Transform(glm::vec3 localPosition, glm::vec3 localEulerRotation, Transform* parent)
-    : mLocalPosition(localPosition), parent(parent), mWorldTransformMatrix(1.0f) {
+    : mLocalPosition(localPosition), parent(parent), mWorldTransformMatrix(1.0f), mInverseWorldTransformMatrix(1.0f) {
     setLocalRotationEuler(localEulerRotation);
-    updateWorldTransformMatrix();
     if (parent) {
         parent->addChild(this);
     }
@@ -19,6 +19,7 @@ Transform::~Transform() {
     for (Transform* child : mChildren) {
         if (child) {
             child->parent = nullptr;
+            child->markWorldTransformDirty();
         }
     }
     mChildren.clear();
@@ -26,7 +27,7 @@ Transform::~Transform() {
 
 void Transform::setLocalPosition(glm::vec3 localPosition) {
     mLocalPosition = localPosition;
-    updateWorldTransformMatrix();
+    markWorldTransformDirty();
 }
 
 glm::vec3 Transform::getLocalPosition() const {
@@ -35,24 +36,22 @@ glm::vec3 Transform::getLocalPosition() const {
 
 void Transform::setWorldPosition(glm::vec3 globalPosition) {
     if (parent) {
-        glm::mat4 parentInverseGlobal = glm::inverse(parent->getWorldTransformMatrix());
-        glm::vec4 localPos = parentInverseGlobal * glm::vec4(globalPosition, 1.0f);
-        mLocalPosition = glm::vec3(localPos);
+        mLocalPosition = parent->inverseTransformPoint(globalPosition);
     }
     else {
         mLocalPosition = globalPosition;
     }
-    updateWorldTransformMatrix();
+    markWorldTransformDirty();
 }
 
 glm::vec3 Transform::getWorldPosition() const {
-    glm::vec4 worldPos = getWorldTransformMatrix() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-    return glm::vec3(worldPos);
+    updateWorldTransformMatrix();
+    return glm::vec3(mWorldTransformMatrix[3]);
 }
 
 void Transform::setLocalRotation(glm::quat localRotation) {
     mLocalRotation = localRotation;
-    updateWorldTransformMatrix();
+    markWorldTransformDirty();
 }
 
 glm::quat Transform::getLocalRotation() const {
@@ -67,19 +66,17 @@ void Transform::setWorldRotation(glm::quat globalRotation) {
     else {
         mLocalRotation = globalRotation;
     }
-    updateWorldTransformMatrix();
+    markWorldTransformDirty();
 }
 
 glm::quat Transform::getWorldRotation() const {
-    if (parent) {
-        return parent->getWorldRotation() * mLocalRotation;
-    }
-    return mLocalRotation;
+    updateWorldTransformMatrix();
+    return mWorldRotation;
 }
 
 void Transform::setLocalRotationEuler(glm::vec3 localRotationEuler) {
     mLocalRotation = glm::quat(glm::radians(localRotationEuler));
-    updateWorldTransformMatrix();
+    markWorldTransformDirty();
 }
 
 void Transform::setWorldRotationEuler(glm::vec3 globalRotationEuler) {
@@ -87,20 +84,31 @@ void Transform::setWorldRotationEuler(glm::vec3 globalRotationEuler) {
     setWorldRotation(globalRotation);
 }
 
+void Transform::setWorldPositionAndRotation(glm::vec3 globalPosition, glm::quat globalRotation) {
+    if (parent) {
+        mLocalPosition = parent->inverseTransformPoint(globalPosition);
+        mLocalRotation = glm::inverse(parent->getWorldRotation()) * globalRotation;
+    }
+    else {
+        mLocalPosition = globalPosition;
+        mLocalRotation = globalRotation;
+    }
+    markWorldTransformDirty();
+}
+
 void Transform::rotateAround(const glm::vec3& worldPoint, const glm::vec3& axis, float angleDegrees) {
     glm::vec3 worldPos = getWorldPosition();
     glm::vec3 dirFromPivot = worldPos - worldPoint;
     glm::quat rotation = glm::angleAxis(glm::radians(angleDegrees), glm::normalize(axis));
     glm::vec3 rotatedDir = rotation * dirFromPivot;
     glm::vec3 newWorldPos = worldPoint + rotatedDir;
-    setWorldPosition(newWorldPos);
-    setWorldRotation(rotation * getWorldRotation());
+    setWorldPositionAndRotation(newWorldPos, rotation * getWorldRotation());
 }
 
 void Transform::rotateAxis(const glm::vec3& axis, float angleDegrees) {
     glm::quat rotation = glm::angleAxis(glm::radians(angleDegrees), glm::normalize(axis));
     mLocalRotation = mLocalRotation * rotation;
-    updateWorldTransformMatrix();
+    markWorldTransformDirty();
 }
 
 void Transform::lookAt(const glm::vec3& target, const glm::vec3& worldUp) {
@@ -134,36 +142,36 @@ void Transform::translateLocal(const glm::vec3& localOffset) {
     translate(worldOffset);
 }
 
-glm::vec3 Transform::transformDirection(const glm::vec3& direction) {
+glm::vec3 Transform::transformDirection(const glm::vec3& direction) const {
     return getWorldRotation() * direction;
 }
 
-glm::vec3 Transform::inverseTransformDirection(const glm::vec3& worldDirection) {
+glm::vec3 Transform::inverseTransformDirection(const glm::vec3& worldDirection) const {
     return glm::inverse(getWorldRotation()) * worldDirection;
 }
 
-glm::vec3 Transform::transformPoint(const glm::vec3& point) {
+glm::vec3 Transform::transformPoint(const glm::vec3& point) const {
     glm::vec4 result = getWorldTransformMatrix() * glm::vec4(point, 1.0f);
     return glm::vec3(result);
 }
 
-glm::vec3 Transform::inverseTransformPoint(const glm::vec3& worldPoint) {
-    glm::vec4 result = glm::inverse(getWorldTransformMatrix()) * glm::vec4(worldPoint, 1.0f);
+glm::vec3 Transform::inverseTransformPoint(const glm::vec3& worldPoint) const {
+    glm::vec4 result = getInverseWorldTransformMatrix() * glm::vec4(worldPoint, 1.0f);
     return glm::vec3(result);
 }
 
 void Transform::setParent(Transform* newParent) {
+    // Capture world state before detaching, removeChild clears our parent pointer
+    glm::vec3 globalPos = getWorldPosition();
+    glm::quat globalRot = getWorldRotation();
     if (parent) {
         parent->removeChild(this);
     }
-    glm::vec3 globalPos = getWorldPosition();
-    glm::quat globalRot = getWorldRotation();
     parent = newParent;
     if (parent) {
         parent->addChild(this);
     }
-    setWorldPosition(globalPos);
-    setWorldRotation(globalRot);
+    setWorldPositionAndRotation(globalPos, globalRot);
 }
 
 Transform* Transform::getParent() const {
@@ -180,6 +188,7 @@ void Transform::removeChild(Transform* child) {
     auto it = std::find(mChildren.begin(), mChildren.end(), child);
     if (it != mChildren.end()) {
         (*it)->parent = nullptr; // Clear child's parent pointer
+        (*it)->markWorldTransformDirty();
         mChildren.erase(it);
     }
 }
@@ -202,19 +211,52 @@ glm::mat4 Transform::getLocalTransformMatrix() const {
 }
 
 glm::mat4 Transform::getWorldTransformMatrix() const {
+    updateWorldTransformMatrix();
     return mWorldTransformMatrix;
 }
 
-void Transform::updateWorldTransformMatrix() {
+glm::mat4 Transform::getInverseWorldTransformMatrix() const {
+    updateWorldTransformMatrix();
+    if (mInverseWorldDirty) {
+        mInverseWorldTransformMatrix = glm::inverse(mWorldTransformMatrix);
+        mInverseWorldDirty = false;
+    }
+    return mInverseWorldTransformMatrix;
+}
+
+void Transform::resolveWorldTransforms() const {
+    updateWorldTransformMatrix();
+    for (const Transform* child : mChildren) {
+        child->resolveWorldTransforms();
+    }
+}
+
+void Transform::markWorldTransformDirty() {
+    // A dirty node always has a dirty subtree, so there is nothing left to propagate
+    if (mWorldDirty) {
+        return;
+    }
+    mWorldDirty = true;
+    mInverseWorldDirty = true;
+    onWorldTransformChanged();
+    for (auto& child : mChildren) {
+        child->markWorldTransformDirty();
+    }
+}
+
+void Transform::updateWorldTransformMatrix() const {
+    if (!mWorldDirty) {
+        return;
+    }
     if (parent) {
         mWorldTransformMatrix = parent->getWorldTransformMatrix() * getLocalTransformMatrix();
+        mWorldRotation = parent->getWorldRotation() * mLocalRotation;
     }
     else {
         mWorldTransformMatrix = getLocalTransformMatrix();
+        mWorldRotation = mLocalRotation;
     }
-    for (auto& child : mChildren) {
-        child->updateWorldTransformMatrix();
-    }
+    mWorldDirty = false;
 }
 
 glm::vec3 Transform::getForward() const {
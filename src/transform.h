@@ -10,7 +10,7 @@
 class Transform {
 public:
     Transform(glm::vec3 localPosition, glm::vec3 localEulerRotation, Transform* parent = nullptr);
-    ~Transform();
+    virtual ~Transform();
 
     void setLocalPosition(glm::vec3 localPosition);
     glm::vec3 getLocalPosition() const;
@@ -27,16 +27,19 @@ public:
     void setLocalRotationEuler(glm::vec3 localRotationEuler);
     void setWorldRotationEuler(glm::vec3 localRotationEuler);
 
+    // Set world position and rotation together, marking the subtree dirty only once
+    void setWorldPositionAndRotation(glm::vec3 globalPosition, glm::quat globalRotation);
+
     void rotateAround(const glm::vec3& worldPoint, const glm::vec3& axis, float angleDegrees);
     void rotateAxis(const glm::vec3& axis, float angleDegrees);
     void lookAt(const glm::vec3& target, const glm::vec3& worldUp = glm::vec3(0.0f, 1.0f, 0.0f));
 
     void translate(const glm::vec3& offset);
     void translateLocal(const glm::vec3& localOffset);
-    glm::vec3 transformDirection(const glm::vec3& direction);
-    glm::vec3 inverseTransformDirection(const glm::vec3& worldDirection);
-    glm::vec3 transformPoint(const glm::vec3& point);
-    glm::vec3 inverseTransformPoint(const glm::vec3& worldPoint);
+    glm::vec3 transformDirection(const glm::vec3& direction) const;
+    glm::vec3 inverseTransformDirection(const glm::vec3& worldDirection) const;
+    glm::vec3 transformPoint(const glm::vec3& point) const;
+    glm::vec3 inverseTransformPoint(const glm::vec3& worldPoint) const;
 
     void setParent(Transform* newParent);
     Transform* getParent() const;
@@ -48,17 +51,36 @@ public:
 
     glm::mat4 getLocalTransformMatrix() const;
     glm::mat4 getWorldTransformMatrix() const;
+    glm::mat4 getInverseWorldTransformMatrix() const;
 
-    virtual void updateWorldTransformMatrix();
+    // Resolve cached world state for this transform and all descendants, so that
+    // concurrent readers (e.g. tracer worker threads) never trigger a lazy update
+    void resolveWorldTransforms() const;
 
     glm::vec3 getForward() const;
     glm::vec3 getRight() const;
     glm::vec3 getUp() const;
 
+protected:
+    // Called when the world transform of this node becomes stale, either because it
+    // changed locally or because an ancestor moved. Must stay cheap: no recomputation here.
+    virtual void onWorldTransformChanged() {}
+
 private:
+    // Flag this transform and its subtree as stale, to be recomputed on first read
+    void markWorldTransformDirty();
+    // Recompute cached world matrix and rotation if stale
+    void updateWorldTransformMatrix() const;
+
     glm::vec3 mLocalPosition;
     glm::quat mLocalRotation;
     Transform* parent;
     std::vector<Transform*> mChildren;
-    glm::mat4 mWorldTransformMatrix;
-};
\ No newline at end of file
+
+    // Lazily computed world state
+    mutable glm::mat4 mWorldTransformMatrix;
+    mutable glm::mat4 mInverseWorldTransformMatrix;
+    mutable glm::quat mWorldRotation;
+    mutable bool mWorldDirty = true;
+    mutable bool mInverseWorldDirty = true;
+};